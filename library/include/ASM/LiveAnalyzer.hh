@@ -7,6 +7,7 @@
 #include <list>
 #include <memory>
 #include <optional>
+#include <stdexcept>
 #include "ASM/Common.hh"
 #include "MacroUtil.hh"
 
@@ -112,6 +113,14 @@ public:
         return symSet;
     }
 
+    // dfn所在基本块(dfn连续，中间没有跳转和标号)最后一个结点的dfn
+    size_t get_blockEndDfn(size_t dfn) const
+    {
+        if (dfn >= blockEndDfn.size())
+            throw std::out_of_range("LiveAnalyzer: get_blockEndDfn index out of range");
+        return blockEndDfn[dfn];
+    }
+
 private:
 
     // 流图结点上的活跃信息
@@ -124,11 +133,16 @@ private:
     std::unordered_set<SymPtr> symSet;  
     // 控制流图
     std::shared_ptr<ControlFlowGraph> cfg;
+    // 以dfn为下标，所在基本块末尾结点的dfn
+    std::vector<size_t> blockEndDfn;
 
 
     // 遍历流图，得到每个变量的定值和使用集合，函数中出现的所有变量的集合
     void bfs();
 
+    // 求出每个结点所在基本块的末尾
+    void calBlockEnd();
+
 };
 
 
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 #include "ASM/Common.hh"
 #include "TAC/ThreeAddressCode.hh"
 
@@ -7,12 +10,13 @@ namespace HaveFunCompiler{
 namespace AssemblyBuilder{
 
 class LiveAnalyzer;
+class SideEffectAnalyzer;
 
 // optimizer需要保证，不修改fbegin和fend
 class DeadCodeOptimizer
 {
 public:
-    DeadCodeOptimizer(TACListPtr tacList, TACList::iterator fbegin, TACList::iterator fend) : _fbegin(fbegin), _fend(fend), _tacls(tacList) {}
+    DeadCodeOptimizer(TACListPtr tacList, TACList::iterator fbegin, TACList::iterator fend, const SideEffectAnalyzer *sideEffect) : _fbegin(fbegin), _fend(fend), _tacls(tacList), _sideEffect(sideEffect) {}
     NONCOPYABLE(DeadCodeOptimizer)
 
     void optimize();
@@ -20,9 +24,355 @@ public:
 private:
     TACList::iterator _fbegin, _fend;
     TACListPtr _tacls;
+    // 结果不用的调用，被调函数没有副作用时可以删去
+    const SideEffectAnalyzer *_sideEffect;
 
     bool hasSideEffect(SymbolPtr defSym, TACPtr tac);
 };
 
+// 自身尾调用改为循环
+// 形参声明之后放一个循环头标号，尾调用改为把实参并行赋值给形参，然后跳回循环头
+// return f(...) + x 和 return f(...) * x 把x并入累加量后同样改为循环，其余的返回值都要和累加量运算
+// x改为在调用之前读，所以x只能是常数、局部标量，或者函数本身不写全局变量和数组形参、不调用库函数
+// 数组形参只能原样传递，否则不处理
+class TailRecursionEliminator
+{
+public:
+    TailRecursionEliminator(TACListPtr tacList, TACList::iterator fbegin, TACList::iterator fend, const SideEffectAnalyzer *sideEffect) : _fbegin(fbegin), _fend(fend), _tacls(tacList), _sideEffect(sideEffect) {}
+    NONCOPYABLE(TailRecursionEliminator)
+
+    void optimize();
+
+private:
+    TACList::iterator _fbegin, _fend;
+    TACListPtr _tacls;
+    const SideEffectAnalyzer *_sideEffect;
+
+    // 形参列表
+    std::vector<SymbolPtr> params;
+
+    // call是尾调用时返回紧挨着它的实参的起始位置，否则返回_fend
+    // 调用结果还要和累加量运算时accOp指向这条运算，否则为_fend
+    TACList::iterator matchTailCall(TACList::iterator call, TACList::iterator *accOp) const;
+};
+
+// 全局标量提升为局部变量
+// 在函数入口把全局变量读入局部变量，函数中的访问全部改为访问局部变量，返回前写回
+// 调用访问全局变量的用户函数前写回、调用写全局变量的用户函数后重新读入，这样寄存器分配器就可以把它放在寄存器中
+class GlobalScalarPromoter
+{
+public:
+    GlobalScalarPromoter(TACListPtr tacList, TACList::iterator fbegin, TACList::iterator fend, const SideEffectAnalyzer *sideEffect) : _fbegin(fbegin), _fend(fend), _tacls(tacList), _sideEffect(sideEffect) {}
+    NONCOPYABLE(GlobalScalarPromoter)
+
+    void optimize();
+
+private:
+    TACList::iterator _fbegin, _fend;
+    TACListPtr _tacls;
+    const SideEffectAnalyzer *_sideEffect;
+
+    // tac所在的循环嵌套深度，按跳回前面标签的跳转估计
+    std::unordered_map<TACPtr, int> loopDepth;
+
+    void computeLoopDepth();
+
+    // 按循环深度加权的执行次数估计
+    int weight(TACPtr tac) const;
+
+    // 可以提升的全局标量
+    bool isPromotable(SymbolPtr sym) const;
+
+    // tac中对sym的引用（包括作为数组下标）
+    bool references(TACPtr tac, SymbolPtr sym) const;
+
+    // 被调函数可能读(写)全局变量的调用
+    bool callReadsGlobal(TACPtr tac) const;
+    bool callWritesGlobal(TACPtr tac) const;
+
+    // written为false时不需要写回
+    void promote(SymbolPtr global, bool written);
+};
+
+// 全局常量数组 -> 展开后的下标 -> 初值(字面量)，没有记录的元素为0
+using ConstArrayValues = std::unordered_map<SymbolPtr, std::unordered_map<int, SymbolPtr>>;
+
+// 读全局常量数组时，下标是常量就直接换成初值
+// 下标由只赋值一次的int变量算出时也当作常量，算下标的代码留给之后的死代码删除
+class ConstArrayFolder
+{
+public:
+    ConstArrayFolder(TACListPtr tacList, TACList::iterator fbegin, TACList::iterator fend, const ConstArrayValues *constArrays) : _fbegin(fbegin), _fend(fend), _tacls(tacList), _constArrays(constArrays) {}
+    NONCOPYABLE(ConstArrayFolder)
+
+    void optimize();
+
+    // 从函数之外的初始化代码中收集全局常量数组的初值
+    static ConstArrayValues collect(TACListPtr tacList);
+
+private:
+    TACList::iterator _fbegin, _fend;
+    TACListPtr _tacls;
+    const ConstArrayValues *_constArrays;
+
+    // 值在编译时已知的int标量
+    std::unordered_map<SymbolPtr, int> known;
+
+    void computeKnown();
+
+    // sym是字面量或已知的标量时取出它的值
+    bool valueOf(SymbolPtr sym, int *value) const;
+};
+
+
+// 小的局部数组拆成标量(SROA)，之后寄存器分配器可以把各个元素放在寄存器中
+// 要求所有访问的下标都是字面量，地址只用于初始化时的_builtin_clear/_builtin_copy
+// 这两种调用改为对各元素的赋值，其余传地址的用法(数组实参)都不处理
+class ArrayScalarizer
+{
+public:
+    ArrayScalarizer(TACListPtr tacList, TACList::iterator fbegin, TACList::iterator fend, const ConstArrayValues *constArrays) : _fbegin(fbegin), _fend(fend), _tacls(tacList), _constArrays(constArrays) {}
+    NONCOPYABLE(ArrayScalarizer)
+
+    void optimize();
+
+private:
+    // 元素数不超过这么多的数组才拆开
+    static const int MAX_ELEMENTS = 8;
+
+    TACList::iterator _fbegin, _fend;
+    TACListPtr _tacls;
+    // 初始化模板的初值
+    const ConstArrayValues *_constArrays;
+
+    // 初始化数组的一次_builtin_clear或_builtin_copy调用，[first, call]是实参和调用
+    struct InitCall
+    {
+        TACList::iterator first, call;
+        int offset, count;
+        // _builtin_copy的源数组及起始下标，_builtin_clear时source为空
+        SymbolPtr source;
+        int sourceOffset;
+    };
+
+    // 从it(传数组地址的实参)开始是否为初始化调用，是则填入init
+    bool matchInitCall(TACList::iterator it, InitCall *init) const;
+
+    // 初始化后数组第init.offset+k个元素(已拆成标量element)的值，模板中没有记录的为0
+    SymbolPtr templateValue(const InitCall &init, int k, SymbolPtr element) const;
+};
+
+// 基本块内的数组访问优化：读刚写入或刚读过的元素改为复制，覆盖前没被读过的写入删去
+// 别名分析：不同的局部数组、不同的全局数组互不重叠；数组形参可能指向任何全局数组或调用者的数组，但不会指向本函数的局部数组
+// 同一数组的两次访问，下标经过局部值编号后相同则是同一元素，都是不同的字面量则不重叠，否则可能重叠
+class ArrayAccessOptimizer
+{
+public:
+    ArrayAccessOptimizer(TACListPtr tacList, TACList::iterator fbegin, TACList::iterator fend, const SideEffectAnalyzer *sideEffect) : _fbegin(fbegin), _fend(fend), _tacls(tacList), _sideEffect(sideEffect) {}
+    NONCOPYABLE(ArrayAccessOptimizer)
+
+    void optimize();
+
+private:
+    TACList::iterator _fbegin, _fend;
+    TACListPtr _tacls;
+    const SideEffectAnalyzer *_sideEffect;
+
+    // 数组形参(以及它们的基址)
+    std::unordered_set<SymbolPtr> paramArrays;
+
+    // 已知内容的数组元素：base[offset]的值等于value
+    // store指向写入它的tac，写入后还没有可能读它的代码时pending为true
+    struct Element
+    {
+        SymbolPtr base, offset, value;
+        TACList::iterator store;
+        bool pending;
+    };
+    std::vector<Element> elements;
+
+    // 局部值编号：变量 -> 与它值相同的代表变量(或字面量)
+    std::unordered_map<SymbolPtr, SymbolPtr> canon;
+    // 已算过的 代表(b) op 代表(c)，结果在result中
+    struct Expr
+    {
+        ThreeAddressCode::TACOperationType op;
+        SymbolPtr b, c, result;
+    };
+    std::vector<Expr> exprs;
+
+    void clear();
+
+    SymbolPtr rep(SymbolPtr sym) const;
+
+    // sym被重新赋值，和它的旧值有关的记录都作废
+    void kill(SymbolPtr sym);
+
+    // 两个数组的元素可能重叠
+    bool mayAlias(SymbolPtr base1, SymbolPtr base2) const;
+
+    // base[offset]可能和已知元素e重叠
+    bool mayAlias(const Element &e, SymbolPtr base, SymbolPtr offset) const;
+
+    // 可能被读(写)的元素：写入不再能删去(已知内容作废)，offset为空时表示数组的任意元素
+    void markRead(SymbolPtr base, SymbolPtr offset);
+    void markWritten(SymbolPtr base, SymbolPtr offset);
+
+    // 调用可能写全局变量时，和全局标量有关的记录作废
+    void killGlobals();
+
+    // 处理定值tac的局部值编号
+    void number(TACPtr tac);
+
+    // 读写数组元素的赋值，返回false表示tac被删去
+    bool load(TACPtr tac);
+    bool store(TACList::iterator it);
+};
+
+// 完美嵌套的两层计数循环的交换和分块
+// 处理 i = a; goto Ci; Li: j = b; goto Cj; Lj: 循环体; j增量; Cj: j的条件; ifz goto Lj; Bj: i增量; Ci: i的条件; ifz goto Li; Bi:
+// 循环体是不含调用和跳转的一段代码，两层的初值和条件都与另一层无关，i、j在循环之后不再使用
+// 下标按行优先逐维展开成i、j的仿射函数(假设每一维都不越界)，被写的数组只能以相同的下标访问，且依赖不能让交换后的顺序颠倒
+// 跨步访问更少的顺序作为内层；内层仍有跨步访问时，把内层循环按L1大小分块，让跨步访问的缓存行在外层相邻几次之间复用
+class LoopNestOptimizer
+{
+public:
+    LoopNestOptimizer(TACListPtr tacList, TACList::iterator fbegin, TACList::iterator fend, int l1CacheSize) : _fbegin(fbegin), _fend(fend), _tacls(tacList), _l1CacheSize(l1CacheSize) {}
+    NONCOPYABLE(LoopNestOptimizer)
+
+    void optimize();
+
+private:
+    static const int CACHE_LINE_SIZE = 64;
+    // 块太小时分块的额外开销超过收益
+    static const int MIN_TILE_SIZE = 16;
+
+    TACList::iterator _fbegin, _fend;
+    TACListPtr _tacls;
+    int _l1CacheSize;
+
+    // 数组形参(以及它们的基址)
+    std::unordered_set<SymbolPtr> paramArrays;
+    // 每个标号被跳转到的次数
+    std::unordered_map<SymbolPtr, int> labelRefs;
+    // 分块时新建的标号和变量的编号
+    int tileCount = 0;
+
+    // 一层循环：循环变量和步长，初值赋值，跳到条件的goto，循环头标号，增量的第一条(到条件的标号为止)，条件的标号和跳回循环头的ifz
+    struct Loop
+    {
+        SymbolPtr var;
+        int step;
+        TACList::iterator init, jump, head, incBegin, condLabel, branch;
+    };
+    struct Nest
+    {
+        Loop outer, inner;
+        // 两层的初值、goto和循环头之间夹着的标量声明
+        std::vector<TACList::iterator> decls;
+        // 循环体从bodyBegin到inner.incBegin，整个嵌套从outer.init到end
+        TACList::iterator bodyBegin, end;
+    };
+
+    // 下标的一维：外层变量系数、内层变量系数和常数
+    struct Term
+    {
+        long long coef[2];
+        long long constant;
+    };
+    // 按行优先逐维展开的下标，sizes[k]是第k+1维的长度
+    struct Subscript
+    {
+        std::vector<Term> dims;
+        std::vector<long long> sizes;
+    };
+    struct Access
+    {
+        SymbolPtr base;
+        bool write;
+        // 下标不是仿射函数时为false
+        bool affine;
+        Subscript subscript;
+    };
+
+    // it指向外层循环的初值赋值
+    bool match(TACList::iterator it, Nest *nest) const;
+
+    // 检查嵌套能否交换和分块，并收集循环体中的数组访问
+    bool analyze(const Nest &nest, const std::unordered_set<SymbolPtr> &liveOut, std::vector<Access> *accesses) const;
+
+    // op是加减乘时由两个仿射值算出结果，结果不是仿射函数时返回false
+    static bool evaluate(ThreeAddressCode::TACOperationType op, const Subscript &x, const Subscript &y, Subscript *result);
+
+    // 被写元素的依赖在交换后仍然保持先后顺序
+    static bool permutable(const Subscript &subscript);
+
+    // 下标中var(0为外层，1为内层)每加1元素地址移动的元素个数
+    static long long stride(const Subscript &subscript, int var);
+
+    // 交换内外层，返回交换后外层初值赋值的位置
+    TACList::iterator interchange(const Nest &nest);
+
+    // 内层循环每tileSize次迭代分为一块，块的循环放在最外面
+    void tile(const Nest &nest, int tileSize);
+};
+
+// 最内层计数循环的展开
+// 处理 goto C; H: 循环体; i增量; C: t = i rel n; x = !t; ifz x goto H，循环体是不含调用和跳转的一段代码，n在循环中不变
+// 初值和次数都已知、展开后不超过规模限制的循环完全展开，各份中代入i的值并折叠常量；
+// 其余的循环按因子展开成新的循环，剩下的不足一轮的迭代仍由原来的循环执行
+class LoopUnroller
+{
+public:
+    LoopUnroller(TACListPtr tacList, TACList::iterator fbegin, TACList::iterator fend, int maxTimes, int maxInsns) : _fbegin(fbegin), _fend(fend), _tacls(tacList), _maxTimes(maxTimes), _maxInsns(maxInsns) {}
+    NONCOPYABLE(LoopUnroller)
+
+    void optimize();
+
+private:
+    TACList::iterator _fbegin, _fend;
+    TACListPtr _tacls;
+    // 部分展开的最大因子，展开后循环体(不算声明)的最大tac数
+    int _maxTimes, _maxInsns;
+
+    // 每个标号被跳转到的次数
+    std::unordered_map<SymbolPtr, int> labelRefs;
+    // 展开时新建的标号和变量的编号
+    int unrollCount = 0;
+
+    struct Loop
+    {
+        SymbolPtr var;
+        int step;
+        // 继续循环的条件是 var rel bound，bound是字面量或循环中不变的量
+        ThreeAddressCode::TACOperationType rel;
+        SymbolPtr bound;
+        // 循环之前给var赋的常数初值
+        bool initKnown;
+        int init;
+        // 跳到条件的goto，循环头标号，增量的第一条，条件的标号，条件中的比较和跳回循环头的ifz
+        TACList::iterator jump, head, incBegin, condLabel, compare, branch;
+        // 条件中在比较之前算出bound的tac
+        std::vector<TACList::iterator> boundDefs;
+        // 循环体和增量中不算声明的tac数
+        int size;
+    };
+
+    // it指向循环之前的goto
+    bool match(TACList::iterator it, Loop *loop) const;
+
+    // 初值和bound都是常数时模拟出循环的次数，超过limit或无法确定时返回-1
+    static int tripCount(const Loop &loop, int limit);
+
+    // 循环体和增量复制一份插到pos之前，其中声明的变量换成新的；value不为空时代入循环变量的值并折叠常量
+    void copyBody(const Loop &loop, TACList::iterator pos, const std::string &suffix, const int *value);
+
+    void unrollFully(const Loop &loop, int trips);
+
+    // 展开成每轮执行times次的循环，放在原来的循环之前；调整后的界超出int范围时返回false
+    // n不是常数时运行时先检查调整后的界，会溢出就跳过展开的循环
+    bool unroll(const Loop &loop, int times);
+};
+
 }
 }
\ No newline at end of file
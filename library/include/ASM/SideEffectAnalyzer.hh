@@ -0,0 +1,70 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ASM/Common.hh"
+#include "MacroUtil.hh"
+#include "TAC/ThreeAddressCode.hh"
+
+namespace HaveFunCompiler{
+namespace AssemblyBuilder{
+
+// 函数的副作用摘要，包含它直接或间接调用的函数
+struct FunctionSummary
+{
+    bool readGlobal = false;        // 读全局变量
+    bool writeGlobal = false;       // 写全局变量
+    bool readParamArray = false;    // 通过数组形参读
+    bool writeParamArray = false;   // 通过数组形参写
+    bool io = false;                // 调用了库函数(输入输出、计时)
+
+    // 有外部可见的副作用，结果不用时调用也不能删去
+    bool hasSideEffect() const { return writeGlobal || writeParamArray || io; }
+
+    // 结果只取决于实参的值，可以当作普通表达式处理
+    bool isPure() const { return !hasSideEffect() && !readGlobal && !readParamArray; }
+};
+
+// 在整个三地址码上建立调用图，迭代到不动点求出每个用户函数的副作用摘要
+// 没有定义的被调函数(库函数)一律视为输入输出，并且读写传给它的数组
+class SideEffectAnalyzer
+{
+public:
+    SideEffectAnalyzer(TACListPtr tacList);
+    NONCOPYABLE(SideEffectAnalyzer)
+
+    // 函数的摘要，不是用户函数时返回nullptr
+    const FunctionSummary *get_summary(const std::string &funcName) const;
+
+    // 调用的摘要，库函数按输入输出并读写数组形参处理
+    FunctionSummary get_callSummary(TACPtr call) const;
+
+    // 函数能否经由调用图再次调用到自己(同时存在多个活动记录)
+    bool isRecursive(const std::string &funcName) const;
+
+private:
+    // 数组实参的来源
+    enum class ArrayClass
+    {
+        Local,
+        Global,
+        Param
+    };
+
+    struct CallSite
+    {
+        std::string callee;
+        std::vector<ArrayClass> arrayArgs;
+    };
+
+    std::unordered_map<std::string, FunctionSummary> summaries;
+    std::unordered_map<std::string, std::vector<CallSite>> callSites;
+
+    // 收集[fbegin, fend)内函数本身的读写以及调用点
+    void scanFunction(TACList::iterator fbegin, TACList::iterator fend);
+    void propagate();
+};
+
+}
+}
\ No newline at end of file
@@ -1,4 +1,9 @@
 #pragma once
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 #include "ASM/AssemblyBuilder.hh"
@@ -10,6 +15,8 @@
 namespace HaveFunCompiler {
 namespace AssemblyBuilder {
 
+class SideEffectAnalyzer;
+
 class ArmBuilder : public AssemblyBuilder {
   NONCOPYABLE(ArmBuilder)
   //特殊寄存器编号
@@ -18,7 +25,14 @@ class ArmBuilder : public AssemblyBuilder {
   static const int SP_REGID = 13;
   static const int LR_REGID = 14;
   static const int PC_REGID = 15;
-  static const int DATA_POOL_DISTANCE_THRESHOLD = 400;
+  //全局标量集中放置的数据块
+  static constexpr const char *GLOBAL_ANCHOR_NAME = "_global_anchor";
+  //记忆化结果表的项数(2的幂)，每项为 有效位, 参数1, 参数2, 结果
+  static const int MEMO_TABLE_BITS = 10;
+  //清零不超过这么多个字的_builtin_clear在调用处直接展开
+  static const int INLINE_CLEAR_MAX_WORDS = 16;
+  //不小于这么多字节的局部数组可以静态分配
+  static const int STATIC_ARRAY_MIN_BYTES = 1024;
 
  public:
   ArmBuilder(TACListPtr tac_list);
@@ -49,26 +63,67 @@ class ArmBuilder : public AssemblyBuilder {
   //获得该sym对应的变量名
   std::string GetVariableName(SymbolPtr sym);
 
-  //获得某个数据的引用名称
-  std::string ToDataRefName(std::string name);
-
+  //有编译期初值的全局变量放进.data(初始化全部在编译期求值的常量数组放进.rodata)，其余放进.bss
   std::string DeclareDataToASMString(TACPtr tac);
 
-  void AddDataRef(TACPtr tac);
+  //从头求值全局初始化代码(_builtin_clear和字面量赋值)，结果放进static_init_。
+  //遇到不能求值的tac就停下，它和之后的初始化仍在main中执行，其中写到的全局数组记入static_dynamic_arrays_
+  void CollectStaticInit();
+
+  //不会递归重入的函数中的大局部数组放进.bss，记入static_arrays_，不再占用栈帧
+  void CollectStaticArrays();
+
+  //全局标量访问较多时，为当前函数选一个空闲寄存器常驻全局数据块基址
+  void ChooseGlobalAnchorReg();
+
+  //全局标量在数据块中的偏移，sym不在数据块中时返回-1
+  int GetGlobalAnchorOffset(SymbolPtr sym);
+
+  //当前函数不调用其他函数(包括除法库函数)，lr不会被改写
+  bool IsLeafFunction();
+
+  //栈帧(变量、保存的寄存器和栈上传入的参数)可能超出vldr/vstr的立即数偏移范围
+  bool IsLargeFrame();
+
+  //栈帧较大且有栈上传入的参数时，选一个空闲寄存器作为帧基址，指向函数入口时的sp
+  void ChooseFrameBaseReg();
+
+  //函数开头形如 if (参数比较) return 参数的简单运算; 的分支，在保存寄存器之前用条件执行直接返回。
+  //成功时返回汇编代码，并将函数体中不必再翻译的tac区间写入[*skip_begin, *skip_end)，否则返回空串
+  std::string EarlyReturnToASMString(TACList::iterator *skip_begin, TACList::iterator *skip_end);
+
+  //当前函数是只有一两个int参数、返回int的纯递归函数，可以按实参查表记忆结果
+  bool IsMemoizable();
+
+  //记忆化函数的入口：按实参在表中查找，命中直接返回，否则调用函数体(func_name_MB)并把结果填入表中
+  std::string MemoizeToASMString(const std::string &func_name);
 
   std::string GlobalTACToASMString(TACPtr tac);
 
   std::string FuncTACToASMString(TACPtr tac);
 
-  std::string EndCurrentDataPool(bool ignorebranch = false);
-
   std::string *target_output_;
 
   //数据段代码
   std::string data_section_;
 
-  // 对数据段的引用
-  std::vector<std::string> ref_data_;
+  //全局标量数据块
+  std::string anchor_section_;
+
+  //记忆化函数的结果表
+  std::string memo_section_;
+
+  //全局标量在数据块中的偏移，键为变量名
+  std::unordered_map<std::string, int> global_anchor_offsets_;
+
+  //全局变量的编译期初值，键为变量名，值为 下标 -> 初值的二进制表示
+  std::unordered_map<std::string, std::map<int, uint32_t>> static_init_;
+
+  //已经在编译期求值、main中不再执行的全局tac
+  std::unordered_set<ThreeAddressCode::ThreeAddressCode *> static_init_tacs_;
+
+  //初始化没有全部在编译期求值、main中还要写的全局数组
+  std::unordered_set<std::string> static_dynamic_arrays_;
 
   struct FuncASM {
     std::string name_;
@@ -83,8 +138,14 @@ class ArmBuilder : public AssemblyBuilder {
 
   ArmUtil::GlobalContext glob_context_;
 
-  int data_pool_distance_;
-  int data_pool_id_;
+  //各函数的副作用摘要，开启优化时在翻译函数前计算
+  std::shared_ptr<SideEffectAnalyzer> side_effect_;
+
+  //静态分配的局部数组，声明处装入标号地址
+  std::unordered_set<SymbolPtr> static_arrays_;
+
+  //全局常量数组展开后各下标的初值，开启优化时用来折叠常量下标的读取
+  std::unordered_map<SymbolPtr, std::unordered_map<int, SymbolPtr>> const_arrays_;
 
 
   TACListPtr tac_list_;
@@ -7,6 +7,14 @@
 namespace HaveFunCompiler {
 namespace AssemblyBuilder {
 
+//并行赋值中的一条：dst <- f(srcs)，srcs是它读的寄存器
+struct ParallelMove {
+  int dst;
+  std::vector<int> srcs;
+  //原赋值的下标，解环时插入的复制 dst <- srcs[0] 为-1
+  int id;
+};
+
 class ArmHelper {
  public:
   static uint32_t BitcastToUInt(float value);
@@ -26,10 +34,24 @@ class ArmHelper {
   //作为offset时的立即数
   static bool IsLDRSTRImmediateValue(int value);
 
+  //把任意32位常量装入寄存器：能编码时用mov/mvn，否则用movw/movt，不再需要文字池
+  static void EmitLoadImmediate(std::function<void(const std::string &)> emitln, const std::string &reg,
+                                uint32_t value);
+
+  //用movw/movt装入符号地址
+  static void EmitLoadAddress(std::function<void(const std::string &)> emitln, const std::string &reg,
+                              const std::string &symbol);
+
   //现在只能支持add和sub指令
   static bool EmitImmediateInstWithCheck(std::function<void(const std::string &)> emitln, const std::string &operation,
                                          const std::string &operand1, const std::string &operand2, int imm,
                                          const std::string suffix = "");
+
+  //把一组同时发生的寄存器赋值排成顺序执行的序列，各条的dst互不相同。
+  //没有其他赋值再读自己dst的赋值先执行；剩下的成环时，把环上一个dst先复制到scratches中空闲的寄存器，
+  //读它的赋值改读这个寄存器(返回值中srcs已改写)。scratch也可以是某条赋值的dst，此时那条赋值会等到它被读完。
+  static std::vector<ParallelMove> SequentializeParallelMoves(std::vector<ParallelMove> moves,
+                                                              const std::vector<int> &scratches);
 };
 }  // namespace AssemblyBuilder
 }  // namespace HaveFunCompiler
\ No newline at end of file
@@ -0,0 +1,80 @@
+#pragma once
+#include <list>
+#include <string>
+#include <vector>
+
+namespace HaveFunCompiler {
+namespace AssemblyBuilder {
+
+//结构化的一行汇编。指令会被拆成操作码、条件码、操作数，其它行(标签、伪指令、注释)保留原文。
+struct ArmInst {
+  enum class Kind { Instruction, Label, Directive, Comment };
+
+  Kind kind_ = Kind::Instruction;
+  //基础操作码，如add、ldr、vmov
+  std::string opcode_;
+  //条件码，如eq、gt，无条件时为空
+  std::string cond_;
+  //是否带s后缀（设置标志位）
+  bool set_flags_ = false;
+  //数据类型后缀，包含点，如.f32、.s32.f32
+  std::string datatype_;
+  //按顶层逗号切分的操作数，保留原文
+  std::vector<std::string> operands_;
+  //标签名（不含冒号）、伪指令或注释的原文
+  std::string text_;
+
+  //解析一行汇编（不含换行）
+  static ArmInst Parse(const std::string &line);
+
+  static ArmInst MakeInst(const std::string &opcode, const std::vector<std::string> &operands,
+                          const std::string &cond = "");
+
+  //完整的助记符，例如 subs、movgt、vmov.f32
+  std::string Mnemonic() const;
+
+  std::string ToString() const;
+
+  bool IsInstruction() const { return kind_ == Kind::Instruction; }
+
+  bool IsConditional() const { return !cond_.empty(); }
+
+  //操作码是否为已知的，未知指令应被当作什么都可能读写
+  bool IsKnown() const;
+
+  //跳转类指令（b、bl、bx、blx或写pc）
+  bool IsBranch() const;
+
+  bool IsCall() const;
+
+  //控制流不会落到下一条（无条件b、bx、写pc）
+  bool IsUnconditionalJump() const;
+
+  //可能写内存
+  bool WritesMemory() const;
+
+  //被读取/写入的寄存器，名字已规范化（r11->fp，r12->ip等）
+  std::vector<std::string> GetUseRegs() const;
+
+  std::vector<std::string> GetDefRegs() const;
+
+  bool UsesReg(const std::string &reg) const;
+
+  bool DefinesReg(const std::string &reg) const;
+
+  //规范化寄存器名，不是寄存器时返回空串
+  static std::string NormalizeRegName(const std::string &name);
+
+  //展开形如 {r4-r6, lr} 的寄存器列表
+  static std::vector<std::string> ExpandRegList(const std::string &operand);
+};
+
+using ArmInstList = std::list<ArmInst>;
+
+//整段汇编文本与指令列表的互相转换
+ArmInstList ParseArmInstList(const std::string &text);
+
+std::string ArmInstListToString(const ArmInstList &insts);
+
+}  // namespace AssemblyBuilder
+}  // namespace HaveFunCompiler
\ No newline at end of file
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <unordered_map>
+#include <vector>
 #include "ASM/Common.hh"
 #include "ASM/arm/RegAllocator.hh"
 #include "stdint.h"
@@ -7,6 +9,8 @@
 namespace HaveFunCompiler {
 namespace AssemblyBuilder {
 
+class InstructionSelector;
+
 namespace ArmUtil {
 
 struct FunctionContext {
@@ -70,6 +74,18 @@ struct FunctionContext {
   //当前函数的reg allocator
   RegAllocator *reg_alloc_;
 
+  //当前函数的指令选择结果，未开启优化时为nullptr
+  InstructionSelector *selector_;
+
+  //常驻全局数据块基址的寄存器，没有则为-1
+  int global_anchor_reg_;
+
+  //栈帧超出立即数寻址范围时指向函数入口sp的帧基址寄存器，没有则为-1
+  int frame_base_reg_;
+
+  //每个调用点之后仍然活跃的变量（不含接收返回值的变量），调用时只需保存它们所在的调用者保存寄存器
+  std::unordered_map<ThreeAddressCode::ThreeAddressCode *, std::vector<SymbolPtr>> call_live_out_;
+
   //是否处于函数头部位置，用来断言parameter只能出现在函数开头位置。
   bool parameter_head_;
 
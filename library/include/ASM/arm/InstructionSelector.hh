@@ -0,0 +1,93 @@
+#pragma once
+
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "ASM/Common.hh"
+#include "MacroUtil.hh"
+#include "TAC/ThreeAddressCode.hh"
+
+namespace HaveFunCompiler {
+namespace AssemblyBuilder {
+
+class RegAllocator;
+
+//一次匹配选中的合并指令。整个匹配在最后一条tac处输出，前面的tac不再单独输出。
+struct SelectedPattern {
+  enum class Kind {
+    // dst = src1 * src2 + acc  =>  mla
+    MulAdd,
+    // dst = acc - src1 * src2  =>  mls
+    MulSub,
+    // dst = acc + (src1 << imm)  =>  add dst, acc, src1, lsl #imm
+    ShiftAdd,
+    // dst = acc - (src1 << imm)  =>  sub dst, acc, src1, lsl #imm
+    ShiftSub,
+    // dst = (src1 << imm) - acc  =>  rsb dst, acc, src1, lsl #imm
+    ShiftRsb,
+    // dst = dst + src1 * src2  =>  vmla.f32
+    FloatMulAdd,
+    // dst = dst - src1 * src2  =>  vmls.f32
+    FloatMulSub,
+    // dst = src1 + imm  =>  add/sub dst, src1, #imm
+    AddImm,
+    // dst = imm - src1  =>  rsb dst, src1, #imm
+    RsbImm,
+    // dst = src1 << imm  =>  lsl
+    ShiftImm,
+  };
+  Kind kind_;
+  SymbolPtr dst_;
+  SymbolPtr src1_;
+  SymbolPtr src2_;
+  SymbolPtr acc_;
+  int imm_ = 0;
+};
+
+//基本块内的树模式匹配指令选择。
+//在相邻的tac上匹配乘加、移位运算数、立即数运算数等模式，按估计的指令数选择代价最小的覆盖，
+//没有匹配上的tac仍由FuncTACToASMString中原有的模板翻译。
+class InstructionSelector {
+ public:
+  InstructionSelector(TACList::iterator fbegin, TACList::iterator fend, RegAllocator *reg_alloc);
+  NONCOPYABLE(InstructionSelector)
+
+  void select();
+
+  //该tac已被合并进后面的模式，不需要单独输出
+  bool IsFolded(const TACPtr &tac) const;
+
+  //以该tac结尾的模式，没有则返回nullptr
+  const SelectedPattern *GetPattern(const TACPtr &tac) const;
+
+ private:
+  TACList::iterator fbegin_, fend_;
+  RegAllocator *reg_alloc_;
+
+  std::unordered_map<SymbolPtr, int> use_count_;
+  std::unordered_map<SymbolPtr, int> def_count_;
+
+  std::unordered_set<ThreeAddressCode::ThreeAddressCode *> folded_;
+  std::unordered_map<ThreeAddressCode::ThreeAddressCode *, SelectedPattern> patterns_;
+
+  void CountUseDef();
+
+  //从it开始尝试匹配，成功返回模式覆盖的tac数量，否则返回0
+  int MatchAt(TACList::iterator it, SelectedPattern *pattern);
+
+  //模式结尾的 d = r 赋值可以被并入，结果直接写到d
+  bool MatchCopyTail(TACList::iterator it, const SymbolPtr &result, SymbolPtr *dst);
+
+  //只在一处被使用且只被定值一次的局部临时量，可以不物化
+  bool IsSingleUseTemp(const SymbolPtr &sym) const;
+
+  bool IsIntScalar(const SymbolPtr &sym) const;
+
+  bool IsFloatScalar(const SymbolPtr &sym) const;
+
+  //没有分配到寄存器，需要占用自由寄存器的操作数个数（不同符号只计一次）
+  int CountNonRegOperands(const std::vector<SymbolPtr> &syms) const;
+};
+
+}  // namespace AssemblyBuilder
+}  // namespace HaveFunCompiler
\ No newline at end of file
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+#include "ASM/arm/ArmInst.hh"
+#include "MacroUtil.hh"
+
+namespace HaveFunCompiler {
+namespace AssemblyBuilder {
+
+//文字池管理。按字节计算每条 ldr rX, =expr 到文字池的距离，只为真正引用过的常量留位置。
+//文字池优先放在无条件跳转之后（不会被执行到，不需要跳过），实在放不下时才插入跳过文字池的b指令。
+class LiteralPoolManager {
+ public:
+  // label_prefix用来保证不同函数中生成的跳过标签不重名
+  LiteralPoolManager(ArmInstList *insts, const std::string &label_prefix) : insts_(insts), label_prefix_(label_prefix) {}
+  NONCOPYABLE(LiteralPoolManager)
+
+  void place();
+
+  //插入的文字池数量，以及其中需要额外跳过的数量
+  int get_pool_count() const { return pool_count_; }
+  int get_branch_count() const { return branch_count_; }
+
+ private:
+  // ldr的pc相对寻址范围为±4095，pc比指令地址超前8字节；预留余量给对齐和池本身
+  static const int LITERAL_RANGE = 4095 - 8 - 64;
+
+  ArmInstList *insts_;
+  std::string label_prefix_;
+  int pool_count_ = 0;
+  int branch_count_ = 0;
+
+  //指令在代码段中占的字节数
+  static int SizeOf(const ArmInst &inst);
+
+  //是否为引用文字池的伪指令 ldr rX, =expr，是则返回expr
+  static bool IsLiteralLoad(const ArmInst &inst, std::string *literal);
+
+  //在it之前插入文字池，needbranch时用b跳过
+  void InsertPool(ArmInstList::iterator it, bool needbranch);
+};
+
+}  // namespace AssemblyBuilder
+}  // namespace HaveFunCompiler
\ No newline at end of file
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include "ASM/arm/ArmInst.hh"
+#include "MacroUtil.hh"
+
+namespace HaveFunCompiler {
+namespace AssemblyBuilder {
+
+//函数级的机器指令窥孔优化，反复应用各条规则直到不再变化
+class PeepholeOptimizer {
+ public:
+  PeepholeOptimizer(ArmInstList *insts) : insts_(insts) {}
+  NONCOPYABLE(PeepholeOptimizer)
+
+  void optimize();
+
+  //各条规则删除(或改写)的指令数，键为规则名
+  const std::map<std::string, int> &get_rule_counts() const { return rule_counts_; }
+
+  //形如 "self-move=1 store-load=3" 的统计信息
+  std::string CountsToString() const;
+
+ private:
+  ArmInstList *insts_;
+  std::map<std::string, int> rule_counts_;
+
+  // mov rX, rX 以及相邻的 mov rA, rB; mov rB, rA
+  bool RemoveSelfMove();
+  //基本块内栈槽的存取转发：读刚存入的栈槽改为mov，重复存入同一值的str删除
+  bool ForwardStackSlot();
+  //跳到紧随其后的标签的跳转
+  bool RemoveBranchToNext();
+  //全局变量回存时 push {X}; movw/movt X, g; str R, [X]; pop {X}，X之后不再活跃则去掉push/pop
+  bool RemoveGlobalStorePushPop();
+
+  // it之后(不含it) reg是否可能被读到，不确定时返回true
+  bool IsLiveAfter(ArmInstList::iterator it, const std::string &reg) const;
+
+  void Count(const std::string &rule, int n = 1) { rule_counts_[rule] += n; }
+};
+
+}  // namespace AssemblyBuilder
+}  // namespace HaveFunCompiler
\ No newline at end of file
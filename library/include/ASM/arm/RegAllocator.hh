@@ -6,6 +6,7 @@
 #include <list>
 #include <set>
 #include <unordered_map>
+#include <unordered_set>
 #include "ASM/Common.hh"
 #include "MacroUtil.hh"
 
@@ -114,7 +115,9 @@ public:
 
     NONCOPYABLE(RegAllocator)
 
-    RegAllocator(const LiveAnalyzer&);
+    // isLeaf: 函数中没有调用，r1-r3, s1-s15不需要跨调用保存，优先分配它们
+    // staticArrays: 静态分配的局部数组，不在栈上留空间
+    RegAllocator(const LiveAnalyzer&, bool isLeaf = false, const std::unordered_set<SymPtr> *staticArrays = nullptr);
 
     SymAttribute get_SymAttribute(SymPtr sym);
     SymAttribute get_ArrayAttribute(SymPtr arrPtr);
@@ -136,6 +139,14 @@ private:
     // 根据指针Sym，取得数组地址属性
     std::unordered_map<SymPtr, SymAttribute> ptrToArrayOnStack;
 
+    // 是否为叶函数
+    bool isLeaf;
+
+    const std::unordered_set<SymPtr> *staticArrays;
+
+    // 保留的寄存器号，以及第一个参数(不能留在r0, s0)改放的寄存器号
+    int intReservedReg, floatReservedReg, intParam0Reg, floatParam0Reg;
+
 private:
     enum SymType {PARAM, LOCAL_VAR};
     enum SymValueType {INT, FLOAT};
@@ -200,6 +211,16 @@ private:
     // 得到局部变量、参数列表，建立指针到栈上数组的映射
     void ContextInit(const LiveAnalyzer&);
 
+    // 确定保留寄存器和第一个参数的寄存器
+    // 非叶函数固定保留r4, s16，第一个参数放在r12, s31
+    // 叶函数改用没有传参的r1-r3, s1-s15，省去入口处的保存
+    void chooseSpecialRegs();
+
+    // 按分配优先级排列的可分配寄存器号
+    // callerSavedCnt: 调用者保存的寄存器个数(3或15)，编号1..callerSavedCnt
+    // paramRegCnt: 用来传参的寄存器个数(含0号)
+    std::vector<int> regAllocOrder(int callerSavedCnt, int poolSize, int reservedReg, int param0Reg, int paramRegCnt) const;
+
     // 得到每个参数传入时占用的寄存器或栈空间
     // 保存在该参数SymPtr对应的SymAttribute中
     void getParamAddr();
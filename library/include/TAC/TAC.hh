@@ -100,6 +100,7 @@ class TACFactory {
   std::string ToTempLabelName(uint64_t id);
   std::string ToVariableOrConstantName(const std::string name);
   std::string ToTempVariableName(uint64_t id);
+  std::string ToArrayTemplateName(uint64_t id);
 
  private:
   //如果是能翻译成常量bool的表达式，会返回true，out_const_result传递相应值
@@ -182,6 +183,8 @@ class TACBuilder {
   ExpressionPtr CreateAssign(SymbolPtr var, ExpressionPtr exp);
 
   ExpressionPtr AccessArray(ExpressionPtr array, std::vector<ExpressionPtr> pos);
+  //读常量数组中下标全是常量的元素时，直接返回它的初值，否则原样返回
+  ExpressionPtr FoldConstArrayRead(ExpressionPtr exp);
   ExpressionPtr CreateArrayInit(ExpressionPtr array, ExpressionPtr init_array);
 
   ExpressionPtr CreateConstExp(int n);
@@ -250,6 +253,19 @@ class TACBuilder {
   FlattenedArray FlattenInitArray(ArrayDescriptorPtr array);
   int ArrayInitImpl(ExpressionPtr array, FlattenedArray::iterator &it, const FlattenedArray::iterator &end,
                     TACListPtr tac_list);
+  //局部数组的初始化：成段的常量初值从全局常量模板整段复制，只清零没有初始化到的空隙。
+  //init_tac为逐个元素赋值的代码，其中有下标不是常量的赋值时返回false，由调用者整个清零再逐个赋值
+  bool CreateLocalArrayInit(ExpressionPtr array, TACListPtr init_tac, size_t size);
+  //按展开后的下标访问数组元素
+  ExpressionPtr AccessFlattenedArray(ExpressionPtr array, size_t offset);
+  //调用_builtin_clear清零array中从begin开始的count个元素
+  void AppendArrayClear(ExpressionPtr array, size_t begin, size_t count);
+  //新建全局常量数组作为初始化模板，声明和初值放到array_template_tac_中
+  SymbolPtr CreateArrayTemplate(SymbolValue::ValueType type, const std::vector<SymbolPtr> &values);
+  //至少这么多个非零常量才用模板复制
+  static const size_t ARRAY_TEMPLATE_MIN_RUN = 4;
+  //模板中两个常量之间允许夹着的0的个数，更长的空隙单独清零
+  static const size_t ARRAY_TEMPLATE_MAX_GAP = 16;
   std::string AppendScopePrefix(const std::string &name, uint64_t scope_id = (uint64_t)-1);
   SymbolPtr FindSymbolWithName(const std::string &name);
   VariantStack compiler_stack_;
@@ -259,6 +275,8 @@ class TACBuilder {
   //目前临时标签标号
   uint64_t cur_temp_label_;
   uint64_t cur_symtab_id_;
+  //目前数组初始化模板标号
+  uint64_t cur_array_template_;
   std::vector<SymbolTable> symbol_stack_;
   std::vector<std::pair<SymbolPtr, SymbolPtr>> loop_cont_brk_stack_;
 
@@ -268,6 +286,9 @@ class TACBuilder {
   std::unordered_map<std::string, SymbolPtr> text_tab_;
   std::vector<std::string> stored_text_;
 
+  //数组初始化模板的声明和初值，放在整个程序的最前面
+  TACListPtr array_template_tac_;
+
   TACListPtr tac_list_;
 };
 
@@ -100,6 +100,8 @@ class ThreeAddressCodeList {
 
   void erase(iterator it) { list_.erase(it); }
 
+  iterator insert(iterator it, std::shared_ptr<ThreeAddressCode> tac) { return list_.insert(it, tac); }
+
  private:
   list_t list_;
 };
@@ -392,44 +392,20 @@ InitVal
     tacbuilder->Top(&type);
     if($1->ret->value_.Type() == ValueType::Array)
     {
+      //常量下标访问常量数组在PrimaryExp中已经折叠，到这里的都要在运行时读取
       auto arrayDescriptor = $1->ret->value_.GetArrayDescriptor();
-      if($1->ret->type_ == SymbolType::Constant)
-      {
-        assert(arrayDescriptor->dimensions.empty());
-        if (!arrayDescriptor->subarray->empty()) {
-          assert(arrayDescriptor->subarray->size() == 1);
-          if((ValueType)type != arrayDescriptor->value_type){
-            if((ValueType)type == SymbolValue::ValueType::Int){
-              exp = tacbuilder->CastFloatToInt(arrayDescriptor->subarray->begin()->second);
-            }else{
-              exp = tacbuilder->CastIntToFloat(arrayDescriptor->subarray->begin()->second);
-            }
-            $$ = exp;
-          }else{
-            $$ = arrayDescriptor->subarray->begin()->second;
-          }
-        } else {
-          if ((ValueType)type == SymbolValue::ValueType::Int){
-            $$ = tacbuilder->CreateConstExp(0);
-          }
-          else{
-            $$ = tacbuilder->CreateConstExp(static_cast<float>(0));
-          }
-        }
-      }else{
-        SymbolPtr tmpVar = tacbuilder->CreateTempVariable(arrayDescriptor->value_type);
-        (*$1->tac) += tacbuilder->NewTAC(TACOperationType::Variable,tmpVar);
-        ExpressionPtr tempexp = tacbuilder->CreateAssign(tmpVar,$1);
-        if((ValueType)type != arrayDescriptor->value_type){
-          if((ValueType)type == SymbolValue::ValueType::Int){
-            exp = tacbuilder->CastFloatToInt(tempexp);
-          }else{
-            exp = tacbuilder->CastIntToFloat(tempexp);
-          }
-          $$ = exp;
+      SymbolPtr tmpVar = tacbuilder->CreateTempVariable(arrayDescriptor->value_type);
+      (*$1->tac) += tacbuilder->NewTAC(TACOperationType::Variable,tmpVar);
+      ExpressionPtr tempexp = tacbuilder->CreateAssign(tmpVar,$1);
+      if((ValueType)type != arrayDescriptor->value_type){
+        if((ValueType)type == SymbolValue::ValueType::Int){
+          exp = tacbuilder->CastFloatToInt(tempexp);
         }else{
-          $$ = tempexp;
+          exp = tacbuilder->CastIntToFloat(tempexp);
         }
+        $$ = exp;
+      }else{
+        $$ = tempexp;
       }
     }else{
       if($1->ret->value_.Type()!=(ValueType)type){
@@ -793,7 +769,7 @@ PrimaryExp
   }
   | LVal
   {
-    $$ = $1;
+    $$ = tacbuilder->FoldConstArrayRead($1);
   }
   | Number
   ;
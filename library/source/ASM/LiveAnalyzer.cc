@@ -97,6 +97,7 @@ LiveAnalyzer::LiveAnalyzer(std::shared_ptr<ControlFlowGraph> controlFlowGraph) :
 {
     // 遍历流图，得到每个变量的定值和使用集合，函数中出现的所有变量的集合，局部变量的集合
     bfs();
+    calBlockEnd();
 
     nodeLiveInfo.resize(cfg->get_nodes_number());
 
@@ -223,6 +224,35 @@ void LiveAnalyzer::bfs()
     }
 }
 
+void LiveAnalyzer::calBlockEnd()
+{
+    size_t n = cfg->get_nodes_number();
+    std::vector<size_t> dfnToNode(n + 1, n);
+    for (size_t i = 0; i < n; ++i)
+        if (cfg->get_node_dfn(i) != 0 && cfg->get_node_dfn(i) <= n)
+            dfnToNode[cfg->get_node_dfn(i)] = i;
+
+    // 逆dfn序求：结点以跳转、调用结束基本块，或唯一后继不是dfn连续的非标号结点时，它就是基本块末尾
+    blockEndDfn.assign(n + 1, 0);
+    for (size_t d = n; d >= 1; --d)
+    {
+        size_t u = dfnToNode[d];
+        blockEndDfn[d] = d;
+        if (u == n)
+            continue;
+        auto op = cfg->get_node_tac(u)->operation_;
+        if (op == TACOperationType::Goto || op == TACOperationType::IfZero || op == TACOperationType::Return ||
+            op == TACOperationType::Call || op == TACOperationType::CallAndReturn)
+            continue;
+        auto &outLs = cfg->get_outNodeList(u);
+        if (outLs.size() != 1 || cfg->get_node_dfn(outLs[0]) != d + 1 || d + 1 > n)
+            continue;
+        if (cfg->get_node_tac(outLs[0])->operation_ == TACOperationType::Label)
+            continue;
+        blockEndDfn[d] = blockEndDfn[d + 1];
+    }
+}
+
 LiveAnalyzer::iterator LiveAnalyzer::get_fbegin() const
 {
     return cfg->get_fbegin();
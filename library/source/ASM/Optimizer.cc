@@ -1,7 +1,11 @@
 #include "ASM/Optimizer.hh"
 #include "ASM/ControlFlowGraph.hh"
 #include "ASM/LiveAnalyzer.hh"
+#include "ASM/SideEffectAnalyzer.hh"
 #include "TAC/Symbol.hh"
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
 #include <vector>
 
 namespace HaveFunCompiler{
@@ -9,34 +13,188 @@ namespace AssemblyBuilder{
 
 using namespace ThreeAddressCode;
 
+namespace
+{
+// 值为0的int或float字面量
+SymbolPtr zeroLiteral(SymbolValue::ValueType type)
+{
+    auto zero = std::make_shared<Symbol>();
+    zero->type_ = SymbolType::Constant;
+    zero->offset_ = 0;
+    zero->value_ = type == SymbolValue::ValueType::Float ? SymbolValue(0.0f) : SymbolValue(0);
+    return zero;
+}
+
+SymbolPtr intLiteral(int value)
+{
+    auto literal = std::make_shared<Symbol>();
+    literal->type_ = SymbolType::Constant;
+    literal->offset_ = 0;
+    literal->value_ = SymbolValue(value);
+    return literal;
+}
+
+// 同一个符号，或者值相同的int字面量
+bool sameValue(const SymbolPtr &a, const SymbolPtr &b)
+{
+    if (a == b)
+        return true;
+    if (!a || !b || !a->IsLiteral() || !b->IsLiteral() || a->value_.Type() != SymbolValue::ValueType::Int || b->value_.Type() != SymbolValue::ValueType::Int)
+        return false;
+    return a->value_.GetInt() == b->value_.GetInt();
+}
+
+// [begin, end)的末尾是循环变量的增量 var = var + c 或 t = var + c; var = t
+bool matchIncrement(TACList::iterator begin, TACList::iterator end, const SymbolPtr &var, TACList::iterator *incBegin, int *step)
+{
+    if (begin == end)
+        return false;
+    auto isIntLiteral = [](const SymbolPtr &sym)
+    {
+        return sym->IsLiteral() && sym->value_.Type() == SymbolValue::ValueType::Int;
+    };
+    // var + c、c + var 或 var - c
+    auto isStep = [&](const TACPtr &tac)
+    {
+        if (tac->operation_ == TACOperationType::Add && tac->b_ == var && isIntLiteral(tac->c_))
+            *step = tac->c_->value_.GetInt();
+        else if (tac->operation_ == TACOperationType::Add && tac->c_ == var && isIntLiteral(tac->b_))
+            *step = tac->b_->value_.GetInt();
+        else if (tac->operation_ == TACOperationType::Sub && tac->b_ == var && isIntLiteral(tac->c_) && tac->c_->value_.GetInt() != INT_MIN)
+            *step = -tac->c_->value_.GetInt();
+        else
+            return false;
+        return *step != 0;
+    };
+    auto last = std::prev(end);
+    if ((*last)->a_ != var)
+        return false;
+    if (isStep(*last))
+    {
+        *incBegin = last;
+        return true;
+    }
+    if ((*last)->operation_ != TACOperationType::Assign || (*last)->b_->value_.Type() != SymbolValue::ValueType::Int || last == begin)
+        return false;
+    auto prev = std::prev(last);
+    if ((*prev)->a_ != (*last)->b_ || !isStep(*prev))
+        return false;
+    *incBegin = prev;
+    return true;
+}
+
+// 两个int常数的运算结果(一元运算忽略y)，除以0等不能在编译时算出的返回false
+bool foldInt(TACOperationType op, int x, int y, int *result)
+{
+    auto ux = static_cast<unsigned>(x), uy = static_cast<unsigned>(y);
+    switch (op)
+    {
+    case TACOperationType::Add:
+        *result = static_cast<int>(ux + uy);
+        return true;
+    case TACOperationType::Sub:
+        *result = static_cast<int>(ux - uy);
+        return true;
+    case TACOperationType::Mul:
+        *result = static_cast<int>(ux * uy);
+        return true;
+    case TACOperationType::Div:
+    case TACOperationType::Mod:
+        if (y == 0 || (x == INT_MIN && y == -1))
+            return false;
+        *result = op == TACOperationType::Div ? x / y : x % y;
+        return true;
+    case TACOperationType::Equal:
+        *result = x == y;
+        return true;
+    case TACOperationType::NotEqual:
+        *result = x != y;
+        return true;
+    case TACOperationType::LessThan:
+        *result = x < y;
+        return true;
+    case TACOperationType::LessOrEqual:
+        *result = x <= y;
+        return true;
+    case TACOperationType::GreaterThan:
+        *result = x > y;
+        return true;
+    case TACOperationType::GreaterOrEqual:
+        *result = x >= y;
+        return true;
+    case TACOperationType::UnaryMinus:
+        *result = static_cast<int>(0u - ux);
+        return true;
+    case TACOperationType::UnaryNot:
+        *result = !x;
+        return true;
+    case TACOperationType::UnaryPositive:
+        *result = x;
+        return true;
+    default:
+        return false;
+    }
+}
+
+// 两个数组的元素可能重叠：数组形参可能指向任何全局数组或调用者的数组，但不会指向本函数的局部数组
+bool arraysMayAlias(const SymbolPtr &base1, const SymbolPtr &base2, const std::unordered_set<SymbolPtr> &paramArrays)
+{
+    if (base1 == base2)
+        return true;
+    bool param1 = paramArrays.count(base1), param2 = paramArrays.count(base2);
+    if (!param1 && !param2)
+        return false;
+    auto other = param1 ? base2 : base1;
+    return paramArrays.count(other) || other->IsGlobal();
+}
+}
+
 void DeadCodeOptimizer::optimize()
 {
-    auto cfg = std::make_shared<ControlFlowGraph>(_fbegin, _fend);
-    LiveAnalyzer liveAnalyzer(cfg);
+    // 删去一条代码可能让它用到的变量也变成死的，反复删到不再变化
     std::vector<TACList::iterator> deadCodes;
-
-    auto tacNum = cfg->get_nodes_number();
-    for (size_t i = 0; i < tacNum; ++i)
+    do
     {
-        auto tac = cfg->get_node_tac(i);
-        auto defSym = tac->getDefineSym();
-        if (defSym)
+        deadCodes.clear();
+        auto cfg = std::make_shared<ControlFlowGraph>(_fbegin, _fend);
+        LiveAnalyzer liveAnalyzer(cfg);
+
+        auto tacNum = cfg->get_nodes_number();
+        for (size_t i = 0; i < tacNum; ++i)
         {
-            auto& nodeLiveInfo = liveAnalyzer.get_nodeLiveInfo(i);
-            if (nodeLiveInfo.outLive.find(defSym) == nodeLiveInfo.outLive.end() && !hasSideEffect(defSym, tac))
-                deadCodes.push_back(cfg->get_node_itr(i));
+            auto tac = cfg->get_node_tac(i);
+            auto defSym = tac->getDefineSym();
+            if (defSym)
+            {
+                auto& nodeLiveInfo = liveAnalyzer.get_nodeLiveInfo(i);
+                if (nodeLiveInfo.outLive.find(defSym) == nodeLiveInfo.outLive.end() && !hasSideEffect(defSym, tac))
+                {
+                    auto it = cfg->get_node_itr(i);
+                    deadCodes.push_back(it);
+                    // 删去调用时连同它的实参一起删去
+                    while (tac->operation_ == TACOperationType::Call && it != _fbegin)
+                    {
+                        auto op = (*--it)->operation_;
+                        if (op != TACOperationType::Argument && op != TACOperationType::ArgumentAddress)
+                            break;
+                        deadCodes.push_back(it);
+                    }
+                }
+            }
         }
-    }
 
-    for (auto it : deadCodes)
-        _tacls->erase(it);
+        for (auto it : deadCodes)
+            _tacls->erase(it);
+    } while (!deadCodes.empty());
 }
 
 bool DeadCodeOptimizer::hasSideEffect(SymbolPtr defSym, TACPtr tac)
 {
     if (defSym->IsGlobal())  
         return true;
-    if (tac->operation_ == TACOperationType::Call || tac->operation_ == TACOperationType::Parameter)
+    if (tac->operation_ == TACOperationType::Call)
+        return _sideEffect->get_callSummary(tac).hasSideEffect();
+    if (tac->operation_ == TACOperationType::Parameter)
         return true;
     // if (tac->operation_ == TACOperationType::Constant || tac->operation_ == TACOperationType::Variable)
     // {
@@ -49,5 +207,2019 @@ bool DeadCodeOptimizer::hasSideEffect(SymbolPtr defSym, TACPtr tac)
     return false;
 }
 
+void TailRecursionEliminator::optimize()
+{
+    auto funcName = (*_fbegin)->a_->get_tac_name(true);
+    auto entry = _fbegin;
+    ++entry, ++entry;
+    while (entry != _fend && (*entry)->operation_ == TACOperationType::Parameter)
+    {
+        params.push_back((*entry)->a_);
+        ++entry;
+    }
+
+    auto makeTAC = [](TACOperationType op, SymbolPtr a, SymbolPtr b)
+    {
+        auto tac = std::make_shared<ThreeAddressCode::ThreeAddressCode>();
+        tac->operation_ = op;
+        tac->a_ = a;
+        tac->b_ = b;
+        return tac;
+    };
+
+    // 尾调用位置：实参起点、调用，以及 return f(...) op x 中的运算(没有时为_fend)
+    struct TailCall
+    {
+        TACList::iterator argBegin, call, accOp;
+    };
+    std::vector<TailCall> sites;
+    auto accOperation = TACOperationType::Undefined;
+    size_t selfCalls = 0;
+    for (auto it = entry; it != _fend; ++it)
+    {
+        if ((*it)->operation_ != TACOperationType::Call || (*it)->b_->get_tac_name(true) != funcName)
+            continue;
+        ++selfCalls;
+        TailCall site{_fend, it, _fend};
+        site.argBegin = matchTailCall(it, &site.accOp);
+        if (site.argBegin == _fend)
+            continue;
+        // 累加量只有一个，运算不同的位置保持原样
+        if (site.accOp != _fend)
+        {
+            if (accOperation == TACOperationType::Undefined)
+                accOperation = (*site.accOp)->operation_;
+            else if ((*site.accOp)->operation_ != accOperation)
+                continue;
+        }
+        sites.push_back(site);
+    }
+    // 仍有递归调用时，累加量让递归到底的每一层都多走一遍入口，只在能完全去掉递归时使用
+    if (accOperation != TACOperationType::Undefined && sites.size() != selfCalls)
+    {
+        sites.erase(std::remove_if(sites.begin(), sites.end(), [this](const TailCall &site)
+                                   { return site.accOp != _fend; }),
+                    sites.end());
+        accOperation = TACOperationType::Undefined;
+    }
+    if (sites.empty())
+        return;
+
+    auto loopLabel = std::make_shared<Symbol>();
+    loopLabel->type_ = SymbolType::Label;
+    loopLabel->name_ = funcName + "_TRL";
+    loopLabel->offset_ = 0;
+    auto labelPos = _tacls->insert(entry, makeTAC(TACOperationType::Label, loopLabel, nullptr));
+
+    // 有 return f(...) op x 时加一个累加量acc，进入函数时为运算的单位元，每次返回 acc op v
+    SymbolPtr acc;
+    if (accOperation != TACOperationType::Undefined)
+    {
+        auto identity = std::make_shared<Symbol>();
+        identity->type_ = SymbolType::Constant;
+        identity->offset_ = 0;
+        identity->value_ = SymbolValue(accOperation == TACOperationType::Mul ? 1 : 0);
+        acc = std::make_shared<Symbol>(*(*sites.front().call)->a_);
+        acc->name_ = "TRA_" + funcName;
+        _tacls->insert(labelPos, makeTAC(TACOperationType::Variable, acc, nullptr));
+        _tacls->insert(labelPos, makeTAC(TACOperationType::Assign, acc, identity));
+        for (auto it = std::next(labelPos); it != _fend; ++it)
+        {
+            if ((*it)->operation_ != TACOperationType::Return)
+                continue;
+            auto update = makeTAC(accOperation, acc, acc);
+            update->c_ = (*it)->a_;
+            _tacls->insert(it, update);
+            (*it)->a_ = acc;
+        }
+    }
+
+    std::vector<SymbolPtr> temps(params.size());
+    for (auto &site : sites)
+    {
+        auto argBegin = site.argBegin;
+        auto it = site.call;
+        if (site.accOp != _fend)
+        {
+            auto op = *site.accOp;
+            auto update = makeTAC(accOperation, acc, acc);
+            update->c_ = op->b_ == (*it)->a_ ? op->c_ : op->b_;
+            _tacls->insert(argBegin, update);
+            _tacls->erase(site.accOp);
+        }
+
+        // 形参 = 实参 是一组并行赋值：先赋值不再被其他赋值读到的形参，
+        // 剩下的成环时把其中一个形参的旧值存到临时变量，读它的赋值改读临时变量
+        std::vector<std::pair<SymbolPtr, SymbolPtr>> moves;
+        size_t i = 0;
+        for (auto arg = argBegin; arg != it; ++arg, ++i)
+        {
+            if ((*arg)->operation_ != TACOperationType::ArgumentAddress && (*arg)->a_ != params[i])
+                moves.emplace_back(params[i], (*arg)->a_);
+        }
+        auto isRead = [&moves](const SymbolPtr &sym)
+        {
+            for (auto &move : moves)
+            {
+                if (move.second == sym)
+                    return true;
+            }
+            return false;
+        };
+        while (!moves.empty())
+        {
+            auto ready = std::find_if(moves.begin(), moves.end(), [&isRead](const std::pair<SymbolPtr, SymbolPtr> &move)
+                                      { return !isRead(move.first); });
+            if (ready != moves.end())
+            {
+                _tacls->insert(argBegin, makeTAC(TACOperationType::Assign, ready->first, ready->second));
+                moves.erase(ready);
+                continue;
+            }
+            auto param = moves.front().first;
+            auto idx = std::find(params.begin(), params.end(), param) - params.begin();
+            if (!temps[idx])
+            {
+                temps[idx] = std::make_shared<Symbol>(*param);
+                temps[idx]->name_ = "STR_" + param->get_tac_name(true);
+                _tacls->insert(labelPos, makeTAC(TACOperationType::Variable, temps[idx], nullptr));
+            }
+            _tacls->insert(argBegin, makeTAC(TACOperationType::Assign, temps[idx], param));
+            for (auto &move : moves)
+            {
+                if (move.second == param)
+                    move.second = temps[idx];
+            }
+        }
+        _tacls->insert(argBegin, makeTAC(TACOperationType::Goto, loopLabel, nullptr));
+
+        // 删去实参和调用，后面的返回已经不可达，由控制流图去掉
+        while (argBegin != it)
+            _tacls->erase(argBegin++);
+        _tacls->erase(it);
+    }
+}
+
+TACList::iterator TailRecursionEliminator::matchTailCall(TACList::iterator call, TACList::iterator *accOp) const
+{
+    // 跳过标号、块边界和临时变量的声明
+    auto skip = [this](TACList::iterator it)
+    {
+        while (it != _fend && ((*it)->operation_ == TACOperationType::Label || (*it)->operation_ == TACOperationType::Variable ||
+                               (*it)->operation_ == TACOperationType::BlockBegin || (*it)->operation_ == TACOperationType::BlockEnd))
+            ++it;
+        return it;
+    };
+
+    // 整数结果接着和另一个值做加法或乘法，满足交换律和结合律，可以放进累加量
+    auto result = (*call)->a_;
+    auto ret = skip(std::next(call));
+    *accOp = _fend;
+    if (result && result->value_.Type() == SymbolValue::ValueType::Int && ret != _fend &&
+        ((*ret)->operation_ == TACOperationType::Add || (*ret)->operation_ == TACOperationType::Mul) &&
+        ((*ret)->b_ == result) != ((*ret)->c_ == result) && (*ret)->a_->value_.Type() == SymbolValue::ValueType::Int)
+    {
+        // 并入累加量后x在递归调用之前读，递归可能改变全局变量和数组元素，库函数(如getarray)也可能写它们
+        auto x = (*ret)->b_ == result ? (*ret)->c_ : (*ret)->b_;
+        bool local = x->IsLiteral() || (!x->IsGlobal() && x->value_.Type() != SymbolValue::ValueType::Array);
+        auto summary = _sideEffect->get_callSummary(*call);
+        if (!local && (summary.writeGlobal || summary.writeParamArray || summary.io))
+            return _fend;
+        *accOp = ret;
+        result = (*ret)->a_;
+        ++ret;
+    }
+
+    // 之后直接返回同一个值，void函数也可以直接落到函数末尾
+    ret = skip(ret);
+    if (ret == _fend)
+        return _fend;
+    if (!((*ret)->operation_ == TACOperationType::Return && (*ret)->a_ == result) &&
+        !((*ret)->operation_ == TACOperationType::FunctionEnd && !result))
+        return _fend;
+
+    // 紧挨着调用的实参与形参一一对应
+    auto argBegin = call;
+    size_t n = 0;
+    while (argBegin != _fbegin)
+    {
+        auto op = (*std::prev(argBegin))->operation_;
+        if (op != TACOperationType::Argument && op != TACOperationType::ArgumentAddress)
+            break;
+        --argBegin;
+        ++n;
+    }
+    if (n != params.size())
+        return _fend;
+    size_t i = 0;
+    for (auto arg = argBegin; arg != call; ++arg, ++i)
+    {
+        auto val = (*arg)->a_;
+        auto param = params[i];
+        if (param->value_.Type() == SymbolValue::ValueType::Array)
+        {
+            // 数组形参只接受原样传入的 &a[0]
+            if ((*arg)->operation_ != TACOperationType::ArgumentAddress)
+                return _fend;
+            auto ad = val->value_.GetArrayDescriptor();
+            if (ad->base_addr.lock() != param->value_.GetArrayDescriptor()->base_addr.lock() ||
+                !ad->base_offset->IsLiteral() || ad->base_offset->value_.GetInt() != 0)
+                return _fend;
+        }
+        else if ((*arg)->operation_ != TACOperationType::Argument || val->value_.Type() != param->value_.Type())
+            return _fend;
+    }
+    return argBegin;
+}
+
+void GlobalScalarPromoter::optimize()
+{
+    computeLoopDepth();
+
+    // 统计每个全局标量的加权访问次数，以及是否被写过
+    std::vector<SymbolPtr> globals;
+    std::unordered_map<SymbolPtr, int> benefit;
+    std::unordered_map<SymbolPtr, bool> written;
+    std::unordered_map<std::string, SymbolPtr> nameToSym;
+    int exitCnt = 1, writeBackWeight = 0, reloadWeight = 0;
+    for (auto it = _fbegin; it != _fend; ++it)
+    {
+        auto tac = *it;
+        if (tac->operation_ == TACOperationType::Return)
+            ++exitCnt;
+        if (callReadsGlobal(tac) || callWritesGlobal(tac))
+            writeBackWeight += weight(tac);
+        if (callWritesGlobal(tac))
+            reloadWeight += weight(tac);
+        for (auto sym : {tac->a_, tac->b_, tac->c_})
+        {
+            if (sym && sym->value_.Type() == SymbolValue::ValueType::Array)
+                sym = sym->value_.GetArrayDescriptor()->base_offset;
+            if (!isPromotable(sym))
+                continue;
+            auto name = sym->get_tac_name(true);
+            if (nameToSym.find(name) == nameToSym.end())
+            {
+                nameToSym[name] = sym;
+                globals.push_back(sym);
+            }
+            benefit[nameToSym[name]] += weight(tac);
+        }
+        auto defSym = tac->getDefineSym();
+        if (isPromotable(defSym))
+            written[nameToSym[defSym->get_tac_name(true)]] = true;
+    }
+
+    for (auto global : globals)
+    {
+        // 代价：入口读入，调用后重新读入；被写过时还要在返回和调用前写回
+        int cost = 1 + reloadWeight;
+        if (written[global])
+            cost += exitCnt + writeBackWeight;
+        if (benefit[global] > cost)
+            promote(global, written[global]);
+    }
+}
+
+void GlobalScalarPromoter::computeLoopDepth()
+{
+    std::unordered_map<std::string, size_t> labelPos;
+    std::vector<TACPtr> tacs;
+    for (auto it = _fbegin; it != _fend; ++it)
+    {
+        if ((*it)->operation_ == TACOperationType::Label)
+            labelPos[(*it)->a_->get_tac_name(true)] = tacs.size();
+        tacs.push_back(*it);
+    }
+
+    // 跳回前面标签的跳转与标签之间视为一层循环
+    std::vector<int> delta(tacs.size() + 1, 0);
+    for (size_t i = 0; i < tacs.size(); ++i)
+    {
+        auto op = tacs[i]->operation_;
+        if (op != TACOperationType::Goto && op != TACOperationType::IfZero)
+            continue;
+        auto target = labelPos.find(tacs[i]->a_->get_tac_name(true));
+        if (target != labelPos.end() && target->second < i)
+        {
+            ++delta[target->second];
+            --delta[i + 1];
+        }
+    }
+    int depth = 0;
+    for (size_t i = 0; i < tacs.size(); ++i)
+    {
+        depth += delta[i];
+        loopDepth[tacs[i]] = depth;
+    }
+}
+
+int GlobalScalarPromoter::weight(TACPtr tac) const
+{
+    auto it = loopDepth.find(tac);
+    int depth = it == loopDepth.end() ? 0 : std::min(it->second, 4);
+    int w = 1;
+    while (depth--)
+        w *= 8;
+    return w;
+}
+
+bool GlobalScalarPromoter::isPromotable(SymbolPtr sym) const
+{
+    if (!sym || sym->type_ != SymbolType::Variable || !sym->IsGlobal() || sym->IsGlobalTemp())
+        return false;
+    auto type = sym->value_.Type();
+    return type == SymbolValue::ValueType::Int || type == SymbolValue::ValueType::Float;
+}
+
+bool GlobalScalarPromoter::callReadsGlobal(TACPtr tac) const
+{
+    // 库函数不会访问用户的全局变量
+    if (tac->operation_ != TACOperationType::Call || !tac->b_->IsGlobal())
+        return false;
+    auto summary = _sideEffect->get_summary(tac->b_->get_tac_name(true));
+    return !summary || summary->readGlobal;
+}
+
+bool GlobalScalarPromoter::callWritesGlobal(TACPtr tac) const
+{
+    if (tac->operation_ != TACOperationType::Call || !tac->b_->IsGlobal())
+        return false;
+    auto summary = _sideEffect->get_summary(tac->b_->get_tac_name(true));
+    return !summary || summary->writeGlobal;
+}
+
+void GlobalScalarPromoter::promote(SymbolPtr global, bool written)
+{
+    auto name = global->get_tac_name(true);
+    auto isGlobal = [&name](const SymbolPtr &sym)
+    {
+        return sym && sym->IsGlobal() && sym->value_.Type() != SymbolValue::ValueType::Array && sym->get_tac_name(true) == name;
+    };
+    auto makeTAC = [](TACOperationType op, SymbolPtr a, SymbolPtr b)
+    {
+        auto tac = std::make_shared<ThreeAddressCode::ThreeAddressCode>();
+        tac->operation_ = op;
+        tac->a_ = a;
+        tac->b_ = b;
+        return tac;
+    };
+
+    auto local = std::make_shared<Symbol>(*global);
+    local->name_ = "SPV_" + name;
+
+    // 函数内的访问全部改为访问局部变量
+    for (auto it = _fbegin; it != _fend; ++it)
+    {
+        auto &tac = *it;
+        for (auto field : {&tac->a_, &tac->b_, &tac->c_})
+        {
+            if (!*field)
+                continue;
+            if (isGlobal(*field))
+                *field = local;
+            else if ((*field)->value_.Type() == SymbolValue::ValueType::Array && isGlobal((*field)->value_.GetArrayDescriptor()->base_offset))
+            {
+                // 作为数组下标，复制一份数组访问
+                auto ad = std::make_shared<ArrayDescriptor>(*(*field)->value_.GetArrayDescriptor());
+                ad->base_offset = local;
+                auto arr = std::make_shared<Symbol>(**field);
+                arr->value_ = SymbolValue(ad);
+                *field = arr;
+            }
+        }
+    }
+
+    // 入口(形参声明之后)读入
+    auto entry = _fbegin;
+    ++entry, ++entry;
+    while (entry != _fend && (*entry)->operation_ == TACOperationType::Parameter)
+        ++entry;
+    _tacls->insert(entry, makeTAC(TACOperationType::Variable, local, nullptr));
+    _tacls->insert(entry, makeTAC(TACOperationType::Assign, local, global));
+
+    auto fendTAC = std::prev(_fend);
+    for (auto it = entry; it != fendTAC; ++it)
+    {
+        auto tac = *it;
+        if (written && tac->operation_ == TACOperationType::Return)
+            _tacls->insert(it, makeTAC(TACOperationType::Assign, global, local));
+        else if (callReadsGlobal(tac) || callWritesGlobal(tac))
+        {
+            // 调用前写回(放在实参之前)，调用后重新读入
+            // 只知道被调函数是否写了某个全局变量，重新读入的也要先写回
+            if (written)
+            {
+                auto argBegin = it;
+                while (argBegin != entry)
+                {
+                    auto op = (*std::prev(argBegin))->operation_;
+                    if (op != TACOperationType::Argument && op != TACOperationType::ArgumentAddress)
+                        break;
+                    --argBegin;
+                }
+                _tacls->insert(argBegin, makeTAC(TACOperationType::Assign, global, local));
+            }
+            // 返回值就是该变量时，返回值覆盖了被调函数可能做的修改
+            if (callWritesGlobal(tac) && tac->a_ != local)
+                it = _tacls->insert(std::next(it), makeTAC(TACOperationType::Assign, local, global));
+        }
+    }
+
+    // 从函数末尾直接落出去的情况
+    auto last = std::prev(fendTAC);
+    if (written && (*last)->operation_ != TACOperationType::Return && (*last)->operation_ != TACOperationType::Goto)
+        _tacls->insert(fendTAC, makeTAC(TACOperationType::Assign, global, local));
+}
+
+ConstArrayValues ConstArrayFolder::collect(TACListPtr tacList)
+{
+    ConstArrayValues values;
+    int funcLevel = 0;
+    for (auto &tac : *tacList)
+    {
+        if (tac->operation_ == TACOperationType::FunctionBegin)
+            ++funcLevel;
+        else if (tac->operation_ == TACOperationType::FunctionEnd)
+            --funcLevel;
+        if (funcLevel)
+            continue;
+        if (tac->operation_ == TACOperationType::Constant && tac->a_->IsGlobal() && tac->a_->value_.Type() == SymbolValue::ValueType::Array)
+            values[tac->a_];
+        else if (tac->operation_ == TACOperationType::Assign && tac->a_->value_.Type() == SymbolValue::ValueType::Array)
+        {
+            auto arrayDescriptor = tac->a_->value_.GetArrayDescriptor();
+            auto it = values.find(arrayDescriptor->base_addr.lock());
+            if (it == values.end())
+                continue;
+            auto offset = arrayDescriptor->base_offset;
+            // 初值不是字面量的数组不处理
+            if (!offset->IsLiteral() || !tac->b_->IsLiteral() || tac->b_->value_.Type() != arrayDescriptor->value_type)
+                values.erase(it);
+            else
+                it->second[offset->value_.GetInt()] = tac->b_;
+        }
+    }
+    return values;
+}
+
+bool ConstArrayFolder::valueOf(SymbolPtr sym, int *value) const
+{
+    if (sym->IsLiteral())
+    {
+        if (sym->value_.Type() != SymbolValue::ValueType::Int)
+            return false;
+        *value = sym->value_.GetInt();
+        return true;
+    }
+    auto it = known.find(sym);
+    if (it == known.end())
+        return false;
+    *value = it->second;
+    return true;
+}
+
+void ConstArrayFolder::computeKnown()
+{
+    // 只赋值一次的局部int标量，形参除外；在赋值之前读到的只能是未初始化的值，所以可以认为它一直是这个值
+    std::unordered_map<SymbolPtr, int> defCount;
+    for (auto it = _fbegin; it != _fend; ++it)
+    {
+        auto tac = *it;
+        if (tac->operation_ == TACOperationType::Variable || tac->operation_ == TACOperationType::Constant)
+            continue;
+        auto defSym = tac->getDefineSym();
+        if (!defSym)
+            continue;
+        // 形参在入口处已经有值，算作一次额外的赋值
+        defCount[defSym] += (tac->operation_ == TACOperationType::Parameter ? 2 : 1);
+    }
+
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (auto it = _fbegin; it != _fend; ++it)
+        {
+            auto tac = *it;
+            auto defSym = tac->getDefineSym();
+            if (!defSym || defCount[defSym] != 1 || known.count(defSym) || defSym->IsGlobal() || defSym->value_.Type() != SymbolValue::ValueType::Int)
+                continue;
+            int b, c;
+            switch (tac->operation_)
+            {
+            case TACOperationType::Assign:
+                if (!valueOf(tac->b_, &b))
+                    continue;
+                known[defSym] = b;
+                break;
+            case TACOperationType::Add:
+            case TACOperationType::Sub:
+            case TACOperationType::Mul:
+            {
+                if (!valueOf(tac->b_, &b) || !valueOf(tac->c_, &c))
+                    continue;
+                // 按32位补码回绕
+                uint32_t ub = b, uc = c;
+                uint32_t res = tac->operation_ == TACOperationType::Add ? ub + uc : (tac->operation_ == TACOperationType::Sub ? ub - uc : ub * uc);
+                known[defSym] = static_cast<int>(res);
+                break;
+            }
+            default:
+                continue;
+            }
+            changed = true;
+        }
+    }
+}
+
+void ConstArrayFolder::optimize()
+{
+    if (_constArrays->empty())
+        return;
+    computeKnown();
+    for (auto it = _fbegin; it != _fend; ++it)
+    {
+        auto tac = *it;
+        // 前端把数组元素的读取都放在单独的赋值中
+        if (tac->operation_ != TACOperationType::Assign || !tac->a_->value_.IsNumericType() ||
+            tac->b_->value_.Type() != SymbolValue::ValueType::Array)
+            continue;
+        auto arrayDescriptor = tac->b_->value_.GetArrayDescriptor();
+        auto array = arrayDescriptor->base_addr.lock();
+        auto values = _constArrays->find(array);
+        int offset;
+        if (values == _constArrays->end() || !valueOf(arrayDescriptor->base_offset, &offset))
+            continue;
+        if (offset < 0 || offset >= static_cast<int>(array->value_.GetArrayDescriptor()->GetSizeInByte() / 4))
+            continue;
+        auto value = values->second.find(offset);
+        if (value != values->second.end())
+        {
+            tac->b_ = value->second;
+            continue;
+        }
+        tac->b_ = zeroLiteral(arrayDescriptor->value_type);
+    }
+}
+
+bool ArrayScalarizer::matchInitCall(TACList::iterator it, InitCall *init) const
+{
+    auto literalOffset = [](const SymbolPtr &element, int *offset)
+    {
+        auto base_offset = element->value_.GetArrayDescriptor()->base_offset;
+        if (!base_offset->IsLiteral() || base_offset->value_.Type() != SymbolValue::ValueType::Int)
+            return false;
+        *offset = base_offset->value_.GetInt();
+        return true;
+    };
+    init->first = it;
+    init->source = nullptr;
+    init->sourceOffset = 0;
+    if (!literalOffset((*it)->a_, &init->offset))
+        return false;
+    auto next = std::next(it);
+    // _builtin_copy多一个源数组地址
+    if (next != _fend && (*next)->operation_ == TACOperationType::ArgumentAddress)
+    {
+        auto source = (*next)->a_->value_.GetArrayDescriptor()->base_addr.lock();
+        if (!_constArrays->count(source) || !literalOffset((*next)->a_, &init->sourceOffset))
+            return false;
+        init->source = source;
+        ++next;
+    }
+    if (next == _fend || (*next)->operation_ != TACOperationType::Argument || !(*next)->a_->IsLiteral() ||
+        (*next)->a_->value_.Type() != SymbolValue::ValueType::Int)
+        return false;
+    init->count = (*next)->a_->value_.GetInt();
+    init->call = std::next(next);
+    if (init->call == _fend || (*init->call)->operation_ != TACOperationType::Call || (*init->call)->a_)
+        return false;
+    auto size = static_cast<int>((*it)->a_->value_.GetArrayDescriptor()->base_addr.lock()->value_.GetArrayDescriptor()->GetSizeInByte() / 4);
+    if (init->offset < 0 || init->count < 0 || init->offset + init->count > size)
+        return false;
+    return (*init->call)->b_->get_tac_name(true) == (init->source ? "_builtin_copy" : "_builtin_clear");
+}
+
+SymbolPtr ArrayScalarizer::templateValue(const InitCall &init, int k, SymbolPtr element) const
+{
+    if (init.source)
+    {
+        auto &values = _constArrays->at(init.source);
+        auto it = values.find(init.sourceOffset + k);
+        if (it != values.end())
+            return it->second;
+    }
+    return zeroLiteral(element->value_.Type());
+}
+
+void ArrayScalarizer::optimize()
+{
+    // 候选数组 -> 声明
+    std::unordered_map<SymbolPtr, TACList::iterator> candidates;
+    for (auto it = _fbegin; it != _fend; ++it)
+    {
+        auto tac = *it;
+        if ((tac->operation_ != TACOperationType::Variable && tac->operation_ != TACOperationType::Constant) ||
+            tac->a_->value_.Type() != SymbolValue::ValueType::Array || tac->a_->IsGlobal())
+            continue;
+        auto size = tac->a_->value_.GetArrayDescriptor()->GetSizeInByte() / 4;
+        if (size > 0 && size <= MAX_ELEMENTS)
+            candidates.emplace(tac->a_, it);
+    }
+
+    // 检查所有访问，下标不是字面量或者地址被传出的数组不处理
+    std::unordered_map<SymbolPtr, std::vector<InitCall>> inits;
+    for (auto it = _fbegin; it != _fend && !candidates.empty(); ++it)
+    {
+        auto tac = *it;
+        if (tac->operation_ == TACOperationType::Variable || tac->operation_ == TACOperationType::Constant)
+            continue;
+        if (tac->operation_ == TACOperationType::ArgumentAddress)
+        {
+            auto base = tac->a_->value_.GetArrayDescriptor()->base_addr.lock();
+            if (!candidates.count(base))
+                continue;
+            InitCall init;
+            if (matchInitCall(it, &init))
+            {
+                inits[base].push_back(init);
+                it = init.call;
+            }
+            else
+                candidates.erase(base);
+            continue;
+        }
+        for (auto sym : {tac->a_, tac->b_, tac->c_})
+        {
+            if (!sym || sym->value_.Type() != SymbolValue::ValueType::Array)
+                continue;
+            auto arrayDescriptor = sym->value_.GetArrayDescriptor();
+            auto base = arrayDescriptor->base_addr.lock();
+            if (!candidates.count(base))
+                continue;
+            auto offset = arrayDescriptor->base_offset;
+            int size = base->value_.GetArrayDescriptor()->GetSizeInByte() / 4;
+            if (sym == base || !offset->IsLiteral() || offset->value_.Type() != SymbolValue::ValueType::Int ||
+                offset->value_.GetInt() < 0 || offset->value_.GetInt() >= size)
+                candidates.erase(base);
+        }
+    }
+    if (candidates.empty())
+        return;
+
+    // 每个元素一个标量
+    std::unordered_map<SymbolPtr, std::vector<SymbolPtr>> scalars;
+    for (auto &[array, decl] : candidates)
+    {
+        auto type = array->value_.GetArrayDescriptor()->value_type;
+        auto &elements = scalars[array];
+        int size = array->value_.GetArrayDescriptor()->GetSizeInByte() / 4;
+        for (int k = 0; k < size; ++k)
+        {
+            auto scalar = std::make_shared<Symbol>(*array);
+            scalar->type_ = SymbolType::Variable;
+            scalar->name_ = "SRV_" + array->get_tac_name(true) + "_" + std::to_string(k);
+            scalar->value_ = type == SymbolValue::ValueType::Float ? SymbolValue(0.0f) : SymbolValue(0);
+            elements.push_back(scalar);
+            auto tac = std::make_shared<ThreeAddressCode::ThreeAddressCode>();
+            tac->operation_ = TACOperationType::Variable;
+            tac->a_ = scalar;
+            _tacls->insert(decl, tac);
+        }
+        _tacls->erase(decl);
+    }
+
+    for (auto it = _fbegin; it != _fend; ++it)
+    {
+        auto &tac = *it;
+        if (tac->operation_ == TACOperationType::ArgumentAddress)
+            continue;
+        for (auto field : {&tac->a_, &tac->b_, &tac->c_})
+        {
+            if (!*field || (*field)->value_.Type() != SymbolValue::ValueType::Array)
+                continue;
+            auto arrayDescriptor = (*field)->value_.GetArrayDescriptor();
+            auto elements = scalars.find(arrayDescriptor->base_addr.lock());
+            if (elements != scalars.end())
+                *field = elements->second[arrayDescriptor->base_offset->value_.GetInt()];
+        }
+    }
+
+    // 初始化调用改为逐个元素赋值
+    for (auto &[array, calls] : inits)
+    {
+        auto elements = scalars.find(array);
+        if (elements == scalars.end())
+            continue;
+        for (auto &init : calls)
+        {
+            for (int k = 0; k < init.count; ++k)
+            {
+                auto tac = std::make_shared<ThreeAddressCode::ThreeAddressCode>();
+                tac->operation_ = TACOperationType::Assign;
+                tac->a_ = elements->second[init.offset + k];
+                tac->b_ = templateValue(init, k, tac->a_);
+                _tacls->insert(init.first, tac);
+            }
+            for (auto it = init.first, end = std::next(init.call); it != end;)
+                _tacls->erase(it++);
+        }
+    }
+}
+
+void ArrayAccessOptimizer::clear()
+{
+    elements.clear();
+    canon.clear();
+    exprs.clear();
+}
+
+SymbolPtr ArrayAccessOptimizer::rep(SymbolPtr sym) const
+{
+    auto it = canon.find(sym);
+    return it == canon.end() ? sym : it->second;
+}
+
+void ArrayAccessOptimizer::kill(SymbolPtr sym)
+{
+    for (auto it = canon.begin(); it != canon.end();)
+    {
+        if (it->first == sym || it->second == sym)
+            it = canon.erase(it);
+        else
+            ++it;
+    }
+    exprs.erase(std::remove_if(exprs.begin(), exprs.end(), [&sym](const Expr &e)
+                               { return e.b == sym || e.c == sym || e.result == sym; }),
+                exprs.end());
+    elements.erase(std::remove_if(elements.begin(), elements.end(), [&sym](const Element &e)
+                                  { return e.offset == sym || e.value == sym; }),
+                   elements.end());
+}
+
+bool ArrayAccessOptimizer::mayAlias(SymbolPtr base1, SymbolPtr base2) const
+{
+    return arraysMayAlias(base1, base2, paramArrays);
+}
+
+bool ArrayAccessOptimizer::mayAlias(const Element &e, SymbolPtr base, SymbolPtr offset) const
+{
+    if (!mayAlias(e.base, base))
+        return false;
+    if (e.base != base || !offset)
+        return true;
+    // 同一数组的不同字面量下标
+    return !(e.offset->IsLiteral() && offset->IsLiteral() && !sameValue(e.offset, offset));
+}
+
+void ArrayAccessOptimizer::markRead(SymbolPtr base, SymbolPtr offset)
+{
+    for (auto &e : elements)
+    {
+        if (mayAlias(e, base, offset))
+            e.pending = false;
+    }
+}
+
+void ArrayAccessOptimizer::markWritten(SymbolPtr base, SymbolPtr offset)
+{
+    elements.erase(std::remove_if(elements.begin(), elements.end(), [&](const Element &e)
+                                  { return mayAlias(e, base, offset); }),
+                   elements.end());
+}
+
+void ArrayAccessOptimizer::killGlobals()
+{
+    std::vector<SymbolPtr> globals;
+    auto collect = [&globals](const SymbolPtr &sym)
+    {
+        if (sym && sym->IsGlobal())
+            globals.push_back(sym);
+    };
+    for (auto &[sym, r] : canon)
+    {
+        collect(sym);
+        collect(r);
+    }
+    for (auto &e : exprs)
+    {
+        collect(e.b);
+        collect(e.c);
+    }
+    for (auto &sym : globals)
+        kill(sym);
+}
+
+void ArrayAccessOptimizer::number(TACPtr tac)
+{
+    auto defSym = tac->getDefineSym();
+    if (!defSym)
+        return;
+    // 先取操作数的代表，defSym可能也是操作数
+    auto rb = tac->b_ ? rep(tac->b_) : nullptr;
+    auto rc = tac->c_ ? rep(tac->c_) : nullptr;
+    kill(defSym);
+    if (defSym->value_.Type() != SymbolValue::ValueType::Int || rb == defSym || rc == defSym)
+        return;
+    auto isScalar = [](const SymbolPtr &sym)
+    {
+        return sym && sym->value_.Type() == SymbolValue::ValueType::Int;
+    };
+    switch (tac->operation_)
+    {
+    case TACOperationType::Assign:
+        if (isScalar(rb))
+            canon[defSym] = rb;
+        break;
+    case TACOperationType::Add:
+    case TACOperationType::Sub:
+    case TACOperationType::Mul:
+    {
+        if (!isScalar(rb) || !isScalar(rc))
+            break;
+        bool commutative = tac->operation_ != TACOperationType::Sub;
+        for (auto &e : exprs)
+        {
+            if (e.op == tac->operation_ && ((sameValue(e.b, rb) && sameValue(e.c, rc)) || (commutative && sameValue(e.b, rc) && sameValue(e.c, rb))))
+            {
+                canon[defSym] = e.result;
+                return;
+            }
+        }
+        exprs.push_back({tac->operation_, rb, rc, defSym});
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+bool ArrayAccessOptimizer::load(TACPtr tac)
+{
+    auto arrayDescriptor = tac->b_->value_.GetArrayDescriptor();
+    auto base = arrayDescriptor->base_addr.lock();
+    auto offset = rep(arrayDescriptor->base_offset);
+    for (auto &e : elements)
+    {
+        if (e.base != base || !sameValue(e.offset, offset) || e.value->value_.Type() != tac->a_->value_.Type())
+            continue;
+        // 元素的值已经在e.value中，改为复制
+        tac->b_ = e.value;
+        if (e.value != tac->a_)
+            number(tac);
+        return true;
+    }
+    markRead(base, offset);
+    number(tac);
+    if (offset != tac->a_)
+        elements.push_back({base, offset, tac->a_, _fend, false});
+    return true;
+}
+
+bool ArrayAccessOptimizer::store(TACList::iterator it)
+{
+    auto tac = *it;
+    auto arrayDescriptor = tac->a_->value_.GetArrayDescriptor();
+    auto base = arrayDescriptor->base_addr.lock();
+    auto offset = rep(arrayDescriptor->base_offset);
+    auto value = tac->b_;
+    for (auto &e : elements)
+    {
+        if (e.base != base || !sameValue(e.offset, offset))
+            continue;
+        // 元素中已经是这个值
+        if (sameValue(rep(e.value), rep(value)))
+        {
+            _tacls->erase(it);
+            return false;
+        }
+        // 上一次写入还没被读过就被覆盖
+        if (e.pending)
+            _tacls->erase(e.store);
+        break;
+    }
+    markWritten(base, offset);
+    elements.push_back({base, offset, value, it, true});
+    return true;
+}
+
+void ArrayAccessOptimizer::optimize()
+{
+    for (auto it = _fbegin; it != _fend; ++it)
+    {
+        auto tac = *it;
+        if (tac->operation_ == TACOperationType::Parameter && tac->a_->value_.Type() == SymbolValue::ValueType::Array)
+        {
+            paramArrays.insert(tac->a_);
+            paramArrays.insert(tac->a_->value_.GetArrayDescriptor()->base_addr.lock());
+        }
+    }
+
+    auto baseOf = [](const SymbolPtr &sym)
+    {
+        return sym->value_.GetArrayDescriptor()->base_addr.lock();
+    };
+    clear();
+    for (auto it = _fbegin; it != _fend;)
+    {
+        auto cur = it++;
+        auto tac = *cur;
+        switch (tac->operation_)
+        {
+        case TACOperationType::FunctionBegin:
+        case TACOperationType::FunctionEnd:
+        case TACOperationType::Label:
+        case TACOperationType::Goto:
+        case TACOperationType::IfZero:
+        case TACOperationType::Return:
+        case TACOperationType::CallAndReturn:
+            // 基本块边界
+            clear();
+            continue;
+        case TACOperationType::ArgumentAddress:
+            markRead(baseOf(tac->a_), nullptr);
+            continue;
+        case TACOperationType::Call:
+            // 跨调用保留元素的值需要占用callee-saved寄存器或者溢出到栈上，不比重新读取划算，
+            // 所以调用之后不再转发；调用之前的写入可能被被调函数读到
+            elements.clear();
+            if (_sideEffect->get_callSummary(tac).writeGlobal)
+                killGlobals();
+            number(tac);
+            continue;
+        case TACOperationType::Variable:
+        case TACOperationType::Constant:
+            // 重新进入作用域的数组内容未知
+            if (tac->a_->value_.Type() == SymbolValue::ValueType::Array)
+                markWritten(tac->a_, nullptr);
+            else
+                number(tac);
+            continue;
+        case TACOperationType::Assign:
+            if (tac->b_->value_.Type() == SymbolValue::ValueType::Array && tac->a_->value_.IsNumericType())
+            {
+                load(tac);
+                continue;
+            }
+            if (tac->a_->value_.Type() == SymbolValue::ValueType::Array && tac->b_->value_.Type() != SymbolValue::ValueType::Array)
+            {
+                store(cur);
+                continue;
+            }
+            break;
+        default:
+            break;
+        }
+        // 其余用到数组元素的tac，按可能读写该数组处理
+        for (auto sym : {tac->a_, tac->b_, tac->c_})
+        {
+            if (sym && sym->value_.Type() == SymbolValue::ValueType::Array)
+            {
+                markRead(baseOf(sym), nullptr);
+                if (sym == tac->a_ && tac->operation_ != TACOperationType::Argument)
+                    markWritten(baseOf(sym), nullptr);
+            }
+        }
+        number(tac);
+    }
+}
+
+bool LoopNestOptimizer::match(TACList::iterator it, Nest *nest) const
+{
+    auto isOp = [this](TACList::iterator it, TACOperationType op)
+    {
+        return it != _fend && (*it)->operation_ == op;
+    };
+    // 局部int变量赋初值
+    auto isInit = [](const TACPtr &tac)
+    {
+        return tac->operation_ == TACOperationType::Assign && !tac->a_->IsGlobal() && tac->a_->value_.Type() == SymbolValue::ValueType::Int &&
+               tac->b_->value_.Type() == SymbolValue::ValueType::Int;
+    };
+    // 标量的运算、复制和转换
+    auto isScalarOp = [](const TACPtr &tac)
+    {
+        auto op = tac->operation_;
+        if (op == TACOperationType::Variable || op == TACOperationType::Constant)
+            return tac->a_->value_.Type() != SymbolValue::ValueType::Array;
+        return (op > TACOperationType::Undefined && op < TACOperationType::LogicAnd) || (op >= TACOperationType::UnaryMinus && op <= TACOperationType::UnaryPositive) ||
+               op == TACOperationType::Assign || op == TACOperationType::FloatToInt || op == TACOperationType::IntToFloat;
+    };
+    // 条件到ifz为止，只有标量的运算
+    auto skipCondition = [&](TACList::iterator it)
+    {
+        for (; it != _fend && (*it)->operation_ != TACOperationType::IfZero; ++it)
+        {
+            auto tac = *it;
+            if (!isScalarOp(tac))
+                return _fend;
+            for (auto &sym : {tac->a_, tac->b_, tac->c_})
+            {
+                if (sym && sym->value_.Type() == SymbolValue::ValueType::Array)
+                    return _fend;
+            }
+        }
+        return it;
+    };
+
+    // 跳过标量声明，记在decls中
+    auto skipDecls = [&](TACList::iterator it)
+    {
+        while (isOp(it, TACOperationType::Variable) && (*it)->a_->value_.Type() != SymbolValue::ValueType::Array)
+            nest->decls.push_back(it++);
+        return it;
+    };
+
+    auto &outer = nest->outer, &inner = nest->inner;
+    nest->decls.clear();
+    if (!isInit(*it))
+        return false;
+    outer.init = it;
+    outer.var = (*it)->a_;
+    outer.jump = it = skipDecls(++it);
+    if (!isOp(it, TACOperationType::Goto))
+        return false;
+    auto outerCondLabel = (*it)->a_;
+    outer.head = ++it;
+    if (!isOp(it, TACOperationType::Label))
+        return false;
+    auto outerHead = (*it)->a_;
+    it = skipDecls(++it);
+    if (it == _fend || !isInit(*it) || (*it)->a_ == outer.var)
+        return false;
+    inner.init = it;
+    inner.var = (*it)->a_;
+    inner.jump = it = skipDecls(++it);
+    if (!isOp(it, TACOperationType::Goto))
+        return false;
+    auto innerCondLabel = (*it)->a_;
+    inner.head = ++it;
+    if (!isOp(it, TACOperationType::Label))
+        return false;
+    auto innerHead = (*it)->a_;
+
+    nest->bodyBegin = ++it;
+    while (it != _fend && isScalarOp(*it))
+        ++it;
+    if (!isOp(it, TACOperationType::Label) || (*it)->a_ != innerCondLabel)
+        return false;
+    inner.condLabel = it;
+    if (!matchIncrement(nest->bodyBegin, inner.condLabel, inner.var, &inner.incBegin, &inner.step))
+        return false;
+    it = skipCondition(++it);
+    if (it == _fend || (*it)->a_ != innerHead)
+        return false;
+    inner.branch = it;
+    if (!isOp(++it, TACOperationType::Label))
+        return false;
+    auto innerBreak = (*it)->a_;
+
+    auto incBegin = it = skipDecls(++it);
+    while (it != _fend && (*it)->operation_ != TACOperationType::Label)
+        ++it;
+    if (it == _fend || (*it)->a_ != outerCondLabel)
+        return false;
+    outer.condLabel = it;
+    if (!matchIncrement(incBegin, it, outer.var, &outer.incBegin, &outer.step) || outer.incBegin != incBegin)
+        return false;
+    it = skipCondition(++it);
+    if (it == _fend || (*it)->a_ != outerHead)
+        return false;
+    outer.branch = it;
+    if (!isOp(++it, TACOperationType::Label))
+        return false;
+    nest->end = ++it;
+
+    // 除了循环本身的跳转，没有别的代码跳进嵌套里
+    auto refs = [this](const SymbolPtr &label)
+    {
+        auto ref = labelRefs.find(label);
+        return ref == labelRefs.end() ? 0 : ref->second;
+    };
+    return refs(outerHead) == 1 && refs(innerHead) == 1 && refs(outerCondLabel) == 1 && refs(innerCondLabel) == 1 && refs(innerBreak) == 0;
+}
+
+bool LoopNestOptimizer::evaluate(TACOperationType op, const Subscript &x, const Subscript &y, Subscript *result)
+{
+    auto isConstant = [](const Subscript &s)
+    {
+        return s.sizes.empty() && s.dims[0].coef[0] == 0 && s.dims[0].coef[1] == 0;
+    };
+    switch (op)
+    {
+    case TACOperationType::Add:
+    case TACOperationType::Sub:
+    {
+        // 只有一维的量加到最后一维上
+        if (op == TACOperationType::Add && x.sizes.empty() && !y.sizes.empty())
+            return evaluate(op, y, x, result);
+        if (!y.sizes.empty())
+            return false;
+        *result = x;
+        auto &last = result->dims.back();
+        int sign = op == TACOperationType::Add ? 1 : -1;
+        for (int v = 0; v < 2; ++v)
+            last.coef[v] += sign * y.dims[0].coef[v];
+        last.constant += sign * y.dims[0].constant;
+        break;
+    }
+    case TACOperationType::Mul:
+    {
+        if (isConstant(x) && !isConstant(y))
+            return evaluate(op, y, x, result);
+        if (!isConstant(y))
+            return false;
+        auto k = y.dims[0].constant;
+        *result = x;
+        if (isConstant(x))
+        {
+            result->dims[0].constant *= k;
+            break;
+        }
+        // 乘以正的常数看作多出一维，之后加上的量是新一维的下标
+        if (k <= 0)
+            return false;
+        result->sizes.push_back(k);
+        result->dims.push_back(Term{{0, 0}, 0});
+        break;
+    }
+    default:
+        return false;
+    }
+    // 太大的值不可能是合法的下标
+    const long long limit = 1LL << 31;
+    for (auto &term : result->dims)
+    {
+        if (std::llabs(term.coef[0]) >= limit || std::llabs(term.coef[1]) >= limit || std::llabs(term.constant) >= limit)
+            return false;
+    }
+    return true;
+}
+
+bool LoopNestOptimizer::permutable(const Subscript &subscript)
+{
+    // 同一元素在迭代(i, j)和(i + di, j + dj)都被访问时，每一维都有 ci * di + cj * dj = 0
+    // 交换后先后顺序颠倒的是 di > 0 且 dj < 0 的依赖
+    const Term *ratio = nullptr;
+    for (auto &term : subscript.dims)
+    {
+        auto ci = term.coef[0], cj = term.coef[1];
+        if (ci == 0 && cj == 0)
+            continue;
+        // 只有一个变量的系数不为0时，它的差只能是0
+        if (ci == 0 || cj == 0)
+            return true;
+        // 系数异号时di、dj同号
+        if ((ci > 0) != (cj > 0))
+            return true;
+        // 两维的比例不同时只有 di = dj = 0
+        if (ratio && ratio->coef[0] * cj != ratio->coef[1] * ci)
+            return true;
+        ratio = &term;
+    }
+    return false;
+}
+
+long long LoopNestOptimizer::stride(const Subscript &subscript, int var)
+{
+    const long long limit = 1LL << 40;
+    long long ret = 0;
+    for (size_t k = 0; k < subscript.dims.size(); ++k)
+    {
+        if (k)
+            ret *= subscript.sizes[k - 1];
+        ret += subscript.dims[k].coef[var];
+        ret = std::max(-limit, std::min(limit, ret));
+    }
+    return ret;
+}
+
+bool LoopNestOptimizer::analyze(const Nest &nest, const std::unordered_set<SymbolPtr> &liveOut, std::vector<Access> *accesses) const
+{
+    auto outerVar = nest.outer.var, innerVar = nest.inner.var;
+
+    // 循环变量、增量和条件中定值的变量，交换后它们在循环之后的值会变
+    std::unordered_set<SymbolPtr> controlDefs{outerVar, innerVar};
+    auto collectDefs = [&controlDefs](TACList::iterator begin, TACList::iterator end)
+    {
+        for (; begin != end; ++begin)
+        {
+            if (auto defSym = (*begin)->getDefineSym())
+                controlDefs.insert(defSym);
+        }
+    };
+    collectDefs(nest.inner.incBegin, nest.inner.condLabel);
+    collectDefs(std::next(nest.inner.condLabel), nest.inner.branch);
+    collectDefs(nest.outer.incBegin, nest.outer.condLabel);
+    collectDefs(std::next(nest.outer.condLabel), nest.outer.branch);
+    for (auto &sym : controlDefs)
+    {
+        if (liveOut.count(sym))
+            return false;
+    }
+
+    // 循环体中的定值(不算声明)和使用次数
+    auto isDecl = [](const TACPtr &tac)
+    {
+        return tac->operation_ == TACOperationType::Variable || tac->operation_ == TACOperationType::Constant;
+    };
+    std::unordered_map<SymbolPtr, int> defCount, useCount;
+    for (auto it = nest.bodyBegin; it != nest.inner.incBegin; ++it)
+    {
+        if (isDecl(*it))
+            continue;
+        auto defSym = (*it)->getDefineSym();
+        if (defSym && defSym->value_.Type() != SymbolValue::ValueType::Array)
+            ++defCount[defSym];
+        for (auto &sym : (*it)->getUseSym())
+            ++useCount[sym];
+    }
+
+    // 初值和条件只能用到本层的变量、条件自己算出的值和整个嵌套中不变的量
+    auto invariant = [&](const SymbolPtr &sym)
+    {
+        return sym->IsLiteral() || (!controlDefs.count(sym) && !defCount.count(sym));
+    };
+    auto checkCondition = [&](TACList::iterator begin, TACList::iterator end, const SymbolPtr &var)
+    {
+        std::unordered_set<SymbolPtr> local;
+        for (; begin != end; ++begin)
+        {
+            for (auto &sym : {(*begin)->b_, (*begin)->c_})
+            {
+                if (sym && sym != var && !local.count(sym) && !invariant(sym))
+                    return false;
+            }
+            local.insert((*begin)->a_);
+        }
+        return true;
+    };
+    if (!checkCondition(std::next(nest.inner.condLabel), nest.inner.branch, innerVar) ||
+        !checkCondition(std::next(nest.outer.condLabel), nest.outer.branch, outerVar) ||
+        !invariant((*nest.outer.init)->b_) || !invariant((*nest.inner.init)->b_))
+        return false;
+
+    // 按顺序扫描循环体，记录本次迭代中已经定值的变量和它们的仿射值
+    std::unordered_set<SymbolPtr> defined;
+    std::unordered_map<SymbolPtr, Subscript> values;
+    // 在本次迭代定值之前就用到的变量，值来自上一次迭代
+    std::vector<SymbolPtr> carried;
+    auto linear = [&](const SymbolPtr &sym, Subscript *value)
+    {
+        if (sym->IsLiteral() && sym->value_.Type() == SymbolValue::ValueType::Int)
+            *value = Subscript{{Term{{0, 0}, sym->value_.GetInt()}}, {}};
+        else if (sym == outerVar)
+            *value = Subscript{{Term{{1, 0}, 0}}, {}};
+        else if (sym == innerVar)
+            *value = Subscript{{Term{{0, 1}, 0}}, {}};
+        else if (auto it = values.find(sym); it != values.end())
+            *value = it->second;
+        else
+            return false;
+        return true;
+    };
+    auto useScalar = [&](const SymbolPtr &sym)
+    {
+        if (sym->IsLiteral() || sym == outerVar || sym == innerVar || defined.count(sym))
+            return true;
+        if (controlDefs.count(sym))
+            return false;
+        if (defCount.count(sym))
+            carried.push_back(sym);
+        return true;
+    };
+    auto useElement = [&](const SymbolPtr &sym, bool write)
+    {
+        auto arrayDescriptor = sym->value_.GetArrayDescriptor();
+        auto base = arrayDescriptor->base_addr.lock();
+        if (!base || sym == base || !useScalar(arrayDescriptor->base_offset))
+            return false;
+        Access access{base, write, false, {}};
+        access.affine = linear(arrayDescriptor->base_offset, &access.subscript);
+        // 常数项按各维的长度进位，使每一维(除了第一维)的常数都在[0, 长度)中
+        auto &s = access.subscript;
+        for (size_t k = s.dims.size() - 1; access.affine && k > 0; --k)
+        {
+            auto size = s.sizes[k - 1];
+            auto carry = s.dims[k].constant / size - (s.dims[k].constant % size < 0 ? 1 : 0);
+            s.dims[k].constant -= carry * size;
+            s.dims[k - 1].constant += carry;
+        }
+        accesses->push_back(access);
+        return true;
+    };
+
+    for (auto it = nest.bodyBegin; it != nest.inner.incBegin; ++it)
+    {
+        auto tac = *it;
+        if (isDecl(tac))
+            continue;
+        for (auto &sym : {tac->b_, tac->c_})
+        {
+            if (!sym)
+                continue;
+            if (!(sym->value_.Type() == SymbolValue::ValueType::Array ? useElement(sym, false) : useScalar(sym)))
+                return false;
+        }
+        if (tac->a_->value_.Type() == SymbolValue::ValueType::Array)
+        {
+            if (!useElement(tac->a_, true))
+                return false;
+            continue;
+        }
+        auto defSym = tac->a_;
+        if (controlDefs.count(defSym))
+            return false;
+        Subscript x, y, value;
+        bool known = false;
+        if (tac->operation_ == TACOperationType::Assign)
+            known = linear(tac->b_, &value);
+        else if (tac->operation_ == TACOperationType::Add || tac->operation_ == TACOperationType::Sub || tac->operation_ == TACOperationType::Mul)
+            known = linear(tac->b_, &x) && linear(tac->c_, &y) && evaluate(tac->operation_, x, y, &value);
+        defined.insert(defSym);
+        if (known && defSym->value_.Type() == SymbolValue::ValueType::Int)
+            values[defSym] = value;
+        else
+            values.erase(defSym);
+    }
+
+    // 跨迭代的标量只能是 s = s + x 或 t = s + x; s = t 形式的int累加，交换顺序不改变结果
+    for (auto &sym : carried)
+    {
+        if (sym->value_.Type() != SymbolValue::ValueType::Int || defCount[sym] != 1 || useCount[sym] != 1)
+            return false;
+        TACPtr def, use;
+        for (auto it = nest.bodyBegin; it != nest.inner.incBegin; ++it)
+        {
+            if ((*it)->a_ == sym)
+                def = *it;
+            if ((*it)->b_ == sym || (*it)->c_ == sym)
+                use = *it;
+        }
+        if (!def || !use || use->operation_ != TACOperationType::Add || use->b_ == use->c_)
+            return false;
+        if (def != use && (def->operation_ != TACOperationType::Assign || def->b_ != use->a_ || defCount[use->a_] != 1 || useCount[use->a_] != 1))
+            return false;
+    }
+
+    // 被写的数组：所有可能重叠的访问都是同一数组的同一下标，并且依赖允许交换
+    auto sameSubscript = [](const Subscript &x, const Subscript &y)
+    {
+        if (x.sizes != y.sizes || x.dims.size() != y.dims.size())
+            return false;
+        for (size_t k = 0; k < x.dims.size(); ++k)
+        {
+            if (x.dims[k].coef[0] != y.dims[k].coef[0] || x.dims[k].coef[1] != y.dims[k].coef[1] || x.dims[k].constant != y.dims[k].constant)
+                return false;
+        }
+        return true;
+    };
+    for (auto &write : *accesses)
+    {
+        if (!write.write)
+            continue;
+        if (!write.affine || !permutable(write.subscript))
+            return false;
+        for (auto &access : *accesses)
+        {
+            if (arraysMayAlias(write.base, access.base, paramArrays) &&
+                (access.base != write.base || !access.affine || !sameSubscript(write.subscript, access.subscript)))
+                return false;
+        }
+    }
+    return true;
+}
+
+TACList::iterator LoopNestOptimizer::interchange(const Nest &nest)
+{
+    auto &outer = nest.outer, &inner = nest.inner;
+    std::vector<TACPtr> order;
+    auto append = [&order](TACList::iterator begin, TACList::iterator end)
+    {
+        for (; begin != end; ++begin)
+            order.push_back(*begin);
+    };
+    // 声明提到嵌套之前；初值、增量和条件与另一层互换，标号和跳转留在原处
+    for (auto &decl : nest.decls)
+        order.push_back(*decl);
+    order.push_back(*inner.init);
+    order.push_back(*outer.jump);
+    order.push_back(*outer.head);
+    order.push_back(*outer.init);
+    order.push_back(*inner.jump);
+    order.push_back(*inner.head);
+    append(nest.bodyBegin, inner.incBegin);
+    append(outer.incBegin, outer.condLabel);
+    order.push_back(*inner.condLabel);
+    append(std::next(outer.condLabel), outer.branch);
+    order.push_back(*inner.branch);
+    order.push_back(*std::next(inner.branch));
+    append(inner.incBegin, inner.condLabel);
+    order.push_back(*outer.condLabel);
+    append(std::next(inner.condLabel), inner.branch);
+    order.push_back(*outer.branch);
+    order.push_back(*std::next(outer.branch));
+    std::swap((*outer.branch)->b_, (*inner.branch)->b_);
+
+    auto it = outer.init;
+    for (auto &tac : order)
+        *it++ = tac;
+    return std::next(outer.init, nest.decls.size());
+}
+
+void LoopNestOptimizer::tile(const Nest &nest, int tileSize)
+{
+    auto &outer = nest.outer, &inner = nest.inner;
+    auto var = inner.var;
+    auto suffix = std::to_string(tileCount++);
+    auto makeTAC = [](TACOperationType op, SymbolPtr a, SymbolPtr b, SymbolPtr c)
+    {
+        auto tac = std::make_shared<ThreeAddressCode::ThreeAddressCode>();
+        tac->operation_ = op;
+        tac->a_ = a;
+        tac->b_ = b;
+        tac->c_ = c;
+        return tac;
+    };
+    auto makeVar = [&](const std::string &prefix)
+    {
+        auto sym = std::make_shared<Symbol>(*var);
+        sym->name_ = prefix + var->get_tac_name(true) + "_" + suffix;
+        _tacls->insert(outer.init, makeTAC(TACOperationType::Variable, sym, nullptr, nullptr));
+        return sym;
+    };
+    auto makeLabel = [&](const std::string &name)
+    {
+        auto label = std::make_shared<Symbol>();
+        label->type_ = SymbolType::Label;
+        label->name_ = (*_fbegin)->a_->get_tac_name(true) + "_LT" + suffix + name;
+        label->offset_ = 0;
+        return label;
+    };
+    auto tileBegin = makeVar("LTB_"), tileEnd = makeVar("LTE_"), beyond = makeVar("LTX_"), stop = makeVar("LTS_");
+    auto head = makeLabel("H"), cond = makeLabel("C");
+    auto size = intLiteral(tileSize);
+    std::vector<TACPtr> condition;
+    for (auto it = std::next(inner.condLabel); it != inner.branch; ++it)
+    {
+        if ((*it)->operation_ != TACOperationType::Variable)
+            condition.push_back(std::make_shared<ThreeAddressCode::ThreeAddressCode>(**it));
+    }
+    auto innerCond = (*inner.branch)->b_;
+
+    // 块的循环：从内层的初值开始，每次加tileSize，原来的条件对块的起点成立时继续
+    _tacls->insert(outer.init, makeTAC(TACOperationType::Assign, tileBegin, (*inner.init)->b_, nullptr));
+    _tacls->insert(outer.init, makeTAC(TACOperationType::Goto, cond, nullptr, nullptr));
+    _tacls->insert(outer.init, makeTAC(TACOperationType::Label, head, nullptr, nullptr));
+    _tacls->insert(nest.end, makeTAC(TACOperationType::Add, tileBegin, tileBegin, size));
+    _tacls->insert(nest.end, makeTAC(TACOperationType::Label, cond, nullptr, nullptr));
+    _tacls->insert(nest.end, makeTAC(TACOperationType::Assign, var, tileBegin, nullptr));
+    for (auto &tac : condition)
+        _tacls->insert(nest.end, tac);
+    _tacls->insert(nest.end, makeTAC(TACOperationType::IfZero, head, innerCond, nullptr));
+
+    // 内层从块的起点开始，到块的终点或原来的条件不成立为止；innerCond只取0、1，与越界标志相加为0时继续
+    (*inner.init)->b_ = tileBegin;
+    _tacls->insert(std::next(inner.init), makeTAC(TACOperationType::Add, tileEnd, tileBegin, size));
+    _tacls->insert(inner.branch, makeTAC(TACOperationType::GreaterOrEqual, beyond, var, tileEnd));
+    _tacls->insert(inner.branch, makeTAC(TACOperationType::Add, stop, innerCond, beyond));
+    (*inner.branch)->b_ = stop;
+}
+
+void LoopNestOptimizer::optimize()
+{
+    for (auto it = _fbegin; it != _fend; ++it)
+    {
+        auto tac = *it;
+        if (tac->operation_ == TACOperationType::Parameter && tac->a_->value_.Type() == SymbolValue::ValueType::Array)
+        {
+            paramArrays.insert(tac->a_);
+            paramArrays.insert(tac->a_->value_.GetArrayDescriptor()->base_addr.lock());
+        }
+        if (tac->operation_ == TACOperationType::Goto || tac->operation_ == TACOperationType::IfZero)
+            ++labelRefs[tac->a_];
+    }
+
+    auto cfg = std::make_shared<ControlFlowGraph>(_fbegin, _fend);
+    LiveAnalyzer liveAnalyzer(cfg);
+    std::unordered_map<TACPtr, size_t> nodeOf;
+    for (size_t i = 0; i < cfg->get_nodes_number(); ++i)
+        nodeOf[cfg->get_node_tac(i)] = i;
+
+    for (auto it = _fbegin; it != _fend;)
+    {
+        Nest nest;
+        std::vector<Access> accesses;
+        if (!match(it, &nest))
+        {
+            ++it;
+            continue;
+        }
+        auto node = nodeOf.find(*std::prev(nest.end));
+        if (node == nodeOf.end() || !analyze(nest, liveAnalyzer.get_nodeLiveInfo(node->second).outLive, &accesses))
+        {
+            ++it;
+            continue;
+        }
+        it = nest.end;
+
+        // 内层变量系数绝对值大于1的是跨步访问，跨步访问更少的变量放在内层
+        int strided[2] = {0, 0};
+        for (auto &access : accesses)
+        {
+            for (int v = 0; v < 2; ++v)
+            {
+                if (access.affine && std::llabs(stride(access.subscript, v)) > 1)
+                    ++strided[v];
+            }
+        }
+        int innerIdx = strided[0] < strided[1] ? 0 : 1;
+        if (innerIdx == 0 && !match(interchange(nest), &nest))
+            continue;
+
+        // 内层跨步、外层相邻的访问，分块后每次载入的缓存行能在外层接下来的几次迭代中复用，块大小让这些缓存行留在L1中
+        std::vector<const Access *> reused;
+        for (auto &access : accesses)
+        {
+            if (!access.affine)
+                continue;
+            auto innerStride = std::llabs(stride(access.subscript, innerIdx));
+            auto outerStride = std::llabs(stride(access.subscript, 1 - innerIdx));
+            if (innerStride <= 1 || outerStride == 0 || outerStride * 4 >= CACHE_LINE_SIZE)
+                continue;
+            bool counted = false;
+            for (auto other : reused)
+                counted |= other->base == access.base && stride(other->subscript, 0) == stride(access.subscript, 0) && stride(other->subscript, 1) == stride(access.subscript, 1);
+            if (!counted)
+                reused.push_back(&access);
+        }
+        if (reused.empty() || nest.inner.step != 1)
+            continue;
+        int tileSize = _l1CacheSize / (2 * CACHE_LINE_SIZE * static_cast<int>(reused.size()));
+        if (tileSize < MIN_TILE_SIZE)
+            continue;
+
+        // 内层条件的结果必须是0或1；内层次数是不超过块大小的常数时不用分块
+        auto innerCond = (*nest.inner.branch)->b_;
+        bool boolean = false, small = false;
+        auto init = (*nest.inner.init)->b_;
+        for (auto c = std::next(nest.inner.condLabel); c != nest.inner.branch; ++c)
+        {
+            auto tac = *c;
+            if (tac->a_ == innerCond)
+                boolean = (tac->operation_ >= TACOperationType::Equal && tac->operation_ <= TACOperationType::GreaterOrEqual) || tac->operation_ == TACOperationType::UnaryNot;
+            if ((tac->operation_ == TACOperationType::LessThan || tac->operation_ == TACOperationType::LessOrEqual) && tac->b_ == nest.inner.var &&
+                tac->c_->IsLiteral() && init->IsLiteral())
+            {
+                long long trips = static_cast<long long>(tac->c_->value_.GetInt()) - init->value_.GetInt() + (tac->operation_ == TACOperationType::LessOrEqual);
+                small = trips <= tileSize;
+            }
+        }
+        if (boolean && !small)
+            tile(nest, tileSize);
+    }
+}
+
+bool LoopUnroller::match(TACList::iterator it, Loop *loop) const
+{
+    auto isDecl = [](const TACPtr &tac)
+    {
+        return tac->operation_ == TACOperationType::Variable || tac->operation_ == TACOperationType::Constant;
+    };
+    // 标量的运算、复制和转换
+    auto isScalarOp = [](TACOperationType op)
+    {
+        return (op > TACOperationType::Undefined && op < TACOperationType::LogicAnd) || (op >= TACOperationType::UnaryMinus && op <= TACOperationType::UnaryPositive) ||
+               op == TACOperationType::Assign || op == TACOperationType::FloatToInt || op == TACOperationType::IntToFloat;
+    };
+    auto isArray = [](const SymbolPtr &sym)
+    {
+        return sym && sym->value_.Type() == SymbolValue::ValueType::Array;
+    };
+
+    if ((*it)->operation_ != TACOperationType::Goto)
+        return false;
+    loop->jump = it;
+    auto condLabel = (*it)->a_;
+    loop->head = ++it;
+    if (it == _fend || (*it)->operation_ != TACOperationType::Label)
+        return false;
+    auto head = (*it)->a_;
+
+    // 循环体只有标量运算和数组元素的读写
+    auto bodyBegin = ++it;
+    loop->size = 0;
+    for (; it != _fend && (*it)->operation_ != TACOperationType::Label; ++it)
+    {
+        if (isDecl(*it))
+        {
+            if (isArray((*it)->a_))
+                return false;
+            continue;
+        }
+        if (!isScalarOp((*it)->operation_))
+            return false;
+        ++loop->size;
+    }
+    if (it == _fend || (*it)->a_ != condLabel)
+        return false;
+    loop->condLabel = it;
+
+    // 条件只有标量运算，最后两条是比较和取反
+    std::vector<TACList::iterator> conds;
+    for (++it; it != _fend && (*it)->operation_ != TACOperationType::IfZero; ++it)
+    {
+        auto tac = *it;
+        if (isDecl(tac) && !isArray(tac->a_))
+            continue;
+        if (!isScalarOp(tac->operation_) || isArray(tac->a_) || isArray(tac->b_) || isArray(tac->c_))
+            return false;
+        conds.push_back(it);
+    }
+    if (it == _fend || (*it)->a_ != head || conds.size() < 2)
+        return false;
+    loop->branch = it;
+    loop->compare = conds[conds.size() - 2];
+    auto cmp = *loop->compare, neg = *conds.back();
+    if (neg->operation_ != TACOperationType::UnaryNot || neg->b_ != cmp->a_ || (*it)->b_ != neg->a_ ||
+        cmp->operation_ < TACOperationType::Equal || cmp->operation_ > TACOperationType::GreaterOrEqual)
+        return false;
+    conds.resize(conds.size() - 2);
+    loop->boundDefs = conds;
+
+    // 比较的一边是循环变量，bound在另一边时把比较反过来
+    auto isLocalInt = [](const SymbolPtr &sym)
+    {
+        return !sym->IsLiteral() && !sym->IsGlobal() && sym->value_.Type() == SymbolValue::ValueType::Int;
+    };
+    if (isLocalInt(cmp->b_) && matchIncrement(bodyBegin, loop->condLabel, cmp->b_, &loop->incBegin, &loop->step))
+    {
+        loop->var = cmp->b_;
+        loop->bound = cmp->c_;
+        loop->rel = cmp->operation_;
+    }
+    else if (isLocalInt(cmp->c_) && matchIncrement(bodyBegin, loop->condLabel, cmp->c_, &loop->incBegin, &loop->step))
+    {
+        loop->var = cmp->c_;
+        loop->bound = cmp->b_;
+        switch (cmp->operation_)
+        {
+        case TACOperationType::LessThan:
+            loop->rel = TACOperationType::GreaterThan;
+            break;
+        case TACOperationType::LessOrEqual:
+            loop->rel = TACOperationType::GreaterOrEqual;
+            break;
+        case TACOperationType::GreaterThan:
+            loop->rel = TACOperationType::LessThan;
+            break;
+        case TACOperationType::GreaterOrEqual:
+            loop->rel = TACOperationType::LessOrEqual;
+            break;
+        default:
+            loop->rel = cmp->operation_;
+            break;
+        }
+    }
+    else
+        return false;
+    if (loop->bound->value_.Type() != SymbolValue::ValueType::Int)
+        return false;
+
+    // 循环变量只在增量中定值，bound只依赖循环中不变的量
+    std::unordered_set<SymbolPtr> bodyDefs;
+    for (auto it = bodyBegin; it != loop->condLabel; ++it)
+    {
+        if (isDecl(*it))
+            continue;
+        auto defSym = (*it)->getDefineSym();
+        if (defSym == loop->var && it != std::prev(loop->condLabel))
+            return false;
+        if (defSym)
+            bodyDefs.insert(defSym);
+    }
+    std::unordered_set<SymbolPtr> boundSyms;
+    auto invariant = [&](const SymbolPtr &sym)
+    {
+        return !sym || sym->IsLiteral() || boundSyms.count(sym) || (sym != loop->var && !bodyDefs.count(sym));
+    };
+    for (auto def : loop->boundDefs)
+    {
+        if ((*def)->a_ == loop->var || !invariant((*def)->b_) || !invariant((*def)->c_))
+            return false;
+        boundSyms.insert((*def)->a_);
+    }
+    if (!invariant(loop->bound))
+        return false;
+
+    // 入口的goto所在的基本块中，最后一次给var定值是 var = 常数
+    loop->initKnown = false;
+    for (auto prev = loop->jump; prev != _fbegin;)
+    {
+        auto tac = *--prev;
+        auto op = tac->operation_;
+        if (op == TACOperationType::Label || op == TACOperationType::Goto || op == TACOperationType::IfZero || op == TACOperationType::FunctionBegin)
+            break;
+        if (tac->a_ != loop->var || isDecl(tac))
+            continue;
+        if (op == TACOperationType::Assign && tac->b_->IsLiteral() && tac->b_->value_.Type() == SymbolValue::ValueType::Int)
+        {
+            loop->initKnown = true;
+            loop->init = tac->b_->value_.GetInt();
+        }
+        break;
+    }
+
+    // 除了循环本身的跳转，没有别的代码跳进循环
+    auto refs = [this](const SymbolPtr &label)
+    {
+        auto ref = labelRefs.find(label);
+        return ref == labelRefs.end() ? 0 : ref->second;
+    };
+    return refs(head) == 1 && refs(condLabel) == 1;
+}
+
+int LoopUnroller::tripCount(const Loop &loop, int limit)
+{
+    if (!loop.initKnown || !loop.bound->IsLiteral())
+        return -1;
+    long long value = loop.init, bound = loop.bound->value_.GetInt();
+    auto holds = [&]()
+    {
+        switch (loop.rel)
+        {
+        case TACOperationType::Equal:
+            return value == bound;
+        case TACOperationType::NotEqual:
+            return value != bound;
+        case TACOperationType::LessThan:
+            return value < bound;
+        case TACOperationType::LessOrEqual:
+            return value <= bound;
+        case TACOperationType::GreaterThan:
+            return value > bound;
+        default:
+            return value >= bound;
+        }
+    };
+    int count = 0;
+    while (holds())
+    {
+        if (++count > limit)
+            return -1;
+        value += loop.step;
+        if (value < INT_MIN || value > INT_MAX)
+            return -1;
+    }
+    return count;
+}
+
+void LoopUnroller::copyBody(const Loop &loop, TACList::iterator pos, const std::string &suffix, const int *value)
+{
+    auto bodyBegin = std::next(loop.head);
+    auto isDecl = [](const TACPtr &tac)
+    {
+        return tac->operation_ == TACOperationType::Variable || tac->operation_ == TACOperationType::Constant;
+    };
+    std::unordered_map<SymbolPtr, int> defCount;
+    for (auto it = bodyBegin; it != loop.condLabel; ++it)
+    {
+        if (!isDecl(*it) && (*it)->a_->value_.Type() != SymbolValue::ValueType::Array)
+            ++defCount[(*it)->a_];
+    }
+
+    // 循环体中声明的变量换成新的；已知是常数的int变量(只定值一次)
+    std::unordered_map<SymbolPtr, SymbolPtr> renamed;
+    std::unordered_map<SymbolPtr, int> known;
+    if (value)
+        known[loop.var] = *value;
+    auto substituteScalar = [&](const SymbolPtr &sym, bool fold)
+    {
+        auto rename = renamed.find(sym);
+        auto cur = rename == renamed.end() ? sym : rename->second;
+        if (fold)
+        {
+            if (auto k = known.find(cur); k != known.end())
+                return intLiteral(k->second);
+        }
+        return cur;
+    };
+    // 数组元素换掉下标，下标总是可以代入常数
+    auto substitute = [&](const SymbolPtr &sym, bool fold)
+    {
+        if (!sym || sym->IsLiteral())
+            return sym;
+        if (sym->value_.Type() != SymbolValue::ValueType::Array)
+            return substituteScalar(sym, fold);
+        auto arrayDescriptor = sym->value_.GetArrayDescriptor();
+        if (sym == arrayDescriptor->base_addr.lock())
+            return sym;
+        auto offset = substituteScalar(arrayDescriptor->base_offset, true);
+        if (offset == arrayDescriptor->base_offset)
+            return sym;
+        auto ad = std::make_shared<ArrayDescriptor>(*arrayDescriptor);
+        ad->base_offset = offset;
+        auto arr = std::make_shared<Symbol>(*sym);
+        arr->value_ = SymbolValue(ad);
+        return arr;
+    };
+
+    for (auto it = bodyBegin; it != loop.condLabel; ++it)
+    {
+        auto tac = std::make_shared<ThreeAddressCode::ThreeAddressCode>(**it);
+        if (isDecl(tac))
+        {
+            auto sym = std::make_shared<Symbol>(*tac->a_);
+            sym->name_ = tac->a_->get_tac_name(true) + "_LU" + suffix;
+            renamed[tac->a_] = sym;
+            tac->a_ = sym;
+            _tacls->insert(pos, tac);
+            continue;
+        }
+        // 只在结果是int的运算和复制中代入常数，两边都是常数时折叠成赋值
+        auto op = tac->operation_;
+        bool arith = op >= TACOperationType::Add && op <= TACOperationType::GreaterOrEqual;
+        bool unary = op >= TACOperationType::UnaryMinus && op <= TACOperationType::UnaryPositive;
+        bool fold = value && (op == TACOperationType::Assign ? tac->b_->value_.Type() == SymbolValue::ValueType::Int
+                                                             : (arith || unary) && tac->a_->value_.Type() == SymbolValue::ValueType::Int);
+        auto b = substitute(tac->b_, fold), c = substitute(tac->c_, fold);
+        int result;
+        if (fold && arith && b->IsLiteral() && c->IsLiteral() && b->value_.Type() == SymbolValue::ValueType::Int && c->value_.Type() == SymbolValue::ValueType::Int)
+        {
+            if (foldInt(op, b->value_.GetInt(), c->value_.GetInt(), &result))
+            {
+                tac->operation_ = TACOperationType::Assign;
+                b = intLiteral(result);
+                c = nullptr;
+            }
+            else
+            {
+                b = substitute(tac->b_, false);
+                c = substitute(tac->c_, false);
+            }
+        }
+        else if (fold && unary && b->IsLiteral() && b->value_.Type() == SymbolValue::ValueType::Int && foldInt(op, b->value_.GetInt(), 0, &result))
+        {
+            tac->operation_ = TACOperationType::Assign;
+            b = intLiteral(result);
+        }
+        tac->b_ = b;
+        tac->c_ = c;
+        auto defSym = tac->a_;
+        tac->a_ = substitute(defSym, false);
+        if (tac->operation_ == TACOperationType::Assign && renamed.count(defSym) && defCount[defSym] == 1 && tac->b_->IsLiteral() &&
+            tac->b_->value_.Type() == SymbolValue::ValueType::Int)
+            known[tac->a_] = tac->b_->value_.GetInt();
+        _tacls->insert(pos, tac);
+    }
+}
+
+void LoopUnroller::unrollFully(const Loop &loop, int trips)
+{
+    auto suffix = std::to_string(unrollCount++);
+    long long value = loop.init;
+    for (int k = 0; k < trips; ++k, value += loop.step)
+    {
+        int v = static_cast<int>(value);
+        copyBody(loop, loop.jump, suffix + "_" + std::to_string(k), &v);
+    }
+    // 去掉跳转和原来的循环体，条件的计算留给死代码删除；没有被跳转到的出口标号也去掉，外层循环可以接着展开
+    auto exit = std::next(loop.branch);
+    if (exit != _fend && (*exit)->operation_ == TACOperationType::Label && !labelRefs.count((*exit)->a_))
+        _tacls->erase(exit);
+    _tacls->erase(loop.branch);
+    for (auto it = loop.jump, end = std::next(loop.condLabel); it != end;)
+        _tacls->erase(it++);
+}
+
+bool LoopUnroller::unroll(const Loop &loop, int times)
+{
+    long long adjust = static_cast<long long>(times - 1) * loop.step;
+    if (adjust < INT_MIN || adjust > INT_MAX)
+        return false;
+    SymbolPtr limit;
+    if (loop.bound->IsLiteral())
+    {
+        long long bound = loop.bound->value_.GetInt() - adjust;
+        if (bound < INT_MIN || bound > INT_MAX)
+            return false;
+        limit = intLiteral(static_cast<int>(bound));
+    }
+
+    auto suffix = std::to_string(unrollCount++);
+    auto makeTAC = [](TACOperationType op, SymbolPtr a, SymbolPtr b, SymbolPtr c)
+    {
+        auto tac = std::make_shared<ThreeAddressCode::ThreeAddressCode>();
+        tac->operation_ = op;
+        tac->a_ = a;
+        tac->b_ = b;
+        tac->c_ = c;
+        return tac;
+    };
+    auto makeVar = [&](const std::string &prefix, const SymbolPtr &from)
+    {
+        auto sym = std::make_shared<Symbol>(*from);
+        sym->name_ = prefix + from->get_tac_name(true) + "_" + suffix;
+        _tacls->insert(loop.jump, makeTAC(TACOperationType::Variable, sym, nullptr, nullptr));
+        return sym;
+    };
+    auto makeLabel = [&](const std::string &name)
+    {
+        auto label = std::make_shared<Symbol>();
+        label->type_ = SymbolType::Label;
+        label->name_ = (*_fbegin)->a_->get_tac_name(true) + "_LU" + suffix + name;
+        label->offset_ = 0;
+        return label;
+    };
+
+    // 循环之前算出 bound - (times - 1) * step，var不超过它时还能完整地执行一轮
+    if (!limit)
+    {
+        std::unordered_map<SymbolPtr, SymbolPtr> renamed;
+        auto rename = [&renamed](const SymbolPtr &sym)
+        {
+            auto it = renamed.find(sym);
+            return it == renamed.end() ? sym : it->second;
+        };
+        for (auto def : loop.boundDefs)
+        {
+            auto tac = std::make_shared<ThreeAddressCode::ThreeAddressCode>(**def);
+            tac->b_ = rename(tac->b_);
+            tac->c_ = rename(tac->c_);
+            tac->a_ = renamed[tac->a_] = makeVar("LUB_", tac->a_);
+            _tacls->insert(loop.jump, tac);
+        }
+        // bound - (times - 1) * step会溢出时跳过展开的循环，直接执行原来的循环
+        auto edge = intLiteral(static_cast<int>(adjust > 0 ? INT_MIN + adjust : INT_MAX + adjust));
+        auto inRange = makeVar("LUO_", (*loop.compare)->a_);
+        _tacls->insert(loop.jump, makeTAC(adjust > 0 ? TACOperationType::GreaterOrEqual : TACOperationType::LessOrEqual, inRange, rename(loop.bound), edge));
+        _tacls->insert(loop.jump, makeTAC(TACOperationType::IfZero, (*loop.condLabel)->a_, inRange, nullptr));
+        ++labelRefs[(*loop.condLabel)->a_];
+        limit = makeVar("LUL_", loop.var);
+        _tacls->insert(loop.jump, makeTAC(TACOperationType::Sub, limit, rename(loop.bound), intLiteral(static_cast<int>(adjust))));
+    }
+    auto cmp = makeVar("LUT_", (*loop.compare)->a_), neg = makeVar("LUN_", (*loop.compare)->a_);
+    auto head = makeLabel("H"), cond = makeLabel("C");
+
+    _tacls->insert(loop.jump, makeTAC(TACOperationType::Goto, cond, nullptr, nullptr));
+    _tacls->insert(loop.jump, makeTAC(TACOperationType::Label, head, nullptr, nullptr));
+    for (int k = 0; k < times; ++k)
+        copyBody(loop, loop.jump, suffix + "_" + std::to_string(k), nullptr);
+    _tacls->insert(loop.jump, makeTAC(TACOperationType::Label, cond, nullptr, nullptr));
+    _tacls->insert(loop.jump, makeTAC(loop.rel, cmp, loop.var, limit));
+    _tacls->insert(loop.jump, makeTAC(TACOperationType::UnaryNot, neg, cmp, nullptr));
+    _tacls->insert(loop.jump, makeTAC(TACOperationType::IfZero, head, neg, nullptr));
+    return true;
+}
+
+void LoopUnroller::optimize()
+{
+    for (auto it = _fbegin; it != _fend; ++it)
+    {
+        if ((*it)->operation_ == TACOperationType::Goto || (*it)->operation_ == TACOperationType::IfZero)
+            ++labelRefs[(*it)->a_];
+    }
+
+    // 先完全展开，展开后外层循环可能成为最内层，每次展开后从头再找
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (auto it = _fbegin; it != _fend; ++it)
+        {
+            Loop loop;
+            if (!match(it, &loop))
+                continue;
+            int trips = tripCount(loop, _maxInsns / loop.size);
+            if (trips > 0)
+            {
+                unrollFully(loop, trips);
+                changed = true;
+                break;
+            }
+        }
+    }
+
+    // 其余的循环部分展开
+    for (auto it = _fbegin; it != _fend;)
+    {
+        Loop loop;
+        if (!match(it, &loop))
+        {
+            ++it;
+            continue;
+        }
+        it = std::next(loop.branch);
+        // 只处理单调趋向界的循环；次数已知且不足一轮时展开的循环不会执行
+        int times = std::min(_maxTimes, _maxInsns / loop.size);
+        bool increasing = loop.rel == TACOperationType::LessThan || loop.rel == TACOperationType::LessOrEqual;
+        bool decreasing = loop.rel == TACOperationType::GreaterThan || loop.rel == TACOperationType::GreaterOrEqual;
+        if (times < 2 || !((increasing && loop.step > 0) || (decreasing && loop.step < 0)) || tripCount(loop, times - 1) >= 0)
+            continue;
+        unroll(loop, times);
+    }
+}
+
 }
 }
\ No newline at end of file
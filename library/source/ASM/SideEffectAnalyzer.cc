@@ -0,0 +1,204 @@
+#include "ASM/SideEffectAnalyzer.hh"
+#include <unordered_set>
+#include "TAC/Symbol.hh"
+
+namespace HaveFunCompiler{
+namespace AssemblyBuilder{
+
+using namespace ThreeAddressCode;
+
+namespace
+{
+// 库函数(输入输出、计时)的摘要：getarray等会读写数组实参
+FunctionSummary librarySummary()
+{
+    FunctionSummary library;
+    library.io = true;
+    library.readParamArray = true;
+    library.writeParamArray = true;
+    return library;
+}
+}
+
+SideEffectAnalyzer::SideEffectAnalyzer(TACListPtr tacList)
+{
+    // 标号后紧跟FunctionBegin为函数开头
+    TACList::iterator fbegin = tacList->end();
+    for (auto it = tacList->begin(); it != tacList->end(); ++it)
+    {
+        auto op = (*it)->operation_;
+        if (op == TACOperationType::FunctionBegin && it != tacList->begin() && (*std::prev(it))->operation_ == TACOperationType::Label)
+            fbegin = std::prev(it);
+        else if (op == TACOperationType::FunctionEnd && fbegin != tacList->end())
+        {
+            scanFunction(fbegin, std::next(it));
+            fbegin = tacList->end();
+        }
+    }
+    propagate();
+}
+
+const FunctionSummary *SideEffectAnalyzer::get_summary(const std::string &funcName) const
+{
+    auto it = summaries.find(funcName);
+    if (it == summaries.end())
+        return nullptr;
+    return &it->second;
+}
+
+FunctionSummary SideEffectAnalyzer::get_callSummary(TACPtr call) const
+{
+    auto summary = get_summary(call->b_->get_tac_name(true));
+    if (summary)
+        return *summary;
+    return librarySummary();
+}
+
+bool SideEffectAnalyzer::isRecursive(const std::string &funcName) const
+{
+    std::unordered_set<std::string> visited;
+    std::vector<std::string> stack = {funcName};
+    while (!stack.empty())
+    {
+        auto it = callSites.find(stack.back());
+        stack.pop_back();
+        if (it == callSites.end())
+            continue;
+        for (auto &site : it->second)
+        {
+            if (site.callee == funcName)
+                return true;
+            if (visited.insert(site.callee).second)
+                stack.push_back(site.callee);
+        }
+    }
+    return false;
+}
+
+void SideEffectAnalyzer::scanFunction(TACList::iterator fbegin, TACList::iterator fend)
+{
+    auto name = (*fbegin)->a_->get_tac_name(true);
+    auto &summary = summaries[name];
+    auto &sites = callSites[name];
+
+    // 数组形参，访问时数组描述符的base_addr指向它们
+    std::unordered_set<SymbolPtr> paramBases;
+    auto classify = [&paramBases](const SymbolPtr &arr)
+    {
+        auto base = arr->value_.GetArrayDescriptor()->base_addr.lock();
+        if (base->IsGlobal())
+            return ArrayClass::Global;
+        if (paramBases.count(base))
+            return ArrayClass::Param;
+        return ArrayClass::Local;
+    };
+    auto access = [&summary, &classify](const SymbolPtr &arr, bool write)
+    {
+        switch (classify(arr))
+        {
+        case ArrayClass::Global:
+            (write ? summary.writeGlobal : summary.readGlobal) = true;
+            break;
+        case ArrayClass::Param:
+            (write ? summary.writeParamArray : summary.readParamArray) = true;
+            break;
+        default:
+            break;
+        }
+    };
+    auto isGlobalVar = [](const SymbolPtr &sym)
+    {
+        return sym && sym->type_ == SymbolType::Variable && sym->IsGlobal();
+    };
+
+    std::vector<ArrayClass> arrayArgs;
+    for (auto it = fbegin; it != fend; ++it)
+    {
+        auto tac = *it;
+        switch (tac->operation_)
+        {
+        case TACOperationType::Parameter:
+            if (tac->a_->value_.Type() == SymbolValue::ValueType::Array)
+            {
+                paramBases.insert(tac->a_);
+                paramBases.insert(tac->a_->value_.GetArrayDescriptor()->base_addr.lock());
+            }
+            continue;
+        case TACOperationType::Variable:
+        case TACOperationType::Constant:
+            continue;
+        case TACOperationType::ArgumentAddress:
+            arrayArgs.push_back(classify(tac->a_));
+            if (isGlobalVar(tac->a_->value_.GetArrayDescriptor()->base_offset))
+                summary.readGlobal = true;
+            continue;
+        case TACOperationType::Call:
+            sites.push_back({tac->b_->get_tac_name(true), arrayArgs});
+            arrayArgs.clear();
+            break;
+        default:
+            break;
+        }
+
+        auto defSym = tac->getDefineSym();
+        for (auto sym : {tac->a_, tac->b_, tac->c_})
+        {
+            if (!sym)
+                continue;
+            if (sym->value_.Type() == SymbolValue::ValueType::Array)
+            {
+                // 只有赋值的左边是写数组元素
+                access(sym, tac->operation_ == TACOperationType::Assign && sym == tac->a_);
+                if (isGlobalVar(sym->value_.GetArrayDescriptor()->base_offset))
+                    summary.readGlobal = true;
+            }
+            else if (isGlobalVar(sym))
+                (sym == defSym ? summary.writeGlobal : summary.readGlobal) = true;
+        }
+    }
+}
+
+void SideEffectAnalyzer::propagate()
+{
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (auto &[name, sites] : callSites)
+        {
+            auto summary = summaries[name];
+            for (auto &site : sites)
+            {
+                auto it = summaries.find(site.callee);
+                auto callee = it == summaries.end() ? librarySummary() : it->second;
+                summary.readGlobal |= callee.readGlobal;
+                summary.writeGlobal |= callee.writeGlobal;
+                summary.io |= callee.io;
+                // 被调函数通过数组形参的读写，落到实参数组的来源上
+                for (auto arrayClass : site.arrayArgs)
+                {
+                    if (arrayClass == ArrayClass::Global)
+                    {
+                        summary.readGlobal |= callee.readParamArray;
+                        summary.writeGlobal |= callee.writeParamArray;
+                    }
+                    else if (arrayClass == ArrayClass::Param)
+                    {
+                        summary.readParamArray |= callee.readParamArray;
+                        summary.writeParamArray |= callee.writeParamArray;
+                    }
+                }
+            }
+            auto &old = summaries[name];
+            if (summary.readGlobal != old.readGlobal || summary.writeGlobal != old.writeGlobal || summary.io != old.io ||
+                summary.readParamArray != old.readParamArray || summary.writeParamArray != old.writeParamArray)
+            {
+                old = summary;
+                changed = true;
+            }
+        }
+    }
+}
+
+}
+}
\ No newline at end of file
@@ -1,23 +1,35 @@
 #include "ASM/arm/ArmBuilder.hh"
 #include <algorithm>
+#include <climits>
 #include <iostream>
 #include <memory>
+#include <unordered_map>
 #include <vector>
 #include "ASM/ControlFlowGraph.hh"
 #include "ASM/LiveAnalyzer.hh"
 #include "ASM/Optimizer.hh"
+#include "ASM/SideEffectAnalyzer.hh"
 #include "ASM/arm/ArmHelper.hh"
+#include "ASM/arm/ArmInst.hh"
+#include "ASM/arm/InstructionSelector.hh"
+#include "ASM/arm/LiteralPoolManager.hh"
+#include "ASM/arm/PeepholeOptimizer.hh"
 #include "ASM/arm/RegAllocator.hh"
 #include "MacroUtil.hh"
 #include "MagicEnum.hh"
 #include "TAC/TAC.hh"
 
 extern int OP_flag;
+extern int MEMO_flag;
+extern int STATIC_flag;
+extern int L1_CACHE_SIZE;
+extern int MAX_UNROLL_TIMES;
+extern int MAX_UNROLLED_INSNS;
 
 namespace HaveFunCompiler {
 namespace AssemblyBuilder {
 using namespace ThreeAddressCode;
-ArmBuilder::ArmBuilder(TACListPtr tac_list) : data_pool_distance_(0), data_pool_id_(0), tac_list_(tac_list),counter(0) {}
+ArmBuilder::ArmBuilder(TACListPtr tac_list) : tac_list_(tac_list),counter(0) {}
 
 bool ArmBuilder::AppendPrefix() {
   std::string *pfunc_section;
@@ -30,15 +42,44 @@ bool ArmBuilder::AppendPrefix() {
   emitln(".text");
   emitln(".align 4");
   // emitln(".global _builtin_clear");
+  // r0为首地址，r1为字数。每轮用stm清零8个字，不足8个的尾部按r1的低3位分别清零4、2、1个字
   emitln("_builtin_clear:");
+  emitln("push {lr}");
   emitln("mov r2, #0");
-  emitln("cmp r1, #0");
-  emitln("ble _builtin_clear_break");
+  emitln("mov r3, #0");
+  emitln("mov ip, #0");
+  emitln("mov lr, #0");
+  emitln("subs r1, r1, #8");
+  emitln("blt _builtin_clear_tail");
   emitln("_builtin_clear_loop:");
-  emitln("str r2, [r0], #+4");
-  emitln("subs r1, #1");
-  emitln("bgt _builtin_clear_loop");
-  emitln("_builtin_clear_break:");
+  emitln("stmia r0!, {r2, r3, ip, lr}");
+  emitln("stmia r0!, {r2, r3, ip, lr}");
+  emitln("subs r1, r1, #8");
+  emitln("bge _builtin_clear_loop");
+  emitln("_builtin_clear_tail:");
+  //此时r1为剩余字数减8，低3位就是剩余字数
+  emitln("tst r1, #4");
+  emitln("stmiane r0!, {r2, r3, ip, lr}");
+  emitln("tst r1, #2");
+  emitln("stmiane r0!, {r2, r3}");
+  emitln("tst r1, #1");
+  emitln("strne r2, [r0]");
+  emitln("pop {pc}");
+
+  //局部数组初始化时从模板复制初值，r0为目标地址，r1为模板地址，r2为元素个数
+  func_sections_.emplace_back("_builtin_copy");
+  pfunc_section = &func_sections_.back().body_;
+  emitln(".text");
+  emitln(".align 4");
+  emitln("_builtin_copy:");
+  emitln("cmp r2, #0");
+  emitln("ble _builtin_copy_break");
+  emitln("_builtin_copy_loop:");
+  emitln("ldr r3, [r1], #+4");
+  emitln("str r3, [r0], #+4");
+  emitln("subs r2, #1");
+  emitln("bgt _builtin_copy_loop");
+  emitln("_builtin_copy_break:");
   emitln("bx lr");
 
   auto forward_declare = [&, this](std::string func_name) -> void {
@@ -72,6 +113,7 @@ bool ArmBuilder::TranslateGlobal() {
   current_ = tac_list_->begin();
   end_ = tac_list_->end();
   int func_level = 0;
+  CollectStaticInit();
   //第一遍进行变量地址分配
   try {
     for (; current_ != end_; ++current_) {
@@ -106,10 +148,10 @@ bool ArmBuilder::TranslateGlobal() {
             //一定没有全局临时常量
             if (tac->a_->IsGlobalTemp()) {
               throw std::logic_error("Illegal global temporary constant");
-            } else if (tac->a_->name_.value_or("").length() > 3 && tac->a_->name_.value()[2] == 'U') {
-              //对于非临时变量，进行存储声明
+            } else if (auto name = tac->a_->name_.value_or("");
+                       name.length() > 3 && (name[2] == 'U' || name.compare(2, 2, "ST") == 0)) {
+              //对于非临时变量和局部数组的初始化模板，进行存储声明
               data_section_ += DeclareDataToASMString(tac);
-              AddDataRef(tac);
             }
           }
           break;
@@ -140,7 +182,6 @@ bool ArmBuilder::TranslateGlobal() {
               glob_context_.stack_size_for_vars_ += 4;
             } else if (tac->a_->name_.value_or("").length() > 3 && tac->a_->name_.value()[2] == 'U') {
               data_section_ += DeclareDataToASMString(tac);
-              AddDataRef(tac);
             }
           }
           break;
@@ -162,13 +203,9 @@ bool ArmBuilder::TranslateGlobal() {
   //绑定到body，后面简写
   auto *pfunc_section = &func_sections_.back().body_;
   auto emit = [pfunc_section, this](const std::string &inst) -> void { (*pfunc_section) += inst; };
-  auto emitln = [pfunc_section, this](const std::string &inst) -> void {
+  auto emitln = [pfunc_section](const std::string &inst) -> void {
     pfunc_section->append(inst);
     pfunc_section->append("\n");
-    data_pool_distance_ += ArmHelper::CountLines(inst) + 1;
-    if (data_pool_distance_ > DATA_POOL_DISTANCE_THRESHOLD) {
-      (*pfunc_section) += EndCurrentDataPool();
-    }
   };
 
   emitln(".text");
@@ -176,46 +213,57 @@ bool ArmBuilder::TranslateGlobal() {
   emitln(".global main");
   emitln("main:");
 
-  emitln("push {r4-r12, lr}");
-  emitln("vpush {s16-s31}");
-  glob_context_.stack_size_for_regsave_ = 10 * 4 + 16 * 4;
-  if (!ArmHelper::EmitImmediateInstWithCheck(emitln, "sub", "sp", "sp", glob_context_.stack_size_for_vars_)) {
-    emitln("ldr ip, =" + std::to_string(glob_context_.stack_size_for_vars_));
-    emitln("sub sp, sp, ip");
+  //编译期求值之后剩下的全局初始化代码
+  std::vector<TACPtr> init_tacs;
+  bool has_init_code = false;
+  for (; current_ != end_; ++current_) {
+    auto tac = *current_;
+    switch (tac->operation_) {
+      case TACOperationType::FunctionBegin:
+        func_level++;
+        break;
+      case TACOperationType::FunctionEnd:
+        func_level--;
+        break;
+      case TACOperationType::Constant:
+        break;
+      case TACOperationType::Variable:
+        break;
+      default:
+        if (!func_level && !static_init_tacs_.count(tac.get())) {
+          init_tacs.push_back(tac);
+          has_init_code |= tac->operation_ != TACOperationType::Label;
+        }
+        break;
+    }
   }
 
-  try {
-    for (; current_ != end_; ++current_) {
-      auto tac = *current_;
-      switch (tac->operation_) {
-        case TACOperationType::FunctionBegin:
-          func_level++;
-          break;
-        case TACOperationType::FunctionEnd:
-          func_level--;
-          break;
-        case TACOperationType::Constant:
-          break;
-        case TACOperationType::Variable:
-          break;
-        default:
-          if (!func_level) {
-            emit(GlobalTACToASMString(tac));
-          }
-          break;
+  //全部初始化都放进了数据段时，不需要保存寄存器
+  if (has_init_code) {
+    emitln("push {r4-r12, lr}");
+    emitln("vpush {s16-s31}");
+    glob_context_.stack_size_for_regsave_ = 10 * 4 + 16 * 4;
+    if (!ArmHelper::EmitImmediateInstWithCheck(emitln, "sub", "sp", "sp", glob_context_.stack_size_for_vars_)) {
+      ArmHelper::EmitLoadImmediate(emitln, "ip", glob_context_.stack_size_for_vars_);
+      emitln("sub sp, sp, ip");
+    }
+
+    try {
+      for (auto &tac : init_tacs) {
+        emit(GlobalTACToASMString(tac));
       }
+    } catch (std::exception &e) {
+      std::cerr << e.what() << std::endl;
+      return false;
     }
-  } catch (std::exception &e) {
-    std::cerr << e.what() << std::endl;
-    return false;
-  }
-  if (!ArmHelper::EmitImmediateInstWithCheck(emitln, "add", "sp", "sp", glob_context_.stack_size_for_vars_)) {
-    emitln("ldr ip, =" + std::to_string(glob_context_.stack_size_for_vars_));
-    emitln("add sp, sp, ip");
+    if (!ArmHelper::EmitImmediateInstWithCheck(emitln, "add", "sp", "sp", glob_context_.stack_size_for_vars_)) {
+      ArmHelper::EmitLoadImmediate(emitln, "ip", glob_context_.stack_size_for_vars_);
+      emitln("add sp, sp, ip");
+    }
+    emitln("vpop {s16-s31}");
+    emitln("pop {r4-r12 ,lr}");
   }
   glob_context_.stack_size_for_vars_ = 0;
-  emitln("vpop {s16-s31}");
-  emitln("pop {r4-r12 ,lr}");
   glob_context_.stack_size_for_regsave_ = 0;
   emitln("push {lr}");
   emitln("sub sp, sp, #4");
@@ -231,11 +279,39 @@ bool ArmBuilder::TranslateFunction() {
   //[current_,end_)区间内为即将处理的函数
   //拿到func_context_guard确保func_context拥有正确初始化和析构行为
   auto func_context_guard = ArmUtil::FunctionContextGuard(func_context_);
+  bool leaf = false;
   {
     if (OP_flag)
     {
-      // 目前只进行死代码删除优化
-      DeadCodeOptimizer optimizer(tac_list_, current_, end_);
+      // 自身尾调用改为循环
+      TailRecursionEliminator eliminator(tac_list_, current_, end_, side_effect_.get());
+      eliminator.optimize();
+
+      // 全局标量提升到局部变量，之后的死代码删除可以去掉多余的读入
+      GlobalScalarPromoter promoter(tac_list_, current_, end_, side_effect_.get());
+      promoter.optimize();
+
+      // 常量下标读取全局常量数组时直接换成初值
+      ConstArrayFolder folder(tac_list_, current_, end_, &const_arrays_);
+      folder.optimize();
+
+      // 只用常量下标访问的小局部数组拆成标量
+      ArrayScalarizer scalarizer(tac_list_, current_, end_, &const_arrays_);
+      scalarizer.optimize();
+
+      // 两层完美嵌套循环的交换和分块
+      LoopNestOptimizer nestOptimizer(tac_list_, current_, end_, L1_CACHE_SIZE * 1024);
+      nestOptimizer.optimize();
+
+      // 最内层计数循环的完全展开和部分展开
+      LoopUnroller unroller(tac_list_, current_, end_, MAX_UNROLL_TIMES, MAX_UNROLLED_INSNS);
+      unroller.optimize();
+
+      // 基本块内数组元素的读写转发和冗余写入删除
+      ArrayAccessOptimizer accessOptimizer(tac_list_, current_, end_, side_effect_.get());
+      accessOptimizer.optimize();
+
+      DeadCodeOptimizer optimizer(tac_list_, current_, end_, side_effect_.get());
       optimizer.optimize();
     }
 
@@ -246,8 +322,30 @@ bool ArmBuilder::TranslateFunction() {
     auto &deadCode = cfg->get_unreachableTACItrList();
     for (auto it : deadCode) tac_list_->erase(it);
 
-    // 解析寄存器分配
-    func_context_.reg_alloc_ = new RegAllocator(LiveAnalyzer(cfg));
+    // 解析寄存器分配，叶函数优先使用不需要保存的寄存器
+    LiveAnalyzer live_analyzer(cfg);
+    leaf = OP_flag && IsLeafFunction();
+    func_context_.reg_alloc_ = new RegAllocator(live_analyzer, leaf, &static_arrays_);
+
+    //记录调用点之后活跃的变量
+    for (size_t i = 0; i < cfg->get_nodes_number(); i++) {
+      auto tac = cfg->get_node_tac(i);
+      if (tac->operation_ != TACOperationType::Call) {
+        continue;
+      }
+      auto &live_out = func_context_.call_live_out_[tac.get()];
+      for (auto &sym : live_analyzer.get_nodeLiveInfo(i).outLive) {
+        if (sym != tac->a_) {
+          live_out.push_back(sym);
+        }
+      }
+    }
+
+    if (OP_flag) {
+      //在基本块内匹配可以合并的指令模式
+      func_context_.selector_ = new InstructionSelector(current_, end_, func_context_.reg_alloc_);
+      func_context_.selector_->select();
+    }
   }
   //开头label包含了函数名
   auto func_label = (*current_)->a_;
@@ -257,21 +355,29 @@ bool ArmBuilder::TranslateFunction() {
   //绑定到body，后面简写
   auto *pfunc_section = &func_sections_.back().body_;
   auto emit = [pfunc_section, this](const std::string &inst) -> void { (*pfunc_section) += inst; };
-  auto emitln = [pfunc_section, this](const std::string &inst) -> void {
+  auto emitln = [pfunc_section](const std::string &inst) -> void {
     pfunc_section->append(inst);
     pfunc_section->append("\n");
-    data_pool_distance_ += ArmHelper::CountLines(inst) + 1;
-    if (data_pool_distance_ > DATA_POOL_DISTANCE_THRESHOLD) {
-      (*pfunc_section) += EndCurrentDataPool();
-    }
   };
   //添加函数头
   emitln(".text");
   emitln(".align 4");
   emitln(".global " + func_name);
   emitln(func_name + ":");
+  if (MEMO_flag && IsMemoizable()) {
+    emit(MemoizeToASMString(func_name));
+  }
+  //入口处只依赖参数的提前返回，放在保存寄存器之前
+  TACList::iterator skip_begin = end_, skip_end = end_;
+  if (OP_flag) {
+    emit(EarlyReturnToASMString(&skip_begin, &skip_end));
+  }
   //将要用到的寄存器保存起来
   func_context_.func_attr_ = func_context_.reg_alloc_->get_SymAttribute(func_label);
+  //叶函数不用保存lr，直接bx lr返回。栈帧较大时lr要用来计算栈上地址，仍然保存
+  if (leaf && !IsLargeFrame()) {
+    UNSET_UINT(func_context_.func_attr_.attr.used_regs.intRegs, LR_REGID);
+  }
   //保存了的寄存器列表
   std::vector<uint32_t> &saveintregs = func_context_.saveintregs_;
   std::vector<std::pair<uint32_t, uint32_t>> &savefloatregs = func_context_.savefloatregs_;
@@ -287,6 +393,19 @@ bool ArmBuilder::TranslateFunction() {
     reg_list.emplace_back(newreg, newreg);
   };
 
+  if (OP_flag) {
+    ChooseGlobalAnchorReg();
+    ChooseFrameBaseReg();
+  }
+
+  //库函数可能改写ip，调用处只在ip中有活跃值时才保存，所以调用了库函数的函数要在入口处替调用者保存ip
+  for (auto it = current_; it != end_; ++it) {
+    if ((*it)->operation_ == TACOperationType::Call && !(*it)->b_->IsGlobal()) {
+      SET_UINT(func_context_.func_attr_.attr.used_regs.intRegs, IP_REGID);
+      break;
+    }
+  }
+
   //保存会修改的通用寄存器
   for (int i = 4; i < 13; i++) {
     //如果第i号通用寄存器要用
@@ -332,6 +451,12 @@ bool ArmBuilder::TranslateFunction() {
       }
     }
   }
+  //帧基址取保存寄存器之前的sp
+  if (func_context_.frame_base_reg_ != -1) {
+    bool check = ArmHelper::EmitImmediateInstWithCheck(emitln, "add", IntRegIDToName(func_context_.frame_base_reg_),
+                                                       "sp", func_context_.stack_size_for_regsave_);
+    assert(check);
+  }
   //为变量分配栈空间
   func_context_.stack_size_for_vars_ = func_context_.func_attr_.value;
   //可能用很大的栈空间，立即数存不下，保险起见Divide一下
@@ -345,6 +470,11 @@ bool ArmBuilder::TranslateFunction() {
   }
   assert((int)test_varsize_imm == func_context_.stack_size_for_vars_);
 
+  //取全局数据块基址，函数内一直有效
+  if (func_context_.global_anchor_reg_ != -1) {
+    ArmHelper::EmitLoadAddress(emitln, IntRegIDToName(func_context_.global_anchor_reg_), GLOBAL_ANCHOR_NAME);
+  }
+
   //为后面栈的释放我们反向一下。
   std::reverse(var_stack_immvals.begin(), var_stack_immvals.end());
   std::reverse(savefloatregs.begin(), savefloatregs.end());
@@ -360,6 +490,11 @@ bool ArmBuilder::TranslateFunction() {
   --end_;
   assert((*end_)->operation_ == TACOperationType::FunctionEnd);
   for (; current_ != end_; ++current_) {
+    //已经在提前返回中处理过
+    if (current_ == skip_begin) {
+      current_ = std::prev(skip_end);
+      continue;
+    }
     if ((*current_)->operation_ == TACOperationType::Call) {
       auto next = current_;
       ++next;
@@ -430,7 +565,9 @@ bool ArmBuilder::TranslateFunctions() {
 bool ArmBuilder::Translate(std::string *output) {
   target_output_ = output;
   data_section_.clear();
-  ref_data_.clear();
+  anchor_section_.clear();
+  memo_section_.clear();
+  global_anchor_offsets_.clear();
   func_sections_.clear();
 
   if (!AppendPrefix()) {
@@ -439,14 +576,42 @@ bool ArmBuilder::Translate(std::string *output) {
   if (!TranslateGlobal()) {
     return false;
   }
+  if (OP_flag || MEMO_flag || STATIC_flag) {
+    side_effect_ = std::make_shared<SideEffectAnalyzer>(tac_list_);
+  }
+  if (STATIC_flag) {
+    CollectStaticArrays();
+  }
   target_output_->append(data_section_);
+  target_output_->append(anchor_section_);
+  if (OP_flag) {
+    const_arrays_ = ConstArrayFolder::collect(tac_list_);
+  }
   if (!TranslateFunctions()) {
     return false;
   }
   for (auto &func_section : func_sections_) {
+    auto insts = ParseArmInstList(func_section.body_);
+    std::string stat;
+    if (OP_flag) {
+      //在生成最终文本前做一遍窥孔优化
+      PeepholeOptimizer optimizer(&insts);
+      optimizer.optimize();
+      if (!optimizer.get_rule_counts().empty()) {
+        stat += "// peephole " + func_section.name_ + ": " + optimizer.CountsToString() + "\n";
+      }
+    }
+    //文字池要在指令确定之后按实际距离放置
+    LiteralPoolManager pool_manager(&insts, func_section.name_);
+    pool_manager.place();
+    if (pool_manager.get_branch_count() > 0) {
+      stat += "// literal pool " + func_section.name_ + ": pools=" + std::to_string(pool_manager.get_pool_count()) +
+              " branches=" + std::to_string(pool_manager.get_branch_count()) + "\n";
+    }
+    func_section.body_ = ArmInstListToString(insts) + stat;
     target_output_->append(func_section.body_);
   }
-  target_output_->append(EndCurrentDataPool(true));
+  target_output_->append(memo_section_);
   if (!AppendSuffix()) {
     return false;
   }
@@ -460,29 +625,645 @@ std::string ArmBuilder::GetVariableName(SymbolPtr sym) {
   return sym->get_tac_name(true);
 }
 
-std::string ArmBuilder::ToDataRefName(std::string name) { return "_ref_" + name + "_" + std::to_string(data_pool_id_); }
-
 std::string ArmBuilder::DeclareDataToASMString(TACPtr tac) {
   auto sym = tac->a_;
+  auto name = GetVariableName(sym);
+  auto init = static_init_.find(name);
+  bool has_init = init != static_init_.end() && !init->second.empty();
+  if (sym->value_.Type() != SymbolValue::ValueType::Array) {
+    //标量依次放进全局数据块，函数中可以用基址加偏移访问。数据块可能有初值，放在.data
+    if (anchor_section_.empty()) {
+      anchor_section_ = ".data\n.align 4\n" + std::string(GLOBAL_ANCHOR_NAME) + ":\n";
+    }
+    int offset = global_anchor_offsets_.size() * 4;
+    global_anchor_offsets_[name] = offset;
+    anchor_section_ += "// " + tac->ToString() + "\n" + name + ":\n";
+    if (has_init && init->second.begin()->second != 0) {
+      anchor_section_ += ".word " + std::to_string(static_cast<int32_t>(init->second.begin()->second)) + "\n";
+    } else {
+      anchor_section_ += ".skip 4\n";
+    }
+    return "";
+  }
+  size_t sz = sym->value_.GetArrayDescriptor()->dimensions[0];
   //注释和align设置
-  std::string ret = "// " + tac->ToString() + "\n.bss\n.align 4\n";
-  //数据label
-  ret += GetVariableName(sym) + ":\n";
-  //如果是普通的int或float都是1单位sz，数组则可能多个
-  size_t sz = 1;
-  //数组声明
-  if (sym->value_.Type() == SymbolValue::ValueType::Array) {
-    sz = sym->value_.GetArrayDescriptor()->dimensions[0];
+  std::string ret = "// " + tac->ToString() + "\n";
+  if (!has_init) {
+    return ret + ".bss\n.align 4\n" + name + ":\n.skip " + std::to_string(sz * 4) + "\n";
+  }
+  //main中还要写的常量数组不能放在只读段
+  bool read_only = sym->type_ == SymbolType::Constant && !static_dynamic_arrays_.count(name);
+  ret += read_only ? ".section .rodata\n" : ".data\n";
+  ret += ".align 4\n" + name + ":\n";
+  //连续的非零值放在一行.word中，中间的0合并成.zero
+  size_t next = 0;
+  std::string words;
+  auto flush_words = [&ret, &words]() -> void {
+    if (!words.empty()) {
+      ret += ".word " + words + "\n";
+      words.clear();
+    }
+  };
+  for (auto &[idx, bits] : init->second) {
+    if (bits == 0 || idx < 0 || static_cast<size_t>(idx) >= sz) {
+      continue;
+    }
+    if (static_cast<size_t>(idx) > next) {
+      flush_words();
+      ret += ".zero " + std::to_string((idx - next) * 4) + "\n";
+    }
+    words += (words.empty() ? "" : ", ") + std::to_string(static_cast<int32_t>(bits));
+    next = idx + 1;
+  }
+  flush_words();
+  if (next < sz) {
+    ret += ".zero " + std::to_string((sz - next) * 4) + "\n";
+  }
+  return ret;
+}
+
+void ArmBuilder::CollectStaticArrays() {
+  static_arrays_.clear();
+  std::string func_name;
+  for (auto it = tac_list_->begin(); it != tac_list_->end(); ++it) {
+    auto tac = *it;
+    if (tac->operation_ == TACOperationType::FunctionBegin && it != tac_list_->begin()) {
+      func_name = (*std::prev(it))->a_->get_tac_name(true);
+      continue;
+    }
+    if (tac->operation_ == TACOperationType::FunctionEnd) {
+      func_name.clear();
+      continue;
+    }
+    //同一时刻只有一个活动记录的函数，局部数组放在固定位置也不会冲突
+    if (func_name.empty() ||
+        (tac->operation_ != TACOperationType::Variable && tac->operation_ != TACOperationType::Constant) ||
+        tac->a_->value_.Type() != SymbolValue::ValueType::Array ||
+        tac->a_->value_.GetArrayDescriptor()->GetSizeInByte() < STATIC_ARRAY_MIN_BYTES ||
+        side_effect_->isRecursive(func_name)) {
+      continue;
+    }
+    //局部变量名带有作用域编号，可以直接用作标号
+    static_arrays_.insert(tac->a_);
+    data_section_ += DeclareDataToASMString(tac);
+  }
+}
+
+void ArmBuilder::CollectStaticInit() {
+  static_init_.clear();
+  static_init_tacs_.clear();
+  static_dynamic_arrays_.clear();
+  int func_level = 0;
+  //当前调用之前的实参
+  std::vector<TACPtr> args;
+  //给全局变量(数组元素)赋字面量时，返回变量名、下标和按变量类型转换后的初值
+  auto static_target = [this](const SymbolPtr &target, const SymbolPtr &value, std::string *name, int *idx,
+                              uint32_t *bits) -> bool {
+    if (!target->IsGlobal() || !value->IsLiteral() || !value->value_.IsNumericType()) {
+      return false;
+    }
+    auto type = target->value_.Type();
+    *idx = 0;
+    if (type != SymbolValue::ValueType::Array && target->IsGlobalTemp()) {
+      return false;
+    }
+    if (type == SymbolValue::ValueType::Array) {
+      auto ad = target->value_.GetArrayDescriptor();
+      if (!ad->base_offset->IsLiteral() || ad->base_offset->value_.Type() != SymbolValue::ValueType::Int) {
+        return false;
+      }
+      *idx = ad->base_offset->value_.GetInt();
+      type = ad->value_type;
+    }
+    //前端不转换ConstInitVal的类型，如 const float c[3] = {1.5, 2, 3.5} 中的2
+    auto &val = value->value_;
+    bool is_float = val.Type() == SymbolValue::ValueType::Float;
+    if (type == SymbolValue::ValueType::Float) {
+      *bits = ArmHelper::BitcastToUInt(is_float ? val.GetFloat() : static_cast<float>(val.GetInt()));
+    } else if (type == SymbolValue::ValueType::Int) {
+      *bits = static_cast<uint32_t>(is_float ? static_cast<int>(val.GetFloat()) : val.GetInt());
+    } else {
+      return false;
+    }
+    *name = GetVariableName(target);
+    return true;
+  };
+  //求值停下之后，记下之后的初始化代码还会写的全局数组
+  auto stop = [this](TACList::iterator it) -> void {
+    int level = 0;
+    for (; it != tac_list_->end(); ++it) {
+      auto &tac = *it;
+      if (tac->operation_ == TACOperationType::FunctionBegin || tac->operation_ == TACOperationType::FunctionEnd) {
+        level += tac->operation_ == TACOperationType::FunctionBegin ? 1 : -1;
+        continue;
+      }
+      if (level) {
+        continue;
+      }
+      //写数组元素和传数组地址都以数组(元素)为a_，按可能写入处理
+      auto &sym = tac->a_;
+      if (tac->operation_ != TACOperationType::Variable && tac->operation_ != TACOperationType::Constant && sym &&
+          sym->IsGlobal() && sym->value_.Type() == SymbolValue::ValueType::Array) {
+        static_dynamic_arrays_.insert(GetVariableName(sym));
+      }
+    }
+  };
+  for (auto it = tac_list_->begin(); it != tac_list_->end(); ++it) {
+    auto &tac = *it;
+    if (tac->operation_ == TACOperationType::FunctionBegin) {
+      func_level++;
+      continue;
+    }
+    if (tac->operation_ == TACOperationType::FunctionEnd) {
+      func_level--;
+      continue;
+    }
+    if (func_level) {
+      continue;
+    }
+    switch (tac->operation_) {
+      case TACOperationType::Variable:
+      case TACOperationType::Constant:
+      case TACOperationType::Label:
+      case TACOperationType::BlockBegin:
+      case TACOperationType::BlockEnd:
+        continue;
+      case TACOperationType::Argument:
+      case TACOperationType::ArgumentAddress:
+        args.push_back(tac);
+        continue;
+      case TACOperationType::Call: {
+        //清零还没有赋过值的全局数组，.bss/.data本来就是0
+        if (tac->b_->get_tac_name(true) != "_builtin_clear" || args.size() != 2 ||
+            args[0]->operation_ != TACOperationType::ArgumentAddress || !args[0]->a_->IsGlobal() ||
+            static_init_.count(GetVariableName(args[0]->a_))) {
+          stop(std::prev(it, args.size()));
+          return;
+        }
+        for (auto &arg : args) {
+          static_init_tacs_.insert(arg.get());
+        }
+        args.clear();
+        static_init_tacs_.insert(tac.get());
+        continue;
+      }
+      case TACOperationType::Assign: {
+        std::string name;
+        int idx;
+        uint32_t bits;
+        if (!args.empty() || !static_target(tac->a_, tac->b_, &name, &idx, &bits)) {
+          stop(std::prev(it, args.size()));
+          return;
+        }
+        static_init_[name][idx] = bits;
+        static_init_tacs_.insert(tac.get());
+        continue;
+      }
+      default:
+        stop(std::prev(it, args.size()));
+        return;
+    }
+  }
+}
+
+void ArmBuilder::ChooseGlobalAnchorReg() {
+  //基址要两条指令取出，还要多保存一个寄存器，只有访问次数足够多才划算
+  int nref = 0;
+  for (auto it = current_; it != end_; ++it) {
+    auto defsym = (*it)->getDefineSym();
+    if (defsym && GetGlobalAnchorOffset(defsym) != -1) {
+      nref++;
+    }
+    for (auto &sym : (*it)->getUseSym()) {
+      if (GetGlobalAnchorOffset(sym) != -1) {
+        nref++;
+      }
+    }
   }
-  ret += ".skip " + std::to_string(sz * 4) + "\n";
+  if (nref < 2) {
+    return;
+  }
+  //寄存器分配没有用到的r5-r12中挑一个，调用其他函数时它会被保存
+  for (int i = 5; i < 13; i++) {
+    if (!ISSET_UINT(func_context_.func_attr_.attr.used_regs.intRegs, i)) {
+      SET_UINT(func_context_.func_attr_.attr.used_regs.intRegs, i);
+      func_context_.global_anchor_reg_ = i;
+      return;
+    }
+  }
+}
+
+bool ArmBuilder::IsLeafFunction() {
+  for (auto it = current_; it != end_; ++it) {
+    auto &tac = *it;
+    if (tac->operation_ == TACOperationType::Call) {
+      return false;
+    }
+    //不是除以2的幂的整数除法要调用库函数，或者用lr暂存商
+    if ((tac->operation_ == TACOperationType::Div || tac->operation_ == TACOperationType::Mod) &&
+        tac->a_->value_.Type() != SymbolValue::ValueType::Float &&
+        !(tac->c_->type_ == SymbolType::Constant && ArmHelper::IsPowerOf2(tac->c_->value_.GetInt()))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool ArmBuilder::IsMemoizable() {
+  auto func_label = (*current_)->a_;
+  auto func_name = func_label->get_tac_name(true);
+  auto summary = side_effect_->get_summary(func_name);
+  //结果只取决于实参的值
+  if (summary == nullptr || !summary->isPure()) {
+    return false;
+  }
+  //一两个int形参，每个返回值都是int
+  int nparam = 0;
+  bool recursive = false;
+  for (auto it = current_; it != end_; ++it) {
+    auto &tac = *it;
+    switch (tac->operation_) {
+      case TACOperationType::Parameter:
+        if (tac->a_->value_.Type() != SymbolValue::ValueType::Int) {
+          return false;
+        }
+        ++nparam;
+        break;
+      case TACOperationType::Return:
+        if (!tac->a_ || tac->a_->value_.Type() != SymbolValue::ValueType::Int) {
+          return false;
+        }
+        break;
+      case TACOperationType::Call:
+        recursive |= tac->b_->get_tac_name(true) == func_name;
+        break;
+      default:
+        break;
+    }
+  }
+  //不递归时每组实参最多算一次，查表没有收益
+  return nparam >= 1 && nparam <= 2 && recursive;
+}
+
+std::string ArmBuilder::MemoizeToASMString(const std::string &func_name) {
+  std::string ret;
+  auto emitln = [&ret](const std::string &inst) -> void {
+    ret.append(inst);
+    ret.append("\n");
+  };
+  bool two_args = (*std::next(current_, 3))->operation_ == TACOperationType::Parameter;
+  std::string table = func_name + "_memo";
+  std::string miss = func_name + "_MM";
+  std::string body = func_name + "_MB";
+  //每项16字节，零初始化即为无效
+  memo_section_ += ".bss\n.align 4\n" + table + ":\n.skip " + std::to_string(16 << MEMO_TABLE_BITS) + "\n";
+
+  //实参在r0、r1中，r2、r3不是参数寄存器，可以直接使用。表项地址为 table + (hash的低位) * 16
+  emitln("movw r2, #:lower16:" + table);
+  emitln("movt r2, #:upper16:" + table);
+  if (two_args) {
+    emitln("add r3, r1, r0, lsl #5");
+    emitln("lsl r3, r3, #" + std::to_string(32 - MEMO_TABLE_BITS));
+  } else {
+    emitln("lsl r3, r0, #" + std::to_string(32 - MEMO_TABLE_BITS));
+  }
+  emitln("add r2, r2, r3, lsr #" + std::to_string(28 - MEMO_TABLE_BITS));
+  emitln("ldr r3, [r2]");
+  emitln("cmp r3, #0");
+  emitln("beq " + miss);
+  emitln("ldr r3, [r2, #4]");
+  emitln("cmp r3, r0");
+  emitln("bne " + miss);
+  if (two_args) {
+    emitln("ldr r3, [r2, #8]");
+    emitln("cmp r3, r1");
+    emitln("bne " + miss);
+  }
+  emitln("ldr r0, [r2, #12]");
+  emitln("bx lr");
+
+  //不命中：保存实参和表项地址(16字节，不改变栈的对齐)，调用函数体后整项写回。
+  //递归调用可能已经占用了同一项，所以实参也要重新写入
+  emitln(miss + ":");
+  emitln("push {r0, r1, r2, lr}");
+  emitln("bl " + body);
+  emitln("pop {r1, r2, r3, lr}");
+  emitln("str r1, [r3, #4]");
+  emitln("str r2, [r3, #8]");
+  emitln("str r0, [r3, #12]");
+  emitln("mov r1, #1");
+  emitln("str r1, [r3]");
+  emitln("bx lr");
+  emitln(body + ":");
   return ret;
 }
 
-void ArmBuilder::AddDataRef(TACPtr tac) {
-  std::string name = GetVariableName(tac->a_);
-  ref_data_.push_back(name);
-  // std::string ret = "// add reference to data '" + name + "'\n";
-  // ret += ToDataRefName(name) + ": .word " + name + "\n";
+std::string ArmBuilder::EarlyReturnToASMString(TACList::iterator *skip_begin, TACList::iterator *skip_end) {
+  std::string ret;
+  auto emitln = [&ret](const std::string &inst) -> void {
+    ret.append(inst);
+    ret.append("\n");
+  };
+  auto is_int = [](const SymbolPtr &sym) -> bool { return sym->value_.Type() == SymbolValue::ValueType::Int; };
+  //不产生代码的声明
+  auto is_decl = [](const TACPtr &tac) -> bool {
+    return tac->operation_ == TACOperationType::BlockBegin || tac->operation_ == TACOperationType::BlockEnd ||
+           ((tac->operation_ == TACOperationType::Variable || tac->operation_ == TACOperationType::Constant) &&
+            tac->a_->value_.Type() != SymbolValue::ValueType::Array);
+  };
+
+  //入口处int参数所在的寄存器
+  std::unordered_map<SymbolPtr, int> regs;
+  auto it = std::next(current_, 2);
+  int nint = 0;
+  for (; it != end_ && (*it)->operation_ == TACOperationType::Parameter; ++it) {
+    auto sym = (*it)->a_;
+    if (sym->value_.Type() != SymbolValue::ValueType::Float) {
+      if (nint < 4 && is_int(sym)) {
+        regs[sym] = nint;
+      }
+      nint++;
+    }
+  }
+  while (it != end_ && is_decl(*it)) {
+    ++it;
+  }
+  if (it == end_) {
+    return "";
+  }
+
+  //条件：lhs relop rhs 成立时返回
+  auto region_begin = it;
+  auto relop = TACOperationType::NotEqual;
+  SymbolPtr lhs, rhs;
+  switch ((*it)->operation_) {
+    case TACOperationType::Equal:
+    case TACOperationType::NotEqual:
+    case TACOperationType::LessThan:
+    case TACOperationType::LessOrEqual:
+    case TACOperationType::GreaterThan:
+    case TACOperationType::GreaterOrEqual: {
+      relop = (*it)->operation_;
+      lhs = (*it)->b_;
+      rhs = (*it)->c_;
+      auto cond = (*it)->a_;
+      ++it;
+      if (it == end_ || (*it)->operation_ != TACOperationType::IfZero || (*it)->b_ != cond) {
+        return "";
+      }
+      break;
+    }
+    case TACOperationType::IfZero:
+      lhs = (*it)->b_;
+      break;
+    default:
+      return "";
+  }
+  ++it;
+  std::vector<TACPtr> block;
+  for (; it != end_ && (*it)->operation_ != TACOperationType::Return; ++it) {
+    if (is_decl(*it)) {
+      continue;
+    }
+    auto op = (*it)->operation_;
+    if (op != TACOperationType::Add && op != TACOperationType::Sub && op != TACOperationType::Mul) {
+      return "";
+    }
+    block.push_back(*it);
+  }
+  if (it == end_) {
+    return "";
+  }
+  auto rettac = *it;
+  auto region_end = std::next(it);
+  if (rettac->a_ && !is_int(rettac->a_)) {
+    return "";
+  }
+
+  //区间内定值的量在区间外不能被用到，区间被跳过后它们不会被计算
+  std::unordered_map<SymbolPtr, int> outside_uses;
+  bool inside = false;
+  for (auto i = std::next(current_, 2); i != end_; ++i) {
+    if (i == region_begin) {
+      inside = true;
+    } else if (i == region_end) {
+      inside = false;
+    }
+    if (!inside) {
+      for (auto &sym : (*i)->getUseSym()) {
+        outside_uses[sym]++;
+      }
+    }
+  }
+  for (auto i = region_begin; i != region_end; ++i) {
+    auto defsym = (*i)->getDefineSym();
+    if (defsym && (defsym->IsGlobal() || regs.count(defsym) || outside_uses.count(defsym) || !is_int(defsym))) {
+      return "";
+    }
+  }
+
+  //快速路径中读到的参数寄存器不能被改写
+  uint32_t busy = 0;
+  for (auto &tac : block) {
+    for (auto &sym : tac->getUseSym()) {
+      if (regs.count(sym)) {
+        SET_UINT(busy, regs[sym]);
+      }
+    }
+  }
+  if (rettac->a_ && regs.count(rettac->a_)) {
+    SET_UINT(busy, regs[rettac->a_]);
+  }
+
+  //操作数只能是参数、前面算出的值或int字面量
+  auto resolve = [&](const SymbolPtr &sym, int *reg, int *imm) -> bool {
+    if (sym->IsLiteral()) {
+      *reg = -1;
+      *imm = sym->value_.GetInt();
+      return is_int(sym);
+    }
+    auto found = regs.find(sym);
+    if (found == regs.end()) {
+      return false;
+    }
+    *reg = found->second;
+    return true;
+  };
+
+  static const std::unordered_map<TACOperationType, std::string> cond_suffix = {
+      {TACOperationType::Equal, "eq"},       {TACOperationType::NotEqual, "ne"},
+      {TACOperationType::LessThan, "lt"},    {TACOperationType::LessOrEqual, "le"},
+      {TACOperationType::GreaterThan, "gt"}, {TACOperationType::GreaterOrEqual, "ge"},
+  };
+  int lreg, limm = 0, rreg = -1, rimm = 0;
+  if (!resolve(lhs, &lreg, &limm) || (rhs && !resolve(rhs, &rreg, &rimm))) {
+    return "";
+  }
+  if (lreg == -1) {
+    //字面量放到右边，比较方向随之翻转
+    std::swap(lreg, rreg);
+    std::swap(limm, rimm);
+    if (relop == TACOperationType::LessThan) {
+      relop = TACOperationType::GreaterThan;
+    } else if (relop == TACOperationType::GreaterThan) {
+      relop = TACOperationType::LessThan;
+    } else if (relop == TACOperationType::LessOrEqual) {
+      relop = TACOperationType::GreaterOrEqual;
+    } else if (relop == TACOperationType::GreaterOrEqual) {
+      relop = TACOperationType::LessOrEqual;
+    }
+  }
+  if (lreg == -1) {
+    return "";
+  }
+  std::string cc = cond_suffix.at(relop);
+  if (rreg != -1) {
+    emitln("cmp " + IntRegIDToName(lreg) + ", " + IntRegIDToName(rreg));
+  } else if (ArmHelper::IsImmediateValue(rimm)) {
+    emitln("cmp " + IntRegIDToName(lreg) + ", #" + std::to_string(rimm));
+  } else if (rimm != INT_MIN && ArmHelper::IsImmediateValue(-rimm)) {
+    emitln("cmn " + IntRegIDToName(lreg) + ", #" + std::to_string(-rimm));
+  } else {
+    return "";
+  }
+
+  //依次计算，结果都放在r0-r3中没被占用的寄存器里
+  for (size_t i = 0; i < block.size(); i++) {
+    auto &tac = block[i];
+    int reg1, imm1 = 0, reg2, imm2 = 0;
+    if (!resolve(tac->b_, &reg1, &imm1) || !resolve(tac->c_, &reg2, &imm2) || (reg1 == -1 && reg2 == -1)) {
+      return "";
+    }
+    int dst = -1;
+    //返回值最后一步算出时可以直接写r0
+    if (tac->a_ == rettac->a_ && (i + 1 == block.size() || !ISSET_UINT(busy, 0))) {
+      dst = 0;
+    } else {
+      for (int r = 0; r < 4 && dst == -1; r++) {
+        if (!ISSET_UINT(busy, r)) {
+          dst = r;
+        }
+      }
+      if (dst == -1) {
+        return "";
+      }
+    }
+    SET_UINT(busy, dst);
+    regs[tac->a_] = dst;
+    std::string dstname = IntRegIDToName(dst);
+    if (reg1 != -1 && reg2 != -1) {
+      std::string opcode = tac->operation_ == TACOperationType::Add   ? "add"
+                           : tac->operation_ == TACOperationType::Sub ? "sub"
+                                                                      : "mul";
+      emitln(opcode + cc + " " + dstname + ", " + IntRegIDToName(reg1) + ", " + IntRegIDToName(reg2));
+      continue;
+    }
+    if (tac->operation_ == TACOperationType::Mul) {
+      return "";
+    }
+    if (tac->operation_ == TACOperationType::Sub && reg1 == -1) {
+      // imm - reg
+      if (!ArmHelper::IsImmediateValue(imm1)) {
+        return "";
+      }
+      emitln("rsb" + cc + " " + dstname + ", " + IntRegIDToName(reg2) + ", #" + std::to_string(imm1));
+      continue;
+    }
+    int reg = reg1 == -1 ? reg2 : reg1;
+    int imm = reg1 == -1 ? imm1 : imm2;
+    if (tac->operation_ == TACOperationType::Sub) {
+      if (imm == INT_MIN) {
+        return "";
+      }
+      imm = -imm;
+    }
+    if (ArmHelper::IsImmediateValue(imm)) {
+      emitln("add" + cc + " " + dstname + ", " + IntRegIDToName(reg) + ", #" + std::to_string(imm));
+    } else if (imm != INT_MIN && ArmHelper::IsImmediateValue(-imm)) {
+      emitln("sub" + cc + " " + dstname + ", " + IntRegIDToName(reg) + ", #" + std::to_string(-imm));
+    } else {
+      return "";
+    }
+  }
+
+  //设置返回值
+  if (rettac->a_) {
+    int reg, imm = 0;
+    if (!resolve(rettac->a_, &reg, &imm)) {
+      return "";
+    }
+    if (reg > 0) {
+      emitln("mov" + cc + " r0, " + IntRegIDToName(reg));
+    } else if (reg == -1 && ArmHelper::IsImmediateValue(imm)) {
+      emitln("mov" + cc + " r0, #" + std::to_string(imm));
+    } else if (reg == -1 && ArmHelper::IsImmediateValue(~imm)) {
+      emitln("mvn" + cc + " r0, #" + std::to_string(~imm));
+    } else if (reg == -1) {
+      return "";
+    }
+  }
+  emitln("bx" + cc + " lr");
+  *skip_begin = region_begin;
+  *skip_end = region_end;
+  return ret;
+}
+
+bool ArmBuilder::IsLargeFrame() {
+  //保存的寄存器最多为r4-r12, lr以及s16-s31
+  int size = func_context_.func_attr_.value + (9 + 1 + 16) * 4;
+  int nint = 0, nfloat = 0;
+  for (auto it = current_; it != end_; ++it) {
+    if ((*it)->operation_ != TACOperationType::Parameter) {
+      continue;
+    }
+    if ((*it)->a_->value_.Type() == SymbolValue::ValueType::Float) {
+      if (++nfloat > 16) {
+        size += 4;
+      }
+    } else if (++nint > 4) {
+      size += 4;
+    }
+  }
+  return size > 1020;
+}
+
+void ArmBuilder::ChooseFrameBaseReg() {
+  if (!IsLargeFrame()) {
+    return;
+  }
+  //只有栈上传入的参数离sp远、离入口sp近，没有它们时帧基址用处不大
+  int nint = 0, nfloat = 0;
+  for (auto it = current_; it != end_; ++it) {
+    if ((*it)->operation_ != TACOperationType::Parameter) {
+      continue;
+    }
+    if ((*it)->a_->value_.Type() == SymbolValue::ValueType::Float) {
+      nfloat++;
+    } else {
+      nint++;
+    }
+  }
+  if (nint <= 4 && nfloat <= 16) {
+    return;
+  }
+  for (int i = FP_REGID; i >= 5; i--) {
+    if (!ISSET_UINT(func_context_.func_attr_.attr.used_regs.intRegs, i)) {
+      SET_UINT(func_context_.func_attr_.attr.used_regs.intRegs, i);
+      func_context_.frame_base_reg_ = i;
+      return;
+    }
+  }
+}
+
+int ArmBuilder::GetGlobalAnchorOffset(SymbolPtr sym) {
+  if (!sym->IsGlobal() || sym->IsLiteral() || sym->value_.Type() == SymbolValue::ValueType::Array) {
+    return -1;
+  }
+  auto it = global_anchor_offsets_.find(GetVariableName(sym));
+  if (it == global_anchor_offsets_.end()) {
+    return -1;
+  }
+  return it->second;
 }
 
 std::string ArmBuilder::IntRegIDToName(int regid) {
@@ -514,31 +1295,5 @@ std::string ArmBuilder::FloatRegIDToName(int regid) {
   throw std::runtime_error("Unexpected float regid " + std::to_string(regid));
 }
 
-std::string ArmBuilder::EndCurrentDataPool(bool ignorebranch) {
-  data_pool_distance_ = 0;
-  std::string ret;
-  auto emitln = [&ret](const std::string str) -> void {
-    ret.append(str);
-    ret.append("\n");
-  };
-  if (!ignorebranch) {
-    emitln("b _ignore_data_pool_" + std::to_string(data_pool_id_));
-  }
-  emitln(".align 4");
-  emitln(".ltorg");
-  if (!ref_data_.empty()) {
-    emitln(".align 4");
-  }
-  for (const auto &name : ref_data_) {
-    emitln("// add reference to data '" + name);
-    emitln(ToDataRefName(name) + ": .word " + name);
-  }
-  if (!ignorebranch) {
-    emitln(".align 4");
-    emitln("_ignore_data_pool_" + std::to_string(data_pool_id_) + ":");
-  }
-  data_pool_id_++;
-  return ret;
-}
 }  // namespace AssemblyBuilder
 }  // namespace HaveFunCompiler
\ No newline at end of file
@@ -6,24 +6,23 @@
 #include "ASM/arm/ArmBuilder.hh"
 #include "ASM/arm/ArmHelper.hh"
 #include "ASM/arm/FunctionContext.hh"
+#include "ASM/arm/InstructionSelector.hh"
 #include "ASM/arm/RegAllocator.hh"
 #include "MagicEnum.hh"
 #include "TAC/TAC.hh"
 #include "Utility.hh"
 
+extern int IDIV_flag;
+
 namespace HaveFunCompiler {
 using namespace ThreeAddressCode;
 namespace AssemblyBuilder {
 
 std::string ArmBuilder::FuncTACToASMString(TACPtr tac) {
   std::string ret = "";
-  auto emitln = [&ret, this](const std::string &inst) -> void {
+  auto emitln = [&ret](const std::string &inst) -> void {
     ret.append(inst);
     ret.append("\n");
-    data_pool_distance_ += ArmHelper::CountLines(inst) + 1;
-    if (data_pool_distance_ > DATA_POOL_DISTANCE_THRESHOLD) {
-      ret += EndCurrentDataPool();
-    }
   };
   //来个注释好了
   emitln("// " + tac->ToString());
@@ -40,6 +39,43 @@ std::string ArmBuilder::FuncTACToASMString(TACPtr tac) {
     }
   };
 
+  //相对当前sp偏移为realoffset的栈上存储单元的地址。
+  //偏移超出ldr/str(±4095)或vldr/vstr(±1020)的立即数范围时，先尝试用帧基址寄存器寻址，
+  //否则在scratch中算出地址。scratch默认为lr，需要走到这一步的函数都在入口保存了lr
+  auto stack_slot_addr = [&, this](int32_t realoffset, bool isfloat, int scratch = LR_REGID) -> std::string {
+    int32_t limit = isfloat ? 1020 : 4095;
+    if (realoffset >= 0 && realoffset <= limit) {
+      return "[sp, #" + std::to_string(realoffset) + "]";
+    }
+    if (func_context_.frame_base_reg_ != -1) {
+      //帧基址寄存器指向函数入口时的sp
+      int32_t fboffset = realoffset - func_context_.stack_size_for_args_ - func_context_.stack_size_for_vars_ -
+                         func_context_.stack_size_for_regsave_;
+      if (fboffset >= -limit && fboffset <= limit) {
+        return "[" + IntRegIDToName(func_context_.frame_base_reg_) + ", #" + std::to_string(fboffset) + "]";
+      }
+    }
+    ArmHelper::EmitLoadImmediate(emitln, IntRegIDToName(scratch), realoffset);
+    if (!isfloat) {
+      return "[sp, " + IntRegIDToName(scratch) + "]";
+    }
+    emitln("add " + IntRegIDToName(scratch) + ", " + IntRegIDToName(scratch) + ", sp");
+    return "[" + IntRegIDToName(scratch) + "]";
+  };
+
+  //用常驻的基址寄存器访问全局标量，返回 "[rX, #off]"，不能这样访问时返回空串
+  auto global_anchor_addr = [&, this](SymbolPtr sym, bool isfloat) -> std::string {
+    if (func_context_.global_anchor_reg_ == -1) {
+      return "";
+    }
+    int offset = GetGlobalAnchorOffset(sym);
+    // vldr/vstr的偏移只有±1020
+    if (offset == -1 || offset > (isfloat ? 1020 : 4095)) {
+      return "";
+    }
+    return "[" + IntRegIDToName(func_context_.global_anchor_reg_) + ", #" + std::to_string(offset) + "]";
+  };
+
   // reg_id为0时驱逐int_freereg1，否则驱逐int_freereg2。 只会用到reg_id一个寄存器。
   auto evit_int_reg = [&, this](int reg_id) -> void {
     SymbolPtr *target_sym;
@@ -60,10 +96,13 @@ std::string ArmBuilder::FuncTACToASMString(TACPtr tac) {
     }
     if ((*target_sym)->IsGlobal()) {
       //数组指针不会被更改，直接就不用会存。
-      if ((*target_sym)->value_.Type() != SymbolValue::ValueType::Array) {
+      auto addr = global_anchor_addr(*target_sym, false);
+      if (!addr.empty()) {
+        emitln("str " + IntRegIDToName(reg_id) + ", " + addr);
+      } else if ((*target_sym)->value_.Type() != SymbolValue::ValueType::Array) {
         int otherreg = reg_id ? 0 : func_context_.func_attr_.attr.used_regs.intReservedReg;
         emitln("push {" + IntRegIDToName(otherreg) + "}");
-        emitln("ldr " + IntRegIDToName(otherreg) + ", " + ToDataRefName(GetVariableName(*target_sym)));
+        ArmHelper::EmitLoadAddress(emitln, IntRegIDToName(otherreg), GetVariableName(*target_sym));
         emitln("str " + IntRegIDToName(reg_id) + ", [" + IntRegIDToName(otherreg) + "]");
         emitln("pop {" + IntRegIDToName(otherreg) + "}");
       }
@@ -76,30 +115,7 @@ std::string ArmBuilder::FuncTACToASMString(TACPtr tac) {
     }
 
     int32_t realoffset = getrealoffset(attr);
-
-    if (ArmHelper::IsLDRSTRImmediateValue(realoffset)) {
-      emitln("str " + IntRegIDToName(reg_id) + ", [sp, #" + std::to_string(realoffset) + "]");
-    } else {
-      //如果不能直接做，我们对sp加上相应偏移量，使得每一个偏移量都可以。
-      auto splitoffset = ArmHelper::DivideIntoImmediateValues(realoffset);
-      for (size_t i = 0; i + 1 < splitoffset.size(); i++) {
-        emitln("add sp, sp, #" + std::to_string(splitoffset[i]));
-      }
-      //如果最后一个偏移量能直接用立即数放str里面，就直接用了。
-      bool canbeimm = ArmHelper::IsLDRSTRImmediateValue(splitoffset.back());
-      if (canbeimm) {
-        emitln("str " + IntRegIDToName(reg_id) + ", [sp, #" + std::to_string(splitoffset.back()) + "]");
-        splitoffset.pop_back();
-      } else {
-        emitln("add sp, sp, #" + std::to_string(splitoffset.back()));
-        emitln("str " + IntRegIDToName(reg_id) + ", [sp]");
-      }
-      //把sp减回去
-      for (auto it = splitoffset.rbegin(); it != splitoffset.rend(); it++) {
-        bool check = ArmHelper::EmitImmediateInstWithCheck(emitln, "sub", "sp", "sp", *it);
-        assert(check);
-      }
-    }
+    emitln("str " + IntRegIDToName(reg_id) + ", " + stack_slot_addr(realoffset, false));
     *target_sym = nullptr;
   };
 
@@ -150,9 +166,14 @@ std::string ArmBuilder::FuncTACToASMString(TACPtr tac) {
       return;
     }
     if ((*target_sym)->IsGlobal()) {
-      int freeintreg = get_free_int_reg();
-      emitln("ldr " + IntRegIDToName(freeintreg) + ", " + ToDataRefName(GetVariableName(*target_sym)));
-      emitln("vstr " + FloatRegIDToName(reg_id) + ", [" + IntRegIDToName(freeintreg) + "]");
+      auto addr = global_anchor_addr(*target_sym, true);
+      if (!addr.empty()) {
+        emitln("vstr " + FloatRegIDToName(reg_id) + ", " + addr);
+      } else {
+        int freeintreg = get_free_int_reg();
+        ArmHelper::EmitLoadAddress(emitln, IntRegIDToName(freeintreg), GetVariableName(*target_sym));
+        emitln("vstr " + FloatRegIDToName(reg_id) + ", [" + IntRegIDToName(freeintreg) + "]");
+      }
       *target_sym = nullptr;
       return;
     }
@@ -162,30 +183,7 @@ std::string ArmBuilder::FuncTACToASMString(TACPtr tac) {
     }
 
     int32_t realoffset = getrealoffset(attr);
-
-    if (ArmHelper::IsLDRSTRImmediateValue(realoffset)) {
-      emitln("vstr " + FloatRegIDToName(reg_id) + ", [sp, #" + std::to_string(realoffset) + "]");
-    } else {
-      //如果不能直接做，我们对sp加上相应偏移量，使得每一个偏移量都可以。
-      auto splitoffset = ArmHelper::DivideIntoImmediateValues(realoffset);
-      for (size_t i = 0; i + 1 < splitoffset.size(); i++) {
-        emitln("add sp, sp, #" + std::to_string(splitoffset[i]));
-      }
-      //如果最后一个偏移量能直接用立即数放str里面，就直接用了。
-      bool canbeimm = ArmHelper::IsLDRSTRImmediateValue(splitoffset.back());
-      if (canbeimm) {
-        emitln("vstr " + FloatRegIDToName(reg_id) + ", [sp, #" + std::to_string(splitoffset.back()) + "]");
-        splitoffset.pop_back();
-      } else {
-        emitln("add sp, sp, #" + std::to_string(splitoffset.back()));
-        emitln("vstr " + FloatRegIDToName(reg_id) + ", [sp]");
-      }
-      //把sp减回去
-      for (auto it = splitoffset.rbegin(); it != splitoffset.rend(); it++) {
-        bool check = ArmHelper::EmitImmediateInstWithCheck(emitln, "sub", "sp", "sp", *it);
-        assert(check);
-      }
-    }
+    emitln("vstr " + FloatRegIDToName(reg_id) + ", " + stack_slot_addr(realoffset, true));
     *target_sym = nullptr;
   };
 
@@ -303,27 +301,21 @@ std::string ArmBuilder::FuncTACToASMString(TACPtr tac) {
         if (sym->IsLiteral()) {
           int freeintreg = get_free_int_reg();
           uint32_t castval = ArmHelper::BitcastToUInt(sym->value_.GetFloat());
-          if (ArmHelper::IsImmediateValue(castval)) {
-            emitln("mov " + IntRegIDToName(freeintreg) + ", #" + std::to_string(castval));
-          } else {
-            emitln("ldr " + IntRegIDToName(freeintreg) + ", =" + std::to_string(castval));
-          }
+          ArmHelper::EmitLoadImmediate(emitln, IntRegIDToName(freeintreg), castval);
           emitln("vmov " + FloatRegIDToName(target_reg) + ", " + IntRegIDToName(freeintreg));
         } else if (sym->IsGlobal()) {
-          int freeintreg = get_free_int_reg();
-          emitln("ldr " + IntRegIDToName(freeintreg) + ", " + ToDataRefName(GetVariableName(sym)));
-          emitln("vldr " + FloatRegIDToName(target_reg) + ", [" + IntRegIDToName(freeintreg) + "]");
-        } else {
-          auto attr = func_context_.reg_alloc_->get_SymAttribute(sym);
-          int32_t realoffset = getrealoffset(attr);
-          if (ArmHelper::IsLDRSTRImmediateValue(realoffset)) {
-            emitln("vldr " + FloatRegIDToName(target_reg) + ", [sp, #" + std::to_string(realoffset) + "]");
+          auto addr = global_anchor_addr(sym, true);
+          if (!addr.empty()) {
+            emitln("vldr " + FloatRegIDToName(target_reg) + ", " + addr);
           } else {
             int freeintreg = get_free_int_reg();
-            emitln("ldr " + IntRegIDToName(freeintreg) + ", =" + std::to_string(realoffset));
-            // emitln("add " + IntRegIDToName(freeintreg) + ", " + IntRegIDToName(freeintreg) + ", sp");
-            emitln("vldr " + FloatRegIDToName(target_reg) + ", [sp, " + IntRegIDToName(freeintreg) + "]");
+            ArmHelper::EmitLoadAddress(emitln, IntRegIDToName(freeintreg), GetVariableName(sym));
+            emitln("vldr " + FloatRegIDToName(target_reg) + ", [" + IntRegIDToName(freeintreg) + "]");
           }
+        } else {
+          auto attr = func_context_.reg_alloc_->get_SymAttribute(sym);
+          int32_t realoffset = getrealoffset(attr);
+          emitln("vldr " + FloatRegIDToName(target_reg) + ", " + stack_slot_addr(realoffset, true));
         }
       }
 
@@ -373,25 +365,21 @@ std::string ArmBuilder::FuncTACToASMString(TACPtr tac) {
       if (!no_load) {
         if (sym->IsLiteral()) {
           int val = sym->value_.GetInt();
-          if (ArmHelper::IsImmediateValue(val)) {
-            emitln("mov " + IntRegIDToName(target_reg) + ", #" + std::to_string(val));
-          } else {
-            emitln("ldr " + IntRegIDToName(target_reg) + ", =" + std::to_string(val));
-          }
+          ArmHelper::EmitLoadImmediate(emitln, IntRegIDToName(target_reg), val);
         } else if (sym->IsGlobal()) {
-          emitln("ldr " + IntRegIDToName(target_reg) + ", " + ToDataRefName(GetVariableName(sym)));
-          if (sym->value_.Type() != SymbolValue::ValueType::Array) {
-            emitln("ldr " + IntRegIDToName(target_reg) + ", [" + IntRegIDToName(target_reg) + "]");
+          auto addr = global_anchor_addr(sym, false);
+          if (!addr.empty()) {
+            emitln("ldr " + IntRegIDToName(target_reg) + ", " + addr);
+          } else {
+            ArmHelper::EmitLoadAddress(emitln, IntRegIDToName(target_reg), GetVariableName(sym));
+            if (sym->value_.Type() != SymbolValue::ValueType::Array) {
+              emitln("ldr " + IntRegIDToName(target_reg) + ", [" + IntRegIDToName(target_reg) + "]");
+            }
           }
         } else {
           auto attr = func_context_.reg_alloc_->get_SymAttribute(sym);
           int32_t realoffset = getrealoffset(attr);
-          if (ArmHelper::IsLDRSTRImmediateValue(realoffset)) {
-            emitln("ldr " + IntRegIDToName(target_reg) + ", [sp, #" + std::to_string(realoffset) + "]");
-          } else {
-            emitln("ldr " + IntRegIDToName(target_reg) + ", =" + std::to_string(realoffset));
-            emitln("ldr " + IntRegIDToName(target_reg) + ", [sp, " + IntRegIDToName(target_reg) + "]");
-          }
+          emitln("ldr " + IntRegIDToName(target_reg) + ", " + stack_slot_addr(realoffset, false, target_reg));
         }
       }
 
@@ -415,6 +403,40 @@ std::string ArmBuilder::FuncTACToASMString(TACPtr tac) {
     return -1;
   };
 
+  //为一组源操作数分配寄存器，返回值与syms一一对应。
+  //调用者需保证每一类中不在寄存器里的符号不超过两个（自由寄存器只有两个）。
+  auto alloc_operands = [&, this](const std::vector<SymbolPtr> &syms) -> std::vector<int> {
+    std::vector<int> regs(syms.size(), -1);
+    int occupied_int = -1;
+    int occupied_float = -1;
+    auto is_cached = [&](const SymbolPtr &sym) -> bool {
+      return sym == func_context_.int_freereg1_ || sym == func_context_.int_freereg2_ ||
+             sym == func_context_.float_freereg1_ || sym == func_context_.float_freereg2_;
+    };
+    //先处理已经在寄存器中的，避免它们被驱逐
+    for (int pass = 0; pass < 2; pass++) {
+      for (size_t i = 0; i < syms.size(); i++) {
+        if (regs[i] != -1) {
+          continue;
+        }
+        if (pass == 0 && symbol_reg(syms[i]) == -1 && !is_cached(syms[i])) {
+          continue;
+        }
+        int &occupied = (syms[i]->value_.Type() == SymbolValue::ValueType::Float ? occupied_float : occupied_int);
+        regs[i] = alloc_reg(syms[i], occupied);
+        if (symbol_reg(syms[i]) == -1) {
+          occupied = regs[i];
+        }
+        for (size_t j = i + 1; j < syms.size(); j++) {
+          if (syms[j] == syms[i]) {
+            regs[j] = regs[i];
+          }
+        }
+      }
+    }
+    return regs;
+  };
+
   //处理三个都是同种寄存器时的情况。返回值为：res寄存器，op1寄存器，op2寄存器，是否需要在运算后将缓存去除(-1,0,1，-1代表不需要，0表示去除第一个自由寄存器，1代表去除第二个)。
   auto prepare_binary_operation = [&, this](SymbolPtr result, SymbolPtr operand1,
                                             SymbolPtr operand2) -> std::tuple<int, int, int, int> {
@@ -608,7 +630,7 @@ std::string ArmBuilder::FuncTACToASMString(TACPtr tac) {
             }
             if (!ArmHelper::EmitImmediateInstWithCheck(emitln, "add", IntRegIDToName(resreg), IntRegIDToName(op1reg),
                                                        mask)) {
-              emitln("ldr " + IntRegIDToName(resreg) + ", =" + std::to_string(mask));
+              ArmHelper::EmitLoadImmediate(emitln, IntRegIDToName(resreg), mask);
               emitln("add " + IntRegIDToName(resreg) + ", " + IntRegIDToName(op1reg) + ", " + IntRegIDToName(resreg));
             }
             emitln("cmp " + IntRegIDToName(op1reg) + ", #0");
@@ -622,6 +644,8 @@ std::string ArmBuilder::FuncTACToASMString(TACPtr tac) {
                 func_context_.int_freereg2_ = nullptr;
               }
             }
+          } else if (IDIV_flag) {
+            emitln("sdiv " + IntRegIDToName(resreg) + ", " + IntRegIDToName(op1reg) + ", " + IntRegIDToName(op2reg));
           } else {
             evit_int_reg(0);
             evit_int_reg(1);
@@ -737,6 +761,10 @@ std::string ArmBuilder::FuncTACToASMString(TACPtr tac) {
                 func_context_.int_freereg2_ = nullptr;
               }
             }
+          } else if (IDIV_flag) {
+            // lr在函数入口已经保存，可以用来放商
+            emitln("sdiv lr, " + IntRegIDToName(op1reg) + ", " + IntRegIDToName(op2reg));
+            emitln("mls " + IntRegIDToName(resreg) + ", lr, " + IntRegIDToName(op2reg) + ", " + IntRegIDToName(op1reg));
           } else {
             evit_int_reg(0);
             evit_int_reg(1);
@@ -808,7 +836,11 @@ std::string ArmBuilder::FuncTACToASMString(TACPtr tac) {
           throw std::logic_error("Unknown binary operation " +
                                  std::string(magic_enum::enum_name<TACOperationType>(tac->operation_)));
       }
-      if (freeregid != -1 && tac->operation_ != TACOperationType::Mod && tac->operation_ != TACOperationType::Div) {
+      //除法和取模只有用sdiv时才算在resreg中
+      bool divmod = tac->operation_ == TACOperationType::Mod || tac->operation_ == TACOperationType::Div;
+      bool inline_divmod =
+          IDIV_flag && !(tac->c_->type_ == SymbolType::Constant && ArmHelper::IsPowerOf2(tac->c_->value_.GetInt()));
+      if (freeregid != -1 && (!divmod || inline_divmod)) {
         emitln("mov " + IntRegIDToName(alloc_reg(tac->a_, resreg)) + ", " + IntRegIDToName(resreg));
         if (freeregid == 0) {
           // assert(func_context_.int_freereg1_ == tac->b_);
@@ -853,6 +885,67 @@ std::string ArmBuilder::FuncTACToASMString(TACPtr tac) {
     }
   };
 
+  //数组元素访问直接使用[base, offset, LSL #2]或[base, #imm]寻址，省去地址计算。不适用时返回false
+  auto array_access_with_offset = [&, this]() -> bool {
+    bool arrayA = tac->a_->value_.Type() == SymbolValue::ValueType::Array;
+    auto element = arrayA ? tac->a_ : tac->b_;
+    auto value = arrayA ? tac->b_ : tac->a_;
+    bool is_float = (value->value_.Type() == SymbolValue::ValueType::Float);
+    auto arrayDescriptor = element->value_.GetArrayDescriptor();
+    auto basesym = arrayDescriptor->base_addr.lock();
+    auto offsetsym = arrayDescriptor->base_offset;
+    bool immoffset = false;
+    int32_t byteoffset = 0;
+    if (offsetsym->IsLiteral()) {
+      byteoffset = offsetsym->value_.GetInt() * 4;
+      // vldr/vstr的偏移范围比ldr/str小
+      immoffset = is_float ? (byteoffset >= -1020 && byteoffset <= 1020) : ArmHelper::IsLDRSTRImmediateValue(byteoffset);
+    }
+    // vldr/vstr不支持寄存器偏移
+    if (is_float && !immoffset) {
+      return false;
+    }
+    std::vector<SymbolPtr> intsyms = {basesym};
+    if (!immoffset) {
+      intsyms.push_back(offsetsym);
+    }
+    if (arrayA && !is_float) {
+      intsyms.push_back(value);
+    }
+    int nonreg = 0;
+    for (size_t i = 0; i < intsyms.size(); i++) {
+      if (symbol_reg(intsyms[i]) == -1 && std::find(intsyms.begin(), intsyms.begin() + i, intsyms[i]) == intsyms.begin() + i) {
+        nonreg++;
+      }
+    }
+    if (nonreg > 2) {
+      return false;
+    }
+    //浮点值先分配，因为装载浮点字面量或全局变量时可能会占用通用自由寄存器
+    int valuereg = -1;
+    if (is_float) {
+      valuereg = arrayA ? alloc_reg(value) : alloc_reg(value, -1, true);
+    }
+    auto regs = alloc_operands(intsyms);
+    std::string addr = "[" + IntRegIDToName(regs[0]) +
+                       (immoffset ? ", #" + std::to_string(byteoffset) : ", " + IntRegIDToName(regs[1]) + ", LSL #2") +
+                       "]";
+    if (arrayA) {
+      if (is_float) {
+        emitln("vstr " + FloatRegIDToName(valuereg) + ", " + addr);
+      } else {
+        emitln("str " + IntRegIDToName(regs.back()) + ", " + addr);
+      }
+    } else {
+      if (is_float) {
+        emitln("vldr " + FloatRegIDToName(valuereg) + ", " + addr);
+      } else {
+        emitln("ldr " + IntRegIDToName(alloc_reg(value, -1, true)) + ", " + addr);
+      }
+    }
+    return true;
+  };
+
   auto assignment = [&, this]() -> void {
     if (tac->b_ == tac->a_) {
       //无需赋值
@@ -864,6 +957,9 @@ std::string ArmBuilder::FuncTACToASMString(TACPtr tac) {
       //不符合语法
       throw std::logic_error("Cant assign array element to array element");
     }
+    if ((arrayA || arrayB) && func_context_.selector_ != nullptr && array_access_with_offset()) {
+      return;
+    }
     if (arrayA) {
       auto arrayDescriptor = tac->a_->value_.GetArrayDescriptor();
       auto basesym = arrayDescriptor->base_addr.lock();
@@ -934,9 +1030,14 @@ std::string ArmBuilder::FuncTACToASMString(TACPtr tac) {
         emitln("ldr " + IntRegIDToName(valuereg) + ", [" + IntRegIDToName(addrreg) + "]");
       }
     } else if (tac->a_->IsGlobal()) {
-      int dstreg = get_free_int_reg();
+      int dstreg = -1;
       int valreg;
-      emitln("ldr " + IntRegIDToName(dstreg) + ", " + ToDataRefName(GetVariableName(tac->a_)));
+      auto addr = global_anchor_addr(tac->a_, tac->a_->value_.Type() == SymbolValue::ValueType::Float);
+      if (addr.empty()) {
+        dstreg = get_free_int_reg();
+        ArmHelper::EmitLoadAddress(emitln, IntRegIDToName(dstreg), GetVariableName(tac->a_));
+        addr = "[" + IntRegIDToName(dstreg) + "]";
+      }
       if (tac->a_->value_.Type() == SymbolValue::ValueType::Float) {
         valreg = alloc_reg(tac->b_);
         if (func_context_.float_freereg1_ == tac->a_) {
@@ -946,7 +1047,7 @@ std::string ArmBuilder::FuncTACToASMString(TACPtr tac) {
                  FloatRegIDToName(valreg));
         }
 
-        emitln("vstr " + FloatRegIDToName(valreg) + ", [" + IntRegIDToName(dstreg) + "]");
+        emitln("vstr " + FloatRegIDToName(valreg) + ", " + addr);
       } else {
         valreg = alloc_reg(tac->b_, dstreg);
         if (func_context_.int_freereg1_ == tac->a_) {
@@ -955,7 +1056,7 @@ std::string ArmBuilder::FuncTACToASMString(TACPtr tac) {
           emitln("mov " + IntRegIDToName(func_context_.func_attr_.attr.used_regs.intReservedReg) + ", " +
                  IntRegIDToName(valreg));
         }
-        emitln("str " + IntRegIDToName(valreg) + ", [" + IntRegIDToName(dstreg) + "]");
+        emitln("str " + IntRegIDToName(valreg) + ", " + addr);
       }
     } else {
       int valreg = alloc_reg(tac->b_);
@@ -1033,12 +1134,7 @@ std::string ArmBuilder::FuncTACToASMString(TACPtr tac) {
         }
 
         int32_t realoffset = func_context_.stack_size_for_vars_ + func_context_.stack_size_for_regsave_ + offset;
-        if (ArmHelper::IsLDRSTRImmediateValue(realoffset)) {
-          emitln("ldr " + IntRegIDToName(symAttr.value) + ", [sp, #" + std::to_string(realoffset) + "]");
-        } else {
-          emitln("ldr " + IntRegIDToName(symAttr.value) + ", =" + std::to_string(realoffset));
-          emitln("ldr " + IntRegIDToName(symAttr.value) + ", [sp, " + IntRegIDToName(symAttr.value) + "]");
-        }
+        emitln("ldr " + IntRegIDToName(symAttr.value) + ", " + stack_slot_addr(realoffset, false, symAttr.value));
         break;
       }
       case symAttr.FLOAT_REG: {
@@ -1058,14 +1154,8 @@ std::string ArmBuilder::FuncTACToASMString(TACPtr tac) {
           break;
         }
         int32_t realoffset = func_context_.stack_size_for_vars_ + func_context_.stack_size_for_regsave_ + offset;
-        if (ArmHelper::IsLDRSTRImmediateValue(realoffset)) {
-          emitln("vldr " + FloatRegIDToName(symAttr.value) + ", [sp, #" + std::to_string(realoffset) + "]");
-        } else {
-          int intReservedReg = func_context_.func_attr_.attr.used_regs.intReservedReg;
-          emitln("ldr " + IntRegIDToName(intReservedReg) + ", =" + std::to_string(realoffset));
-          emitln("add " + IntRegIDToName(intReservedReg) + ", " + IntRegIDToName(intReservedReg) + ", sp");
-          emitln("vldr " + FloatRegIDToName(symAttr.value) + ", [" + IntRegIDToName(intReservedReg) + "]");
-        }
+        int intReservedReg = func_context_.func_attr_.attr.used_regs.intReservedReg;
+        emitln("vldr " + FloatRegIDToName(symAttr.value) + ", " + stack_slot_addr(realoffset, true, intReservedReg));
         break;
       }
       case symAttr.STACK_VAR: {
@@ -1073,22 +1163,11 @@ std::string ArmBuilder::FuncTACToASMString(TACPtr tac) {
           throw std::runtime_error("Move stack parameter to another stack");
         }
         int32_t realoffset = symAttr.value;
-        if (ArmHelper::IsLDRSTRImmediateValue(realoffset)) {
-          if (is_float) {
-            emitln("vstr " + FloatRegIDToName(offset) + ", [sp, #" + std::to_string(realoffset) + "]");
-          } else {
-            emitln("str " + IntRegIDToName(offset) + ", [sp, #" + std::to_string(realoffset) + "]");
-          }
+        int intReservedReg = func_context_.func_attr_.attr.used_regs.intReservedReg;
+        if (is_float) {
+          emitln("vstr " + FloatRegIDToName(offset) + ", " + stack_slot_addr(realoffset, true, intReservedReg));
         } else {
-          if (is_float) {
-            int intReservedReg = func_context_.func_attr_.attr.used_regs.intReservedReg;
-            emitln("ldr " + IntRegIDToName(intReservedReg) + ", =" + std::to_string(realoffset));
-            emitln("add " + IntRegIDToName(intReservedReg) + ", " + IntRegIDToName(intReservedReg) + ", sp");
-            emitln("vstr " + FloatRegIDToName(offset) + ", [" + IntRegIDToName(intReservedReg) + "]");
-          } else {
-            emitln("ldr " + IntRegIDToName(offset) + ", =" + std::to_string(realoffset));
-            emitln("ldr " + IntRegIDToName(offset) + ", [sp, " + IntRegIDToName(offset) + "]");
-          }
+          emitln("str " + IntRegIDToName(offset) + ", " + stack_slot_addr(realoffset, false, intReservedReg));
         }
         break;
       }
@@ -1109,17 +1188,330 @@ std::string ArmBuilder::FuncTACToASMString(TACPtr tac) {
     }
   };
 
+  //实参的值所在的符号，数组取其基址
+  auto arg_value_sym = [](SymbolPtr sym) -> SymbolPtr {
+    if (sym->value_.Type() == SymbolValue::ValueType::Array) {
+      return sym->value_.GetArrayDescriptor()->base_addr.lock();
+    }
+    return sym;
+  };
+
+  //把不在寄存器中的实参(字面量、全局变量或栈上变量)直接装入reg，浮点数装入时可能用到lr
+  auto load_arg_value = [&, this](SymbolPtr sym, int reg) -> void {
+    if (sym->value_.Type() == SymbolValue::ValueType::Float) {
+      std::string sreg = FloatRegIDToName(reg);
+      if (sym->IsLiteral()) {
+        ArmHelper::EmitLoadImmediate(emitln, "lr", ArmHelper::BitcastToUInt(sym->value_.GetFloat()));
+        emitln("vmov " + sreg + ", lr");
+      } else if (sym->IsGlobal()) {
+        auto addr = global_anchor_addr(sym, true);
+        if (addr.empty()) {
+          ArmHelper::EmitLoadAddress(emitln, "lr", GetVariableName(sym));
+          addr = "[lr]";
+        }
+        emitln("vldr " + sreg + ", " + addr);
+      } else {
+        auto attr = func_context_.reg_alloc_->get_SymAttribute(sym);
+        emitln("vldr " + sreg + ", " + stack_slot_addr(getrealoffset(attr), true));
+      }
+      return;
+    }
+    std::string rreg = IntRegIDToName(reg);
+    if (sym->IsLiteral()) {
+      ArmHelper::EmitLoadImmediate(emitln, rreg, sym->value_.GetInt());
+    } else if (sym->IsGlobal()) {
+      auto addr = global_anchor_addr(sym, false);
+      if (!addr.empty()) {
+        emitln("ldr " + rreg + ", " + addr);
+      } else {
+        ArmHelper::EmitLoadAddress(emitln, rreg, GetVariableName(sym));
+        if (sym->value_.Type() != SymbolValue::ValueType::Array) {
+          emitln("ldr " + rreg + ", [" + rreg + "]");
+        }
+      }
+    } else {
+      auto attr = func_context_.reg_alloc_->get_SymAttribute(sym);
+      emitln("ldr " + rreg + ", " + stack_slot_addr(getrealoffset(attr), false, reg));
+    }
+  };
+
+  //把数组实参的地址 base + off * 4 算到dst中。breg/oreg为base/off当前所在的寄存器，不在寄存器中时为-1，
+  //需要先装入，dst已被占用时用lr暂存
+  auto emit_arg_address = [&, this](int dst, const ArmUtil::FunctionContext::ArgRecord &record, int breg,
+                                    int oreg) -> void {
+    auto arrayDescriptor = record.sym->value_.GetArrayDescriptor();
+    auto basesym = arrayDescriptor->base_addr.lock();
+    auto offsym = arrayDescriptor->base_offset;
+    std::string rdst = IntRegIDToName(dst);
+    //dst本身就是lr时(栈上传递的实参)，改用保留寄存器暂存，它在调用前已被清空
+    int scratch = (dst == LR_REGID ? func_context_.func_attr_.attr.used_regs.intReservedReg : LR_REGID);
+    if (offsym->IsLiteral()) {
+      if (breg == -1) {
+        load_arg_value(basesym, dst);
+        breg = dst;
+      }
+      int imm = offsym->value_.GetInt() * 4;
+      if (!ArmHelper::EmitImmediateInstWithCheck(emitln, "add", rdst, IntRegIDToName(breg), imm)) {
+        ArmHelper::EmitLoadImmediate(emitln, IntRegIDToName(scratch), imm);
+        emitln("add " + rdst + ", " + IntRegIDToName(breg) + ", " + IntRegIDToName(scratch));
+      }
+      return;
+    }
+    if (breg == -1) {
+      breg = (oreg == dst ? scratch : dst);
+      load_arg_value(basesym, breg);
+    }
+    if (oreg == -1) {
+      oreg = (breg == dst ? scratch : dst);
+      load_arg_value(offsym, oreg);
+    }
+    emitln("add " + rdst + ", " + IntRegIDToName(breg) + ", " + IntRegIDToName(oreg) + ", LSL #2");
+  };
+
+  //栈上传递的实参直接写到最终位置[sp, #storage_pos]，调用者已经留好了空间
+  auto store_stack_args = [&, this]() -> void {
+    int intreserved = func_context_.func_attr_.attr.used_regs.intReservedReg;
+    int floatreserved = func_context_.func_attr_.attr.used_regs.floatReservedReg;
+    for (auto &record : func_context_.arg_records_) {
+      if (record.storage_in_reg) {
+        continue;
+      }
+      bool isfloat = !record.isaddr && record.sym->value_.Type() == SymbolValue::ValueType::Float;
+      int reg;
+      if (record.isaddr) {
+        auto arrayDescriptor = record.sym->value_.GetArrayDescriptor();
+        reg = LR_REGID;
+        emit_arg_address(reg, record, symbol_reg(arrayDescriptor->base_addr.lock()),
+                         symbol_reg(arrayDescriptor->base_offset));
+      } else {
+        auto sym = arg_value_sym(record.sym);
+        reg = symbol_reg(sym);
+        if (reg == -1) {
+          reg = (isfloat ? floatreserved : LR_REGID);
+          load_arg_value(sym, reg);
+        }
+      }
+      std::string addr = "[sp, #" + std::to_string(record.storage_pos) + "]";
+      if (record.storage_pos > (isfloat ? 1020 : 4095)) {
+        if (isfloat) {
+          ArmHelper::EmitLoadImmediate(emitln, "lr", record.storage_pos);
+          emitln("add lr, lr, sp");
+          addr = "[lr]";
+        } else {
+          ArmHelper::EmitLoadImmediate(emitln, IntRegIDToName(intreserved), record.storage_pos);
+          addr = "[sp, " + IntRegIDToName(intreserved) + "]";
+        }
+      }
+      if (isfloat) {
+        emitln("vstr " + FloatRegIDToName(reg) + ", " + addr);
+      } else {
+        emitln("str " + IntRegIDToName(reg) + ", " + addr);
+      }
+    }
+  };
+
+  //寄存器传递的实参。源在寄存器中的看作一组并行赋值，排好顺序后输出，成环时借保留寄存器或r0/s0断开；
+  //不读寄存器的(字面量、全局变量、栈上变量)最后直接装入目标寄存器
+  auto setup_reg_args = [&, this]() -> void {
+    auto &records = func_context_.arg_records_;
+    std::vector<ParallelMove> intmoves, floatmoves;
+    std::vector<size_t> loads;
+    for (size_t i = 0; i < records.size(); i++) {
+      auto &record = records[i];
+      if (!record.storage_in_reg) {
+        continue;
+      }
+      ParallelMove move{record.storage_pos, {}, static_cast<int>(i)};
+      bool isfloat = false;
+      if (record.isaddr) {
+        auto arrayDescriptor = record.sym->value_.GetArrayDescriptor();
+        for (auto &part : {arrayDescriptor->base_addr.lock(), arrayDescriptor->base_offset}) {
+          if (symbol_reg(part) != -1) {
+            move.srcs.push_back(symbol_reg(part));
+          }
+        }
+      } else {
+        auto sym = arg_value_sym(record.sym);
+        isfloat = (sym->value_.Type() == SymbolValue::ValueType::Float);
+        int reg = symbol_reg(sym);
+        if (reg == record.storage_pos) {
+          continue;
+        }
+        if (reg != -1) {
+          move.srcs.push_back(reg);
+        }
+      }
+      if (move.srcs.empty()) {
+        loads.push_back(i);
+      } else if (isfloat) {
+        floatmoves.push_back(move);
+      } else {
+        intmoves.push_back(move);
+      }
+    }
+
+    auto intscratch = {func_context_.func_attr_.attr.used_regs.intReservedReg, 0};
+    for (auto &move : ArmHelper::SequentializeParallelMoves(intmoves, intscratch)) {
+      if (move.id != -1 && records[move.id].isaddr) {
+        auto arrayDescriptor = records[move.id].sym->value_.GetArrayDescriptor();
+        size_t k = 0;
+        int breg = (symbol_reg(arrayDescriptor->base_addr.lock()) != -1 ? move.srcs[k++] : -1);
+        int oreg = (symbol_reg(arrayDescriptor->base_offset) != -1 ? move.srcs[k++] : -1);
+        emit_arg_address(move.dst, records[move.id], breg, oreg);
+      } else if (move.dst != move.srcs[0]) {
+        emitln("mov " + IntRegIDToName(move.dst) + ", " + IntRegIDToName(move.srcs[0]));
+      }
+    }
+    auto floatscratch = {func_context_.func_attr_.attr.used_regs.floatReservedReg, 0};
+    for (auto &move : ArmHelper::SequentializeParallelMoves(floatmoves, floatscratch)) {
+      if (move.dst != move.srcs[0]) {
+        emitln("vmov " + FloatRegIDToName(move.dst) + ", " + FloatRegIDToName(move.srcs[0]));
+      }
+    }
+    for (auto i : loads) {
+      if (records[i].isaddr) {
+        emit_arg_address(records[i].storage_pos, records[i], -1, -1);
+      } else {
+        load_arg_value(arg_value_sym(records[i].sym), records[i].storage_pos);
+      }
+    }
+  };
+
+  //清零的字数是不大的常量时，在调用处直接用stm清零：r0放首地址，调用后不再活跃的r1-r3和lr放0
+  auto inline_clear = [&, this]() -> bool {
+    auto &records = func_context_.arg_records_;
+    if (tac->b_->get_tac_name(true) != "_builtin_clear" || records.size() != 2 || !records[0].isaddr ||
+        records[1].isaddr || !records[1].sym->IsLiteral()) {
+      return false;
+    }
+    int count = records[1].sym->value_.GetInt();
+    auto live_out = func_context_.call_live_out_.find(tac.get());
+    if (count > INLINE_CLEAR_MAX_WORDS || live_out == func_context_.call_live_out_.end()) {
+      return false;
+    }
+    uint32_t busy = 0;
+    for (auto &sym : live_out->second) {
+      int reg = symbol_reg(sym);
+      if (reg != -1 && sym->value_.Type() != SymbolValue::ValueType::Float) {
+        SET_UINT(busy, reg);
+      }
+    }
+    std::vector<std::string> zeros;
+    for (int i = 1; i < 4; i++) {
+      if (!ISSET_UINT(busy, i)) {
+        zeros.push_back(IntRegIDToName(i));
+      }
+    }
+    zeros.push_back("lr");
+
+    evit_all_freereg();
+    if (count > 0) {
+      auto arrayDescriptor = records[0].sym->value_.GetArrayDescriptor();
+      emit_arg_address(0, records[0], symbol_reg(arrayDescriptor->base_addr.lock()),
+                       symbol_reg(arrayDescriptor->base_offset));
+      zeros.resize(std::min(count, (int)zeros.size()));
+      for (auto &reg : zeros) {
+        emitln("mov " + reg + ", #0");
+      }
+    }
+    while (count > 0) {
+      int n = std::min(count, (int)zeros.size());
+      count -= n;
+      if (n == 1) {
+        emitln("str " + zeros[0] + (count > 0 ? ", [r0], #+4" : ", [r0]"));
+        continue;
+      }
+      std::string regs = zeros[0];
+      for (int i = 1; i < n; i++) {
+        regs += ", " + zeros[i];
+      }
+      emitln((count > 0 ? "stmia r0!, {" : "stm r0, {") + regs + "}");
+    }
+    func_context_.arg_nfloatregs_ = 0;
+    func_context_.arg_nintregs_ = 0;
+    func_context_.arg_stacksize_ = 0;
+    func_context_.arg_records_.clear();
+    return true;
+  };
+
   auto do_call = [&, this]() -> void {
     //初始化一下
     func_context_.stack_size_for_args_ = 0;
     evit_all_freereg();
-    //先压栈吧
-    emitln("push {r1-r3}");
-    emitln("vpush {s1-s15}");
-    //全压！这是刚才压了的寄存器的大小
-    int save_reg_size = 3 * 4 + 15 * 4;
-    //如果是库函数，保存一下ip
-    if (!tac->b_->IsGlobal()) {
+
+    //需要保存的调用者保存寄存器：调用之后仍然活跃的变量所在的
+    uint32_t saveintregs = 0;
+    uint32_t savefloatregs = 0;
+    bool saveip = false;
+    auto mark_saved = [&](SymbolPtr sym) -> void {
+      int reg = symbol_reg(sym);
+      if (reg == -1) {
+        return;
+      }
+      if (sym->value_.Type() == SymbolValue::ValueType::Float) {
+        if (reg > 0 && reg < 16) {
+          SET_UINT(savefloatregs, reg);
+        }
+      } else if (reg > 0 && reg < 4) {
+        SET_UINT(saveintregs, reg);
+      } else if (reg == IP_REGID) {
+        saveip = true;
+      }
+    };
+    auto live_out = func_context_.call_live_out_.find(tac.get());
+    if (tac->operation_ == TACOperationType::CallAndReturn) {
+      //调用之后直接返回，没有需要保存的
+    } else if (live_out == func_context_.call_live_out_.end()) {
+      //没有活跃信息，全部保存
+      saveintregs = 0xe;
+      savefloatregs = 0xfffe;
+      saveip = true;
+    } else {
+      for (auto &sym : live_out->second) {
+        mark_saved(sym);
+      }
+    }
+    //库函数可能改写ip，用户函数自己会保存（调用了库函数的函数在入口处保存了ip）
+    if (func_context_.global_anchor_reg_ == IP_REGID && tac->operation_ != TACOperationType::CallAndReturn) {
+      saveip = true;
+    }
+    if (tac->b_->IsGlobal()) {
+      saveip = false;
+    }
+
+    std::vector<std::pair<int, int>> float_save_ranges;
+    int save_reg_size = 0;
+    if (saveintregs) {
+      std::string inst = "push {";
+      bool first = true;
+      for (int i = 1; i < 4; i++) {
+        if (ISSET_UINT(saveintregs, i)) {
+          inst += (first ? "" : ", ") + IntRegIDToName(i);
+          first = false;
+          save_reg_size += 4;
+        }
+      }
+      emitln(inst + "}");
+    }
+    for (int i = 1; i < 16; i++) {
+      if (!ISSET_UINT(savefloatregs, i)) {
+        continue;
+      }
+      if (!float_save_ranges.empty() && float_save_ranges.back().second == i - 1) {
+        float_save_ranges.back().second = i;
+      } else {
+        float_save_ranges.emplace_back(i, i);
+      }
+    }
+    for (auto &range : float_save_ranges) {
+      if (range.first == range.second) {
+        emitln("vpush {" + FloatRegIDToName(range.first) + "}");
+      } else {
+        emitln("vpush {" + FloatRegIDToName(range.first) + "-" + FloatRegIDToName(range.second) + "}");
+      }
+      save_reg_size += 4 * (range.second - range.first + 1);
+    }
+    if (saveip) {
       emitln("push {ip}");
       save_reg_size += 4;
     }
@@ -1140,214 +1532,55 @@ std::string ArmBuilder::FuncTACToASMString(TACPtr tac) {
     //因为让栈8对齐，这里检查一下并对齐
     if (sumstack % 8 != 0) {
       padding = true;
-      emitln("sub sp, sp, #4");
-      func_context_.stack_size_for_args_ += 4;
     }
 
-    //先把所有栈上的压了，反向压栈。
-    for (auto it = func_context_.arg_records_.rbegin(); it != func_context_.arg_records_.rend(); ++it) {
-      if (it->storage_in_reg) {
-        continue;
-      }
-      if (it->isaddr) {
-        //一定是数组才能取地址
-        assert(it->sym->value_.Type() == SymbolValue::ValueType::Array);
-        auto arrayDescriptor = it->sym->value_.GetArrayDescriptor();
-        auto basesym = arrayDescriptor->base_addr.lock();
-        auto offsym = arrayDescriptor->base_offset;
-        int basereg = alloc_reg(basesym);
-        int offreg = alloc_reg(offsym, basereg);
-        //如果basesym分配在栈空间，result可以复用basereg
-        if (symbol_reg(basesym) == -1) {
-          emitln("add " + IntRegIDToName(basereg) + ", " + IntRegIDToName(basereg) + ", " + IntRegIDToName(offreg) +
-                 ", LSL #2");
-          emitln("push {" + IntRegIDToName(basereg) + "}");
-          func_context_.stack_size_for_args_ += 4;
-          if (basereg == 0) {
-            // assert(func_context_.int_freereg1_ == basesym);
-            func_context_.int_freereg1_ = nullptr;
-          } else {
-            // assert(func_context_.int_freereg2_ == basesym);
-            func_context_.int_freereg2_ = nullptr;
-          }
-        } else {
-          //否则basesym分配在寄存器，需要再申请一个reg储存结果
-          int resreg = (offreg == 0 ? func_context_.func_attr_.attr.used_regs.intReservedReg : 0);
-          evit_int_reg(resreg);
-          emitln("add " + IntRegIDToName(resreg) + ", " + IntRegIDToName(basereg) + ", " + IntRegIDToName(offreg) +
-                 ", LSL #2");
-          emitln("push {" + IntRegIDToName(resreg) + "}");
-          func_context_.stack_size_for_args_ += 4;
-        }
-      } else {
-        int reg = alloc_reg(it->sym);
-        if (it->sym->value_.Type() == SymbolValue::ValueType::Float) {
-          emitln("vpush {" + FloatRegIDToName(reg) + "}");
-          func_context_.stack_size_for_args_ += 4;
-        } else {
-          emitln("push {" + IntRegIDToName(reg) + "}");
-          func_context_.stack_size_for_args_ += 4;
-        }
+    //一次留出栈上实参(和对齐)的空间，实参直接写到各自的位置
+    uint32_t argstacksize = nstackarg * 4 + (padding ? 4 : 0);
+    if (!ArmHelper::EmitImmediateInstWithCheck(emitln, "sub", "sp", "sp", argstacksize)) {
+      for (auto value : ArmHelper::DivideIntoImmediateValues(argstacksize)) {
+        emitln("sub sp, sp, #" + std::to_string(value));
       }
     }
+    func_context_.stack_size_for_args_ += argstacksize;
+    store_stack_args();
 
     //然后处理寄存器
-    //先让float的全压了，因为是倒序，保证了s0最后处理
-    for (auto it = func_context_.arg_records_.rbegin(); it != func_context_.arg_records_.rend(); ++it) {
-      if (!it->storage_in_reg) {
-        continue;
-      }
-      if (it->sym->value_.Type() != SymbolValue::ValueType::Float) {
-        continue;
-      }
-      int reg = symbol_reg(it->sym);
-      if (reg == -1) {
-        reg = alloc_reg(it->sym);
-      }
-      //需要特殊处理会被寄存器传参用到的寄存器位置的变量
-      if (reg > 0 && reg < 16) {
-        //从栈上定位一下
-        int regoffset;
-        {
-          //压栈的顺序是倒过来的，所以是16 - reg ，前面的3是因为前面有3个通用寄存器压栈
-          int nth = 3 + 16 - reg;
-          regoffset = func_context_.stack_size_for_args_ - nth * 4;
-        }
-        if (ArmHelper::IsLDRSTRImmediateValue(regoffset)) {
-          emitln("vldr " + FloatRegIDToName(it->storage_pos) + ", [sp, #" + std::to_string(regoffset) + "]");
-        } else {
-          auto divides = ArmHelper::DivideIntoImmediateValues(regoffset);
-          for (auto val : divides) {
-            emitln("add sp, sp, #" + std::to_string(val));
-          }
-          emitln("vldr " + FloatRegIDToName(it->storage_pos) + ", [sp]");
-          for (auto val : divides) {
-            emitln("sub sp, sp, #" + std::to_string(val));
-          }
-        }
-      } else if (it->storage_pos != reg) {
-        emitln("vmov " + FloatRegIDToName(it->storage_pos) + ", " + FloatRegIDToName(reg));
-      }
-    }
-    auto read_intreg_from_stack = [&, this](int src_regid, int dst_regid) -> void {
-      //一定要是栈上的才行
-      assert(src_regid > 0 && src_regid < 4);
-      //压栈的顺序是倒过来的，所以是4 - reg
-      int nth = 4 - src_regid;
-      int offset = func_context_.stack_size_for_args_ - nth * 4;
-      if (ArmHelper::IsLDRSTRImmediateValue(offset)) {
-        emitln("ldr " + IntRegIDToName(dst_regid) + ", [sp, #" + std::to_string(offset) + "]");
-      } else {
-        emitln("ldr " + IntRegIDToName(dst_regid) + ", =" + std::to_string(offset));
-        emitln("ldr " + IntRegIDToName(dst_regid) + ", [sp, " + IntRegIDToName(dst_regid) + "]");
-      }
-    };
-    for (auto it = func_context_.arg_records_.rbegin(); it != func_context_.arg_records_.rend(); ++it) {
-      if (!it->storage_in_reg) {
-        continue;
-      }
-      if (it->sym->value_.Type() == SymbolValue::ValueType::Float) {
-        continue;
-      }
-      if (it->isaddr) {
-        assert(it->sym->value_.Type() == SymbolValue::ValueType::Array);
-        auto arrayDescriptor = it->sym->value_.GetArrayDescriptor();
-        auto basesym = arrayDescriptor->base_addr.lock();
-        auto offsym = arrayDescriptor->base_offset;
-        int basereg = symbol_reg(basesym);
-        bool basesym_on_stack = false;
-        if (basereg == -1) {
-          basesym_on_stack = true;
-          basereg = alloc_reg(it->sym);
-        }
-        int offreg = symbol_reg(offsym);
-        if (offreg == -1) {
-          offreg = alloc_reg(offsym, basereg);
-        }
-        //如果basesym分配在栈空间，result可以复用basereg
-        if (basesym_on_stack) {
-          //处理一下offreg从栈中读取
-          if (0 < offreg && offreg < 4) {
-            evit_int_reg(basereg == 0);
-            int freeintreg = get_free_int_reg();
-            read_intreg_from_stack(offreg, freeintreg);
-            offreg = freeintreg;
-          }
-          emitln("add " + IntRegIDToName(basereg) + ", " + IntRegIDToName(basereg) + ", " + IntRegIDToName(offreg) +
-                 ", LSL #2");
-          if (basereg != it->storage_pos) {
-            emitln("mov " + IntRegIDToName(it->storage_pos) + ", " + IntRegIDToName(basereg));
-          }
-          if (basereg == 0) {
-            // assert(func_context_.int_freereg1_ == basesym);
-            func_context_.int_freereg1_ = nullptr;
-          } else {
-            // assert(func_context_.int_freereg2_ == basesym);
-            func_context_.int_freereg2_ = nullptr;
-          }
-        } else {
-          //否则basesym分配在寄存器，需要再申请一个reg储存结果
-          int resreg = (offreg == 0 ? func_context_.func_attr_.attr.used_regs.intReservedReg : 0);
-          evit_int_reg(resreg);
-
-          //处理一下basereg从栈中读取
-          if (0 < basereg && basereg < 4) {
-            read_intreg_from_stack(basereg, resreg);
-            basereg = resreg;
-          }
-
-          //处理一下offreg从栈中读取
-          if (0 < offreg && offreg < 4) {
-            evit_int_reg(resreg == 0);
-            int freeintreg = get_free_int_reg();
-            read_intreg_from_stack(offreg, freeintreg);
-            offreg = freeintreg;
-          }
-
-          emitln("add " + IntRegIDToName(resreg) + ", " + IntRegIDToName(basereg) + ", " + IntRegIDToName(offreg) +
-                 ", LSL #2");
-          if (resreg != it->storage_pos) {
-            emitln("mov " + IntRegIDToName(it->storage_pos) + ", " + IntRegIDToName(resreg));
-          }
-        }
-      } else {
-        int reg = symbol_reg(it->sym);
-        if (reg == -1) {
-          reg = alloc_reg(it->sym);
-        }
-        //需要特殊处理会被寄存器传参用到的寄存器位置的变量
-        if (reg > 0 && reg < 4) {
-          read_intreg_from_stack(reg, it->storage_pos);
-        } else if (reg != it->storage_pos) {
-          emitln("mov " + IntRegIDToName(it->storage_pos) + ", " + IntRegIDToName(reg));
-        }
-      }
-    }
+    setup_reg_args();
 
     //可以call了
-    evit_all_freereg();
     emitln("bl " + tac->b_->get_tac_name(true));
 
     //去掉所有栈上arg
-    uint32_t toaddstack = padding ? 4 : 0;
-    toaddstack += nstackarg * 4;
-    if (!ArmHelper::EmitImmediateInstWithCheck(emitln, "add", "sp", "sp", toaddstack)) {
-      auto splitaddstack = ArmHelper::DivideIntoImmediateValues(toaddstack);
-      for (auto value : splitaddstack) {
+    if (!ArmHelper::EmitImmediateInstWithCheck(emitln, "add", "sp", "sp", argstacksize)) {
+      for (auto value : ArmHelper::DivideIntoImmediateValues(argstacksize)) {
         emitln("add sp, sp, #" + std::to_string(value));
       }
     }
-    func_context_.stack_size_for_args_ -= toaddstack;
+    func_context_.stack_size_for_args_ -= argstacksize;
 
     //恢复寄存器
 
-    //如果是库函数，还原一下ip
-    if (!tac->b_->IsGlobal()) {
+    if (saveip) {
       emitln("pop {ip}");
     }
-
-    emitln("vpop {s1-s15}");
-    emitln("pop {r1-r3}");
+    for (auto range = float_save_ranges.rbegin(); range != float_save_ranges.rend(); ++range) {
+      if (range->first == range->second) {
+        emitln("vpop {" + FloatRegIDToName(range->first) + "}");
+      } else {
+        emitln("vpop {" + FloatRegIDToName(range->first) + "-" + FloatRegIDToName(range->second) + "}");
+      }
+    }
+    if (saveintregs) {
+      std::string inst = "pop {";
+      bool first = true;
+      for (int i = 1; i < 4; i++) {
+        if (ISSET_UINT(saveintregs, i)) {
+          inst += (first ? "" : ", ") + IntRegIDToName(i);
+          first = false;
+        }
+      }
+      emitln(inst + "}");
+    }
 
     func_context_.stack_size_for_args_ -= save_reg_size;
 
@@ -1381,25 +1614,8 @@ std::string ArmBuilder::FuncTACToASMString(TACPtr tac) {
     func_context_.arg_records_.clear();
   };
 
-  auto do_return = [&, this]() -> void {
-    evit_all_freereg();
-    if (tac->a_ != nullptr) {
-      //设置返回值
-      int retreg = alloc_reg(tac->a_);
-      //为0的话就不用倒腾了
-      if (retreg != 0) {
-        if (tac->a_->value_.Type() == SymbolValue::ValueType::Float) {
-          emitln("vmov s0, " + FloatRegIDToName(retreg));
-        } else {
-          emitln("mov r0, " + IntRegIDToName(retreg));
-        }
-      }
-      func_context_.int_freereg1_ = nullptr;
-      func_context_.int_freereg2_ = nullptr;
-      func_context_.float_freereg1_ = nullptr;
-      func_context_.float_freereg2_ = nullptr;
-    }
-
+  //释放栈帧并还原保存的寄存器。pop_pc时用pc代替lr出栈直接返回，返回是否已经返回
+  auto release_frame = [&, this](bool pop_pc) -> bool {
     //释放变量栈空间
     for (auto immval : func_context_.var_stack_immvals_) {
       bool check = ArmHelper::EmitImmediateInstWithCheck(emitln, "add", "sp", "sp", immval);
@@ -1417,9 +1633,8 @@ std::string ArmBuilder::FuncTACToASMString(TACPtr tac) {
     }
 
     //还原通用寄存器
-    bool pop_pc = false;
-    if (Contains(func_context_.saveintregs_, LR_REGID) && !Contains(func_context_.saveintregs_, PC_REGID)) {
-      pop_pc = true;
+    if (!Contains(func_context_.saveintregs_, LR_REGID) || Contains(func_context_.saveintregs_, PC_REGID)) {
+      pop_pc = false;
     }
     if (!func_context_.saveintregs_.empty()) {
       std::string inst = "pop {";
@@ -1436,335 +1651,59 @@ std::string ArmBuilder::FuncTACToASMString(TACPtr tac) {
       inst += "}";
       emitln(inst);
     }
-    if (!pop_pc) {
-      //没有用栈来pop lr到sp位置
-      emitln("bx lr");
-    }
+    return pop_pc;
   };
 
-  auto do_call_return = [&, this]() -> void {
-    //初始化一下
-    func_context_.stack_size_for_args_ = 0;
+  auto do_return = [&, this]() -> void {
     evit_all_freereg();
-    //先压栈吧
-    emitln("push {r1-r3}");
-    emitln("vpush {s1-s15}");
-    //全压！这是刚才压了的寄存器的大小
-    int save_reg_size = 3 * 4 + 15 * 4;
-    
-    func_context_.stack_size_for_args_ += save_reg_size;
-    int nstackarg = 0;
-    for (auto &record : func_context_.arg_records_) {
-      if (!record.storage_in_reg) {
-        nstackarg++;
-      }
-    }
-    // //计算一下总大小
-    // size_t sumstack = 0;
-    // bool padding = false;
-    // sumstack += nstackarg * 4;
-    // sumstack += func_context_.stack_size_for_args_;
-    // sumstack += func_context_.stack_size_for_regsave_;
-    // sumstack += func_context_.stack_size_for_vars_;
-    // //因为让栈8对齐，这里检查一下并对齐
-    // if (sumstack % 8 != 0) {
-    //   padding = true;
-    //   emitln("sub sp, sp, #4");
-    //   func_context_.stack_size_for_args_ += 4;
-    // }
-    //记录一下栈开头位置
-    int stack_start_of_args = func_context_.stack_size_for_args_;
-
-    //先把所有栈上的压了，反向压栈。
-    for (auto it = func_context_.arg_records_.rbegin(); it != func_context_.arg_records_.rend(); ++it) {
-      if (it->storage_in_reg) {
-        continue;
-      }
-      if (it->isaddr) {
-        //一定是数组才能取地址
-        assert(it->sym->value_.Type() == SymbolValue::ValueType::Array);
-        auto arrayDescriptor = it->sym->value_.GetArrayDescriptor();
-        auto basesym = arrayDescriptor->base_addr.lock();
-        auto offsym = arrayDescriptor->base_offset;
-        int basereg = alloc_reg(basesym);
-        int offreg = alloc_reg(offsym, basereg);
-        //如果basesym分配在栈空间，result可以复用basereg
-        if (symbol_reg(basesym) == -1) {
-          emitln("add " + IntRegIDToName(basereg) + ", " + IntRegIDToName(basereg) + ", " + IntRegIDToName(offreg) +
-                 ", LSL #2");
-          emitln("push {" + IntRegIDToName(basereg) + "}");
-          func_context_.stack_size_for_args_ += 4;
-          if (basereg == 0) {
-            // assert(func_context_.int_freereg1_ == basesym);
-            func_context_.int_freereg1_ = nullptr;
-          } else {
-            // assert(func_context_.int_freereg2_ == basesym);
-            func_context_.int_freereg2_ = nullptr;
-          }
-        } else {
-          //否则basesym分配在寄存器，需要再申请一个reg储存结果
-          int resreg = (offreg == 0 ? func_context_.func_attr_.attr.used_regs.intReservedReg : 0);
-          evit_int_reg(resreg);
-          emitln("add " + IntRegIDToName(resreg) + ", " + IntRegIDToName(basereg) + ", " + IntRegIDToName(offreg) +
-                 ", LSL #2");
-          emitln("push {" + IntRegIDToName(resreg) + "}");
-          func_context_.stack_size_for_args_ += 4;
-        }
-      } else {
-        int reg = alloc_reg(it->sym);
-        if (it->sym->value_.Type() == SymbolValue::ValueType::Float) {
-          emitln("vpush {" + FloatRegIDToName(reg) + "}");
-          func_context_.stack_size_for_args_ += 4;
-        } else {
-          emitln("push {" + IntRegIDToName(reg) + "}");
-          func_context_.stack_size_for_args_ += 4;
-        }
-      }
-    }
-
-    //然后处理寄存器
-    //先让float的全压了，因为是倒序，保证了s0最后处理
-    for (auto it = func_context_.arg_records_.rbegin(); it != func_context_.arg_records_.rend(); ++it) {
-      if (!it->storage_in_reg) {
-        continue;
-      }
-      if (it->sym->value_.Type() != SymbolValue::ValueType::Float) {
-        continue;
-      }
-      int reg = symbol_reg(it->sym);
-      if (reg == -1) {
-        reg = alloc_reg(it->sym);
-      }
-      //需要特殊处理会被寄存器传参用到的寄存器位置的变量
-      if (reg > 0 && reg < 16) {
-        //从栈上定位一下
-        int regoffset;
-        {
-          //压栈的顺序是倒过来的，所以是16 - reg ，前面的3是因为前面有3个通用寄存器压栈
-          int nth = 3 + 16 - reg;
-          regoffset = func_context_.stack_size_for_args_ - nth * 4;
-        }
-        if (ArmHelper::IsLDRSTRImmediateValue(regoffset)) {
-          emitln("vldr " + FloatRegIDToName(it->storage_pos) + ", [sp, #" + std::to_string(regoffset) + "]");
-        } else {
-          auto divides = ArmHelper::DivideIntoImmediateValues(regoffset);
-          for (auto val : divides) {
-            emitln("add sp, sp, #" + std::to_string(val));
-          }
-          emitln("vldr " + FloatRegIDToName(it->storage_pos) + ", [sp]");
-          for (auto val : divides) {
-            emitln("sub sp, sp, #" + std::to_string(val));
-          }
-        }
-      } else if (it->storage_pos != reg) {
-        emitln("vmov " + FloatRegIDToName(it->storage_pos) + ", " + FloatRegIDToName(reg));
-      }
-    }
-    auto read_intreg_from_stack = [&, this](int src_regid, int dst_regid) -> void {
-      //一定要是栈上的才行
-      assert(src_regid > 0 && src_regid < 4);
-      //压栈的顺序是倒过来的，所以是4 - reg
-      int nth = 4 - src_regid;
-      int offset = func_context_.stack_size_for_args_ - nth * 4;
-      if (ArmHelper::IsLDRSTRImmediateValue(offset)) {
-        emitln("ldr " + IntRegIDToName(dst_regid) + ", [sp, #" + std::to_string(offset) + "]");
-      } else {
-        emitln("ldr " + IntRegIDToName(dst_regid) + ", =" + std::to_string(offset));
-        emitln("ldr " + IntRegIDToName(dst_regid) + ", [sp, " + IntRegIDToName(dst_regid) + "]");
-      }
-    };
-    for (auto it = func_context_.arg_records_.rbegin(); it != func_context_.arg_records_.rend(); ++it) {
-      if (!it->storage_in_reg) {
-        continue;
-      }
-      if (it->sym->value_.Type() == SymbolValue::ValueType::Float) {
-        continue;
-      }
-      if (it->isaddr) {
-        assert(it->sym->value_.Type() == SymbolValue::ValueType::Array);
-        auto arrayDescriptor = it->sym->value_.GetArrayDescriptor();
-        auto basesym = arrayDescriptor->base_addr.lock();
-        auto offsym = arrayDescriptor->base_offset;
-        int basereg = symbol_reg(basesym);
-        bool basesym_on_stack = false;
-        if (basereg == -1) {
-          basesym_on_stack = true;
-          basereg = alloc_reg(it->sym);
-        }
-        int offreg = symbol_reg(offsym);
-        if (offreg == -1) {
-          offreg = alloc_reg(offsym, basereg);
-        }
-        //如果basesym分配在栈空间，result可以复用basereg
-        if (basesym_on_stack) {
-          //处理一下offreg从栈中读取
-          if (0 < offreg && offreg < 4) {
-            evit_int_reg(basereg == 0);
-            int freeintreg = get_free_int_reg();
-            read_intreg_from_stack(offreg, freeintreg);
-            offreg = freeintreg;
-          }
-          emitln("add " + IntRegIDToName(basereg) + ", " + IntRegIDToName(basereg) + ", " + IntRegIDToName(offreg) +
-                 ", LSL #2");
-          if (basereg != it->storage_pos) {
-            emitln("mov " + IntRegIDToName(it->storage_pos) + ", " + IntRegIDToName(basereg));
-          }
-          if (basereg == 0) {
-            // assert(func_context_.int_freereg1_ == basesym);
-            func_context_.int_freereg1_ = nullptr;
-          } else {
-            // assert(func_context_.int_freereg2_ == basesym);
-            func_context_.int_freereg2_ = nullptr;
-          }
+    if (tac->a_ != nullptr) {
+      //设置返回值
+      int retreg = alloc_reg(tac->a_);
+      //为0的话就不用倒腾了
+      if (retreg != 0) {
+        if (tac->a_->value_.Type() == SymbolValue::ValueType::Float) {
+          emitln("vmov s0, " + FloatRegIDToName(retreg));
         } else {
-          //否则basesym分配在寄存器，需要再申请一个reg储存结果
-          int resreg = (offreg == 0 ? func_context_.func_attr_.attr.used_regs.intReservedReg : 0);
-          evit_int_reg(resreg);
-
-          //处理一下basereg从栈中读取
-          if (0 < basereg && basereg < 4) {
-            read_intreg_from_stack(basereg, resreg);
-            basereg = resreg;
-          }
-
-          //处理一下offreg从栈中读取
-          if (0 < offreg && offreg < 4) {
-            evit_int_reg(resreg == 0);
-            int freeintreg = get_free_int_reg();
-            read_intreg_from_stack(offreg, freeintreg);
-            offreg = freeintreg;
-          }
-
-          emitln("add " + IntRegIDToName(resreg) + ", " + IntRegIDToName(basereg) + ", " + IntRegIDToName(offreg) +
-                 ", LSL #2");
-          if (resreg != it->storage_pos) {
-            emitln("mov " + IntRegIDToName(it->storage_pos) + ", " + IntRegIDToName(resreg));
-          }
-        }
-      } else {
-        int reg = symbol_reg(it->sym);
-        if (reg == -1) {
-          reg = alloc_reg(it->sym);
-        }
-        //需要特殊处理会被寄存器传参用到的寄存器位置的变量
-        if (reg > 0 && reg < 4) {
-          read_intreg_from_stack(reg, it->storage_pos);
-        } else if (reg != it->storage_pos) {
-          emitln("mov " + IntRegIDToName(it->storage_pos) + ", " + IntRegIDToName(reg));
-        }
-      }
-    }
-
-    //挪一下栈。
-    func_context_.int_freereg1_ = nullptr;
-    func_context_.int_freereg2_ = nullptr;
-    func_context_.float_freereg1_ = nullptr;
-    func_context_.float_freereg2_ = nullptr;
-
-    //把当前所有栈都退掉，推到本函数保存寄存器处
-    {
-      int totalsize = func_context_.stack_size_for_args_ + func_context_.stack_size_for_vars_;
-      if (!ArmHelper::EmitImmediateInstWithCheck(emitln, "add", "sp", "sp", totalsize)) {
-        auto pieces = ArmHelper::DivideIntoImmediateValues(totalsize);
-        for (auto val : pieces) {
-          emitln("add sp, sp, #" + std::to_string(val));
-        }
-      }
-    }
-
-    //还原寄存器
-    //还原浮点寄存器
-    for (auto regid : func_context_.savefloatregs_) {
-      if (regid.first == regid.second) {
-        emitln("vpop { " + FloatRegIDToName(regid.first) + " }");
-      } else {
-        emitln("vpop { " + FloatRegIDToName(regid.first) + "-" + FloatRegIDToName(regid.second) + " }");
-      }
-    }
-
-    //还原通用寄存器
-    if (!func_context_.saveintregs_.empty()) {
-      std::string inst = "pop {";
-      for (size_t i = 0; i < func_context_.saveintregs_.size(); i++) {
-        inst += IntRegIDToName(func_context_.saveintregs_[i]);
-        if (i + 1 < func_context_.saveintregs_.size()) {
-          inst += ", ";
+          emitln("mov r0, " + IntRegIDToName(retreg));
         }
       }
-      inst += "}";
-      emitln(inst);
+      func_context_.int_freereg1_ = nullptr;
+      func_context_.int_freereg2_ = nullptr;
+      func_context_.float_freereg1_ = nullptr;
+      func_context_.float_freereg2_ = nullptr;
     }
 
-    // bool padding = false;
-    //回到函数参数前端，留三位置放寄存器
-    {
-      stack_start_of_args -= 3 * 4;
-      //对齐一下
-      if ((func_context_.stack_size_for_args_ - stack_start_of_args) % 8 != 0) {
-        // padding = true;
-        stack_start_of_args -= 4;
-      }
-      int totalsize = func_context_.stack_size_for_regsave_ + func_context_.stack_size_for_vars_ + stack_start_of_args;
-      if (!ArmHelper::EmitImmediateInstWithCheck(emitln, "sub", "sp", "sp", totalsize)) {
-        auto pieces = ArmHelper::DivideIntoImmediateValues(totalsize);
-        for (auto val : pieces) {
-          emitln("sub sp, sp, #" + std::to_string(val));
-        }
-      }
+    if (!release_frame(true)) {
+      //没有用栈来pop lr到sp位置
+      emitln("bx lr");
     }
-    //保存三寄存器用来临时倒腾
-    emitln("push {fp, ip, lr}");
-    //重新回到顶部
-    emitln("add sp, sp, #12");
-
-    //这是真实参数栈大小
-    int real_stack_args_size = (int)func_context_.stack_size_for_args_ - stack_start_of_args;
-
-
-    //现在开始挪动，可以自由使用ip和fp寄存器
-    int count = real_stack_args_size / 4;
-    int move_distance =
-        (int)func_context_.stack_size_for_regsave_ + (int)func_context_.stack_size_for_vars_ + stack_start_of_args;
+  };
 
-    //将fp置为本函数开头位置
-    if (!ArmHelper::EmitImmediateInstWithCheck(emitln, "add", "fp", "sp", move_distance)) {
-      auto pieces = ArmHelper::DivideIntoImmediateValues(move_distance);
-      for (auto val : pieces) {
-        emitln("add fp, sp, #" + std::to_string(val));
+  //调用的返回值直接作为本函数的返回值。
+  //参数都通过寄存器传递的用户函数：传好参数、释放栈帧后直接跳过去，由它返回到本函数的调用者。
+  //库函数可能改写ip，需要栈上传参的调用要用到本函数栈帧之上的空间，这两种按普通调用后返回处理
+  auto do_call_return = [&, this]() -> void {
+    bool tail = tac->b_->IsGlobal();
+    for (auto &record : func_context_.arg_records_) {
+      if (!record.storage_in_reg) {
+        tail = false;
       }
     }
-    if (count > 0) {
-      emitln("ldr lr, =" + std::to_string(count));
-      std::string loop_label = "_call_ret_loop_" + std::to_string(++this->counter);
-      emitln(loop_label + ":");
-      emitln("ldr ip, [sp, #-4]!");
-      emitln("str ip, [fp, #-4]!");
-      emitln("subs lr, #1");
-      emitln("bgt " + loop_label);
-    }
-    emitln("mov sp, fp");
-
-    //可以call了
-    emitln("bl " + tac->b_->get_tac_name(true));
-
-    //现在把sp放到参数前
-    {
-      int delta_distance = real_stack_args_size - 12;
-      if (!ArmHelper::EmitImmediateInstWithCheck(emitln, "add", "sp", "sp", delta_distance)) {
-        emitln("ldr lr, =" + std::to_string(delta_distance));
-        emitln("add sp, sp, lr");
-      }
+    if (!tail) {
+      do_call();
+      do_return();
+      return;
     }
-
-    // pop pc 代替 pop lr  然后 bx lr
-    emitln("pop {fp, ip, pc}");
-
-    // emitln("bx lr");
+    func_context_.stack_size_for_args_ = 0;
+    evit_all_freereg();
+    setup_reg_args();
+    release_frame(false);
+    emitln("b " + tac->b_->get_tac_name(true));
 
     func_context_.arg_nfloatregs_ = 0;
     func_context_.arg_nintregs_ = 0;
     func_context_.arg_stacksize_ = 0;
-    func_context_.arg_records_.clear();    
+    func_context_.arg_records_.clear();
   };
 
   auto functionality = [&, this]() -> void {
@@ -1808,7 +1747,9 @@ std::string ArmBuilder::FuncTACToASMString(TACPtr tac) {
         break;
       }
       case TACOperationType::Call: {
-        do_call();
+        if (!inline_clear()) {
+          do_call();
+        }
         break;
       }
 
@@ -1827,13 +1768,26 @@ std::string ArmBuilder::FuncTACToASMString(TACPtr tac) {
   };
 
   auto array_declaration = [&, this]() -> void {
+    if (static_arrays_.count(tac->a_)) {
+      ArmHelper::EmitLoadAddress(emitln, IntRegIDToName(alloc_reg(tac->a_)), GetVariableName(tac->a_));
+      return;
+    }
     auto arrayAttr = func_context_.reg_alloc_->get_ArrayAttribute(tac->a_);
     int reg = alloc_reg(tac->a_);
     int32_t realoffset = arrayAttr.value + func_context_.stack_size_for_args_;
-    if (!ArmHelper::EmitImmediateInstWithCheck(emitln, "add", IntRegIDToName(reg), "sp", realoffset)) {
-      emitln("ldr " + IntRegIDToName(reg) + ", =" + std::to_string(realoffset));
-      emitln("add " + IntRegIDToName(reg) + ", sp, " + IntRegIDToName(reg));
+    if (ArmHelper::EmitImmediateInstWithCheck(emitln, "add", IntRegIDToName(reg), "sp", realoffset)) {
+      return;
     }
+    //靠近栈帧顶部的大数组相对帧基址寄存器可能只需一条sub
+    if (func_context_.frame_base_reg_ != -1) {
+      int32_t fboffset = func_context_.stack_size_for_vars_ + func_context_.stack_size_for_regsave_ - arrayAttr.value;
+      if (ArmHelper::EmitImmediateInstWithCheck(emitln, "sub", IntRegIDToName(reg),
+                                                IntRegIDToName(func_context_.frame_base_reg_), fboffset)) {
+        return;
+      }
+    }
+    ArmHelper::EmitLoadImmediate(emitln, IntRegIDToName(reg), realoffset);
+    emitln("add " + IntRegIDToName(reg) + ", sp, " + IntRegIDToName(reg));
   };
 
   auto cast_operation = [&, this]() -> void {
@@ -1857,6 +1811,74 @@ std::string ArmBuilder::FuncTACToASMString(TACPtr tac) {
     }
   };
 
+  //输出指令选择器选中的合并指令
+  auto selected_operation = [&, this](const SelectedPattern &pattern) -> void {
+    using Kind = SelectedPattern::Kind;
+    switch (pattern.kind_) {
+      case Kind::MulAdd:
+      case Kind::MulSub: {
+        auto regs = alloc_operands({pattern.src1_, pattern.src2_, pattern.acc_});
+        int dstreg = alloc_reg(pattern.dst_, -1, true);
+        emitln(std::string(pattern.kind_ == Kind::MulAdd ? "mla " : "mls ") + IntRegIDToName(dstreg) + ", " +
+               IntRegIDToName(regs[0]) + ", " + IntRegIDToName(regs[1]) + ", " + IntRegIDToName(regs[2]));
+        break;
+      }
+      case Kind::ShiftAdd:
+      case Kind::ShiftSub:
+      case Kind::ShiftRsb: {
+        auto regs = alloc_operands({pattern.acc_, pattern.src1_});
+        int dstreg = alloc_reg(pattern.dst_, -1, true);
+        std::string op = (pattern.kind_ == Kind::ShiftAdd ? "add " : (pattern.kind_ == Kind::ShiftSub ? "sub " : "rsb "));
+        std::string shift = (pattern.imm_ ? ", LSL #" + std::to_string(pattern.imm_) : "");
+        emitln(op + IntRegIDToName(dstreg) + ", " + IntRegIDToName(regs[0]) + ", " + IntRegIDToName(regs[1]) + shift);
+        break;
+      }
+      case Kind::FloatMulAdd:
+      case Kind::FloatMulSub: {
+        //目标就是累加量，直接在其寄存器上累加
+        auto regs = alloc_operands({pattern.src1_, pattern.src2_, pattern.acc_});
+        emitln(std::string(pattern.kind_ == Kind::FloatMulAdd ? "vmla.f32 " : "vmls.f32 ") +
+               FloatRegIDToName(regs[2]) + ", " + FloatRegIDToName(regs[0]) + ", " + FloatRegIDToName(regs[1]));
+        break;
+      }
+      case Kind::AddImm:
+      case Kind::RsbImm:
+      case Kind::ShiftImm: {
+        int srcreg = alloc_operands({pattern.src1_})[0];
+        int dstreg = alloc_reg(pattern.dst_, -1, true);
+        std::string operands = IntRegIDToName(dstreg) + ", " + IntRegIDToName(srcreg);
+        if (pattern.kind_ == Kind::RsbImm) {
+          emitln("rsb " + operands + ", #" + std::to_string(pattern.imm_));
+        } else if (pattern.imm_ == 0) {
+          emitln("mov " + operands);
+        } else if (pattern.kind_ == Kind::ShiftImm) {
+          emitln("lsl " + operands + ", #" + std::to_string(pattern.imm_));
+        } else if (ArmHelper::IsImmediateValue(pattern.imm_)) {
+          emitln("add " + operands + ", #" + std::to_string(pattern.imm_));
+        } else {
+          emitln("sub " + operands + ", #" + std::to_string(-pattern.imm_));
+        }
+        break;
+      }
+      default:
+        throw std::logic_error("Unknown selected pattern");
+    }
+  };
+
+  if (func_context_.selector_ != nullptr) {
+    if (func_context_.selector_->IsFolded(tac)) {
+      //已经合并到后面的指令中
+      func_context_.parameter_head_ = false;
+      return ret;
+    }
+    auto pattern = func_context_.selector_->GetPattern(tac);
+    if (pattern != nullptr) {
+      func_context_.parameter_head_ = false;
+      selected_operation(*pattern);
+      return ret;
+    }
+  }
+
   switch (tac->operation_) {
     case TACOperationType::Add:
     case TACOperationType::Div:
@@ -8,19 +8,17 @@
 #include "MagicEnum.hh"
 #include "TAC/TAC.hh"
 
+extern int IDIV_flag;
+
 namespace HaveFunCompiler {
 namespace AssemblyBuilder {
 using namespace HaveFunCompiler::ThreeAddressCode;
 
 std::string ArmBuilder::GlobalTACToASMString([[maybe_unused]] TACPtr tac) {
   std::string ret = "";
-  auto emitln = [&ret, this](const std::string &inst) -> void {
+  auto emitln = [&ret](const std::string &inst) -> void {
     ret.append(inst);
     ret.append("\n");
-    data_pool_distance_ += ArmHelper::CountLines(inst) + 1;
-    if (data_pool_distance_ > DATA_POOL_DISTANCE_THRESHOLD) {
-      ret += EndCurrentDataPool();
-    }
   };
   //来个注释好了
   emitln("// " + tac->ToString());
@@ -63,7 +61,7 @@ std::string ArmBuilder::GlobalTACToASMString([[maybe_unused]] TACPtr tac) {
       if (target_sym->value_.Type() != SymbolValue::ValueType::Array) {
         //用了一个正常时候用不到的寄存器当临时寄存器。
         int otherreg = glob_context_.USE_INT_REG_NUM;
-        emitln("ldr " + IntRegIDToName(otherreg) + ", " + ToDataRefName(GetVariableName(target_sym)));
+        ArmHelper::EmitLoadAddress(emitln, IntRegIDToName(otherreg), GetVariableName(target_sym));
         emitln("str " + IntRegIDToName(reg_id) + ", [" + IntRegIDToName(otherreg) + "]");
       }
       target_sym = nullptr;
@@ -76,7 +74,7 @@ std::string ArmBuilder::GlobalTACToASMString([[maybe_unused]] TACPtr tac) {
     } else {
       //如果不能直接做，借用ip来完成
       int otherreg = glob_context_.USE_INT_REG_NUM;
-      emitln("ldr " + IntRegIDToName(otherreg) + ", =" + std::to_string(realoffset));
+      ArmHelper::EmitLoadImmediate(emitln, IntRegIDToName(otherreg), realoffset);
       emitln("str " + IntRegIDToName(reg_id) + ", [sp, " + IntRegIDToName(otherreg) + "]");
     }
     target_sym = nullptr;
@@ -102,7 +100,7 @@ std::string ArmBuilder::GlobalTACToASMString([[maybe_unused]] TACPtr tac) {
     if (!target_sym->IsGlobalTemp()) {
       //用了一个正常时候用不到的寄存器当临时寄存器。
       int otherreg = glob_context_.USE_INT_REG_NUM;
-      emitln("ldr " + IntRegIDToName(otherreg) + ", " + ToDataRefName(GetVariableName(target_sym)));
+      ArmHelper::EmitLoadAddress(emitln, IntRegIDToName(otherreg), GetVariableName(target_sym));
       emitln("vstr " + FloatRegIDToName(reg_id) + ", [" + IntRegIDToName(otherreg) + "]");
       target_sym = nullptr;
       return;
@@ -114,7 +112,7 @@ std::string ArmBuilder::GlobalTACToASMString([[maybe_unused]] TACPtr tac) {
     } else {
       //如果不能直接做，借用ip来完成
       int otherreg = glob_context_.USE_INT_REG_NUM;
-      emitln("ldr " + IntRegIDToName(otherreg) + ", =" + std::to_string(realoffset));
+      ArmHelper::EmitLoadImmediate(emitln, IntRegIDToName(otherreg), realoffset);
       emitln("vstr " + FloatRegIDToName(reg_id) + ", [sp, " + IntRegIDToName(otherreg) + "]");
     }
     target_sym = nullptr;
@@ -170,7 +168,7 @@ std::string ArmBuilder::GlobalTACToASMString([[maybe_unused]] TACPtr tac) {
     int target_regid = -1;
     int target_regpos = -1;
     int i, backpos, back;
-    if (hint_regid != -1) {
+    if (hint_regid == -1) {
       for (i = glob_context_.USE_FLOAT_REG_NUM - 1; i >= 0; i--) {
         if (i != except_reg && glob_context_.float_regs_[i] == nullptr) {
           target_regid = i;
@@ -246,13 +244,13 @@ std::string ArmBuilder::GlobalTACToASMString([[maybe_unused]] TACPtr tac) {
         if (!no_load) {
           if (sym->IsLiteral()) {
             int otherreg = glob_context_.USE_INT_REG_NUM;
-            emitln("ldr " + IntRegIDToName(otherreg) +
-                   ", =" + std::to_string(ArmHelper::BitcastToUInt(sym->value_.GetFloat())));
+            ArmHelper::EmitLoadImmediate(emitln, IntRegIDToName(otherreg),
+                                         ArmHelper::BitcastToUInt(sym->value_.GetFloat()));
             emitln("vmov " + FloatRegIDToName(regid) + ", " + IntRegIDToName(otherreg));
           } else if (!sym->IsGlobalTemp()) {
             //是全局变量
             int otherreg = glob_context_.USE_INT_REG_NUM;
-            emitln("ldr " + IntRegIDToName(otherreg) + ", " + ToDataRefName(GetVariableName(sym)));
+            ArmHelper::EmitLoadAddress(emitln, IntRegIDToName(otherreg), GetVariableName(sym));
             emitln("vldr " + FloatRegIDToName(regid) + ", [" + IntRegIDToName(otherreg) + "]");
           } else {
             //是全局临时变量
@@ -261,7 +259,7 @@ std::string ArmBuilder::GlobalTACToASMString([[maybe_unused]] TACPtr tac) {
               emitln("vldr " + FloatRegIDToName(regid) + ", [sp, #" + std::to_string(realoffset) + "]");
             } else {
               int otherreg = glob_context_.USE_INT_REG_NUM;
-              emitln("ldr " + IntRegIDToName(otherreg) + ", =" + std::to_string(realoffset));
+              ArmHelper::EmitLoadImmediate(emitln, IntRegIDToName(otherreg), realoffset);
               emitln("vldr " + FloatRegIDToName(regid) + ", [sp, " + IntRegIDToName(otherreg) + "]");
             }
           }
@@ -294,13 +292,9 @@ std::string ArmBuilder::GlobalTACToASMString([[maybe_unused]] TACPtr tac) {
         if (!no_load) {
           if (sym->IsLiteral()) {
             int val = sym->value_.GetInt();
-            if (ArmHelper::IsImmediateValue(val)) {
-              emitln("mov " + IntRegIDToName(regid) + ", #" + std::to_string(val));
-            } else {
-              emitln("ldr " + IntRegIDToName(regid) + ", =" + std::to_string(val));
-            }
+            ArmHelper::EmitLoadImmediate(emitln, IntRegIDToName(regid), val);
           } else if (!sym->IsGlobalTemp()) {
-            emitln("ldr " + IntRegIDToName(regid) + ", " + ToDataRefName(GetVariableName(sym)));
+            ArmHelper::EmitLoadAddress(emitln, IntRegIDToName(regid), GetVariableName(sym));
             if (sym->value_.Type() != SymbolValue::ValueType::Array) {
               emitln("ldr " + IntRegIDToName(regid) + ", [" + IntRegIDToName(regid) + "]");
             }
@@ -309,7 +303,7 @@ std::string ArmBuilder::GlobalTACToASMString([[maybe_unused]] TACPtr tac) {
             if (ArmHelper::IsLDRSTRImmediateValue(realoffset)) {
               emitln("ldr " + IntRegIDToName(regid) + ", [sp, #" + std::to_string(realoffset) + "]");
             } else {
-              emitln("ldr " + IntRegIDToName(regid) + ", =" + std::to_string(realoffset));
+              ArmHelper::EmitLoadImmediate(emitln, IntRegIDToName(regid), realoffset);
               emitln("ldr " + IntRegIDToName(regid) + ", [sp, " + IntRegIDToName(regid) + "]");
             }
           }
@@ -372,6 +366,16 @@ std::string ArmBuilder::GlobalTACToASMString([[maybe_unused]] TACPtr tac) {
   auto int_divmod_operation = [&, this]() -> void {
     int op1reg = alloc_reg(tac->b_);
     int op2reg = alloc_reg(tac->c_, op1reg);
+    if (IDIV_flag) {
+      // main开头保存过lr，用来放结果
+      emitln("sdiv lr, " + IntRegIDToName(op1reg) + ", " + IntRegIDToName(op2reg));
+      if (tac->operation_ == TACOperationType::Mod) {
+        emitln("mls lr, lr, " + IntRegIDToName(op2reg) + ", " + IntRegIDToName(op1reg));
+      }
+      int regid = alloc_reg(tac->a_, -1, -1, true);
+      emitln("mov " + IntRegIDToName(regid) + ", lr");
+      return;
+    }
     evit_int_reg(0);
     emitln("push {r1-r3}");
     if (op1reg < op2reg) {
@@ -454,7 +458,7 @@ std::string ArmBuilder::GlobalTACToASMString([[maybe_unused]] TACPtr tac) {
     } else if (!tac->a_->IsGlobalTemp()) {
       int dstreg = get_free_int_reg();
       int valreg;
-      emitln("ldr " + IntRegIDToName(dstreg) + ", " + ToDataRefName(GetVariableName(tac->a_)));
+      ArmHelper::EmitLoadAddress(emitln, IntRegIDToName(dstreg), GetVariableName(tac->a_));
       if (tac->a_->value_.Type() == SymbolValue::ValueType::Float) {
         valreg = alloc_reg(tac->b_);
         for (int i = 0; i < glob_context_.USE_FLOAT_REG_NUM; i++) {
@@ -635,7 +639,7 @@ std::string ArmBuilder::GlobalTACToASMString([[maybe_unused]] TACPtr tac) {
     } else {
       auto splitaddstack = ArmHelper::DivideIntoImmediateValues(toaddstack);
       int otherreg = glob_context_.USE_INT_REG_NUM;
-      emitln("ldr " + IntRegIDToName(otherreg) + ", =" + std::to_string(toaddstack));
+      ArmHelper::EmitLoadImmediate(emitln, IntRegIDToName(otherreg), toaddstack);
       emitln("add sp, sp, " + IntRegIDToName(otherreg));
     }
     glob_context_.stack_size_for_args_ -= toaddstack;
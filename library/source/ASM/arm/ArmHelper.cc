@@ -95,6 +95,28 @@ int ArmHelper::CountLines(const std::string &str) {
   return ret;
 }
 
+void ArmHelper::EmitLoadImmediate(std::function<void(const std::string &)> emitln, const std::string &reg,
+                                  uint32_t value) {
+  if (IsImmediateValue(value)) {
+    emitln("mov " + reg + ", #" + std::to_string(value));
+    return;
+  }
+  if (IsImmediateValue(~value)) {
+    emitln("mvn " + reg + ", #" + std::to_string(~value));
+    return;
+  }
+  emitln("movw " + reg + ", #" + std::to_string(value & 0xffffU));
+  if (value >> 16) {
+    emitln("movt " + reg + ", #" + std::to_string(value >> 16));
+  }
+}
+
+void ArmHelper::EmitLoadAddress(std::function<void(const std::string &)> emitln, const std::string &reg,
+                                const std::string &symbol) {
+  emitln("movw " + reg + ", #:lower16:" + symbol);
+  emitln("movt " + reg + ", #:upper16:" + symbol);
+}
+
 bool ArmHelper::EmitImmediateInstWithCheck(std::function<void(const std::string &)> emitln,
                                            const std::string &operation, const std::string &operand1,
                                            const std::string &operand2, int imm, const std::string suffix) {
@@ -124,5 +146,62 @@ bool ArmHelper::EmitImmediateInstWithCheck(std::function<void(const std::string
   return false;
 }
 
+std::vector<ParallelMove> ArmHelper::SequentializeParallelMoves(std::vector<ParallelMove> moves,
+                                                                const std::vector<int> &scratches) {
+  std::vector<ParallelMove> ret;
+  std::vector<int> written;
+  //除了except之外的赋值中读reg的个数
+  auto count_readers = [&moves](int reg, size_t except) -> int {
+    int cnt = 0;
+    for (size_t i = 0; i < moves.size(); i++) {
+      if (i != except) {
+        cnt += std::count(moves[i].srcs.begin(), moves[i].srcs.end(), reg);
+      }
+    }
+    return cnt;
+  };
+  while (!moves.empty()) {
+    bool found = false;
+    for (size_t i = 0; i < moves.size(); i++) {
+      if (count_readers(moves[i].dst, i) == 0) {
+        written.push_back(moves[i].dst);
+        ret.push_back(moves[i]);
+        moves.erase(moves.begin() + i);
+        found = true;
+        break;
+      }
+    }
+    if (found) {
+      continue;
+    }
+    //成环了，从被读得最多的dst处断开
+    size_t victim = 0;
+    for (size_t i = 1; i < moves.size(); i++) {
+      if (count_readers(moves[i].dst, i) > count_readers(moves[victim].dst, victim)) {
+        victim = i;
+      }
+    }
+    int reg = moves[victim].dst;
+    int scratch = -1;
+    for (auto s : scratches) {
+      if (s != reg && count_readers(s, moves.size()) == 0 &&
+          std::find(written.begin(), written.end(), s) == written.end()) {
+        scratch = s;
+        break;
+      }
+    }
+    if (scratch == -1) {
+      throw std::logic_error("SequentializeParallelMoves: no free scratch register");
+    }
+    ret.push_back({scratch, {reg}, -1});
+    for (size_t i = 0; i < moves.size(); i++) {
+      if (i != victim) {
+        std::replace(moves[i].srcs.begin(), moves[i].srcs.end(), reg, scratch);
+      }
+    }
+  }
+  return ret;
+}
+
 }  // namespace AssemblyBuilder
 }  // namespace HaveFunCompiler
\ No newline at end of file
@@ -0,0 +1,480 @@
+#include "ASM/arm/ArmInst.hh"
+#include <algorithm>
+#include <cctype>
+#include <sstream>
+#include "Utility.hh"
+
+namespace HaveFunCompiler {
+namespace AssemblyBuilder {
+
+namespace {
+//按长度从长到短排列，保证最长匹配
+const std::vector<std::string> &BaseOpcodes() {
+  static std::vector<std::string> opcodes = [] {
+    std::vector<std::string> ret = {
+        "mov",   "mvn",   "add",   "sub",   "rsb",   "and",   "orr",   "eor",   "bic",   "adc",   "sbc",
+        "mul",   "mla",   "mls",   "sdiv",  "udiv",  "smull", "umull", "smmul", "neg",   "lsl",   "lsr",
+        "asr",   "ror",   "cmp",   "cmn",   "tst",   "teq",   "movw",  "movt",  "b",     "bl",    "bx",
+        "blx",   "push",  "pop",   "ldr",   "str",   "ldrb",  "strb",  "ldm",   "stm",   "ldmia", "stmia",
+        "ldmdb", "stmdb", "vadd",  "vsub",  "vmul",  "vdiv",  "vneg",  "vmla",  "vmls",  "vmov",  "vcmp",
+        "vmrs",  "vldr",  "vstr",  "vpush", "vpop",  "vcvt",  "vldm",  "vstm",  "vldmia", "vstmia", "vst1",
+        "vld1",  "vdup",  "nop"};
+    std::sort(ret.begin(), ret.end(),
+              [](const std::string &a, const std::string &b) { return a.length() > b.length(); });
+    return ret;
+  }();
+  return opcodes;
+}
+
+const std::vector<std::string> &CondCodes() {
+  static std::vector<std::string> conds = {"eq", "ne", "cs", "hs", "cc", "lo", "mi", "pl", "vs",
+                                           "vc", "hi", "ls", "ge", "lt", "gt", "le", "al"};
+  return conds;
+}
+
+bool CanSetFlags(const std::string &opcode) {
+  static std::vector<std::string> ops = {"mov", "mvn", "add", "sub", "rsb", "and", "orr", "eor", "bic",
+                                         "adc", "sbc", "mul", "mla", "neg", "lsl", "lsr", "asr", "ror"};
+  return Contains(ops, opcode);
+}
+
+std::string Trim(const std::string &str) {
+  size_t l = 0, r = str.length();
+  while (l < r && isspace(static_cast<unsigned char>(str[l]))) l++;
+  while (r > l && isspace(static_cast<unsigned char>(str[r - 1]))) r--;
+  return str.substr(l, r - l);
+}
+
+std::string ToLower(std::string str) {
+  for (auto &c : str) {
+    c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+  }
+  return str;
+}
+
+//按不在[]和{}中的逗号切分
+std::vector<std::string> SplitOperands(const std::string &str) {
+  std::vector<std::string> ret;
+  std::string cur;
+  int depth = 0;
+  for (auto c : str) {
+    if (c == '[' || c == '{') {
+      depth++;
+    } else if (c == ']' || c == '}') {
+      depth--;
+    }
+    if (c == ',' && depth == 0) {
+      ret.push_back(Trim(cur));
+      cur.clear();
+    } else {
+      cur += c;
+    }
+  }
+  cur = Trim(cur);
+  if (!cur.empty()) {
+    ret.push_back(cur);
+  }
+  return ret;
+}
+
+//从操作数原文中取出所有寄存器
+void CollectRegs(const std::string &operand, std::vector<std::string> *regs) {
+  if (!operand.empty() && operand[0] == '{') {
+    for (auto &reg : ArmInst::ExpandRegList(operand)) {
+      regs->push_back(reg);
+    }
+    return;
+  }
+  std::string token;
+  auto flush = [&]() -> void {
+    auto reg = ArmInst::NormalizeRegName(token);
+    if (!reg.empty()) {
+      regs->push_back(reg);
+    }
+    token.clear();
+  };
+  for (auto c : operand) {
+    if (isalnum(static_cast<unsigned char>(c)) || c == '_') {
+      token += c;
+    } else {
+      flush();
+    }
+  }
+  flush();
+}
+
+bool IsLoadOpcode(const std::string &opcode) { return opcode == "ldr" || opcode == "ldrb" || opcode == "vldr"; }
+
+bool IsStoreOpcode(const std::string &opcode) { return opcode == "str" || opcode == "strb" || opcode == "vstr"; }
+
+//访存指令是否会回写基址寄存器：[rn, #x]! 或 [rn], #x
+bool HasWriteBack(const ArmInst &inst) {
+  if (inst.operands_.size() < 2) {
+    return false;
+  }
+  auto &addr = inst.operands_[1];
+  if (addr.empty() || addr[0] != '[') {
+    return false;
+  }
+  return addr.back() == '!' || inst.operands_.size() > 2;
+}
+
+std::string BaseRegOf(const std::string &addr) {
+  std::vector<std::string> regs;
+  auto end = addr.find_first_of(",]");
+  CollectRegs(addr.substr(0, end), &regs);
+  return regs.empty() ? "" : regs[0];
+}
+}  // namespace
+
+std::string ArmInst::NormalizeRegName(const std::string &name) {
+  auto reg = ToLower(Trim(name));
+  if (reg == "fp" || reg == "r11") return "fp";
+  if (reg == "ip" || reg == "r12") return "ip";
+  if (reg == "sp" || reg == "r13") return "sp";
+  if (reg == "lr" || reg == "r14") return "lr";
+  if (reg == "pc" || reg == "r15") return "pc";
+  if (reg.length() < 2 || reg.length() > 3) {
+    return "";
+  }
+  if (reg[0] != 'r' && reg[0] != 's' && reg[0] != 'd' && reg[0] != 'q') {
+    return "";
+  }
+  for (size_t i = 1; i < reg.length(); i++) {
+    if (!isdigit(static_cast<unsigned char>(reg[i]))) {
+      return "";
+    }
+  }
+  int id = std::stoi(reg.substr(1));
+  int limit = (reg[0] == 'r' ? 11 : (reg[0] == 'q' ? 16 : 32));
+  if (id >= limit) {
+    return "";
+  }
+  return reg;
+}
+
+std::vector<std::string> ArmInst::ExpandRegList(const std::string &operand) {
+  std::vector<std::string> ret;
+  auto body = Trim(operand);
+  if (!body.empty() && body.front() == '{') body = body.substr(1);
+  if (!body.empty() && body.back() == '}') body.pop_back();
+  for (auto &item : SplitOperands(body)) {
+    auto dash = item.find('-');
+    if (dash == std::string::npos) {
+      auto reg = NormalizeRegName(item);
+      if (!reg.empty()) {
+        ret.push_back(reg);
+      }
+      continue;
+    }
+    auto first = NormalizeRegName(item.substr(0, dash));
+    auto last = NormalizeRegName(item.substr(dash + 1));
+    if (first.empty() || last.empty()) {
+      continue;
+    }
+    auto regid = [](const std::string &reg) -> int {
+      static const std::vector<std::string> special = {"fp", "ip", "sp", "lr", "pc"};
+      for (size_t i = 0; i < special.size(); i++) {
+        if (reg == special[i]) return 11 + i;
+      }
+      return std::stoi(reg.substr(1));
+    };
+    char cls = (first[0] == 's' || first[0] == 'd' || first[0] == 'q') ? first[0] : 'r';
+    for (int i = regid(first); i <= regid(last); i++) {
+      ret.push_back(NormalizeRegName(std::string(1, cls) + std::to_string(i)));
+    }
+  }
+  return ret;
+}
+
+ArmInst ArmInst::Parse(const std::string &line) {
+  ArmInst inst;
+  auto str = Trim(line);
+  if (str.empty() || str.compare(0, 2, "//") == 0 || str[0] == '@') {
+    inst.kind_ = Kind::Comment;
+    inst.text_ = str;
+    return inst;
+  }
+  if (str[0] == '.') {
+    inst.kind_ = Kind::Directive;
+    inst.text_ = str;
+    return inst;
+  }
+  auto colon = str.find(':');
+  if (colon != std::string::npos && str.find_first_of(" \t,[{") > colon) {
+    //行尾只有冒号的是标签，冒号后仍有内容的（如数据引用）整体当作伪指令
+    inst.kind_ = (colon + 1 == str.length() ? Kind::Label : Kind::Directive);
+    inst.text_ = (inst.kind_ == Kind::Label ? str.substr(0, colon) : str);
+    return inst;
+  }
+  auto space = str.find_first_of(" \t");
+  auto mnemonic = ToLower(str.substr(0, space));
+  if (space != std::string::npos) {
+    inst.operands_ = SplitOperands(str.substr(space + 1));
+  }
+  auto dot = mnemonic.find('.');
+  if (dot != std::string::npos) {
+    inst.datatype_ = mnemonic.substr(dot);
+    mnemonic = mnemonic.substr(0, dot);
+  }
+  for (auto &base : BaseOpcodes()) {
+    if (mnemonic.compare(0, base.length(), base) != 0) {
+      continue;
+    }
+    auto rest = mnemonic.substr(base.length());
+    bool matched = false;
+    if (rest.empty()) {
+      matched = true;
+    } else if (Contains(CondCodes(), rest)) {
+      inst.cond_ = rest;
+      matched = true;
+    } else if (rest[0] == 's' && CanSetFlags(base) && (rest.length() == 1 || Contains(CondCodes(), rest.substr(1)))) {
+      inst.set_flags_ = true;
+      inst.cond_ = rest.substr(1);
+      matched = true;
+    }
+    if (matched) {
+      inst.opcode_ = base;
+      if (inst.cond_ == "al") {
+        inst.cond_.clear();
+      }
+      return inst;
+    }
+  }
+  //未知指令，原样保存
+  inst.opcode_ = mnemonic;
+  return inst;
+}
+
+ArmInst ArmInst::MakeInst(const std::string &opcode, const std::vector<std::string> &operands,
+                          const std::string &cond) {
+  auto dot = opcode.find('.');
+  ArmInst inst;
+  inst.opcode_ = opcode.substr(0, dot);
+  if (dot != std::string::npos) {
+    inst.datatype_ = opcode.substr(dot);
+  }
+  inst.operands_ = operands;
+  inst.cond_ = cond;
+  return inst;
+}
+
+std::string ArmInst::Mnemonic() const { return opcode_ + (set_flags_ ? "s" : "") + cond_ + datatype_; }
+
+std::string ArmInst::ToString() const {
+  switch (kind_) {
+    case Kind::Label:
+      return text_ + ":";
+    case Kind::Directive:
+    case Kind::Comment:
+      return text_;
+    default:
+      break;
+  }
+  std::string ret = Mnemonic();
+  for (size_t i = 0; i < operands_.size(); i++) {
+    ret += (i == 0 ? " " : ", ");
+    ret += operands_[i];
+  }
+  return ret;
+}
+
+bool ArmInst::IsKnown() const { return IsInstruction() && Contains(BaseOpcodes(), opcode_); }
+
+bool ArmInst::IsCall() const { return IsInstruction() && (opcode_ == "bl" || opcode_ == "blx"); }
+
+bool ArmInst::IsBranch() const {
+  if (!IsInstruction()) {
+    return false;
+  }
+  if (opcode_ == "b" || opcode_ == "bl" || opcode_ == "bx" || opcode_ == "blx") {
+    return true;
+  }
+  return DefinesReg("pc");
+}
+
+bool ArmInst::IsUnconditionalJump() const {
+  if (!IsInstruction() || IsConditional() || IsCall()) {
+    return false;
+  }
+  return opcode_ == "b" || opcode_ == "bx" || DefinesReg("pc");
+}
+
+bool ArmInst::WritesMemory() const {
+  if (!IsInstruction()) {
+    return false;
+  }
+  if (!IsKnown() || IsCall()) {
+    return true;
+  }
+  return IsStoreOpcode(opcode_) || opcode_ == "push" || opcode_ == "vpush" || opcode_.compare(0, 3, "stm") == 0 ||
+         opcode_.compare(0, 4, "vstm") == 0 || opcode_ == "vst1";
+}
+
+std::vector<std::string> ArmInst::GetUseRegs() const {
+  std::vector<std::string> ret;
+  if (!IsInstruction()) {
+    return ret;
+  }
+  if (opcode_ == "b") {
+    return ret;
+  }
+  if (IsCall()) {
+    //调用约定：参数寄存器和sp被读
+    ret = {"r0", "r1", "r2", "r3", "sp"};
+    for (int i = 0; i < 16; i++) {
+      ret.push_back("s" + std::to_string(i));
+    }
+    if (opcode_ == "blx") {
+      CollectRegs(operands_[0], &ret);
+    }
+    return ret;
+  }
+  if (opcode_ == "push" || opcode_ == "vpush" || opcode_ == "pop" || opcode_ == "vpop") {
+    ret.push_back("sp");
+    if (opcode_ == "push" || opcode_ == "vpush") {
+      CollectRegs(operands_[0], &ret);
+    }
+    return ret;
+  }
+  if (opcode_.compare(0, 3, "ldm") == 0 || opcode_.compare(0, 4, "vldm") == 0) {
+    CollectRegs(operands_[0], &ret);
+    return ret;
+  }
+  if (opcode_.compare(0, 3, "stm") == 0 || opcode_.compare(0, 4, "vstm") == 0) {
+    for (auto &operand : operands_) {
+      CollectRegs(operand, &ret);
+    }
+    return ret;
+  }
+  bool pure_def = false;
+  if (IsLoadOpcode(opcode_)) {
+    pure_def = true;
+    //ldr r0, =imm 与 ldr r0, label 都不读寄存器
+    if (operands_.size() >= 2 && !operands_[1].empty() && operands_[1][0] != '[') {
+      if (IsConditional()) {
+        CollectRegs(operands_[0], &ret);
+      }
+      return ret;
+    }
+  } else if (!IsStoreOpcode(opcode_) && opcode_ != "cmp" && opcode_ != "cmn" && opcode_ != "tst" &&
+             opcode_ != "teq" && opcode_ != "vcmp" && opcode_ != "bx" && opcode_ != "vmrs" && opcode_ != "vst1" &&
+             opcode_ != "nop" && IsKnown()) {
+    pure_def = true;
+  }
+  for (size_t i = 0; i < operands_.size(); i++) {
+    //纯定义的目标寄存器只有在条件执行或部分写入时才算被读
+    if (i == 0 && pure_def && !IsConditional() && opcode_ != "movt") {
+      continue;
+    }
+    CollectRegs(operands_[i], &ret);
+  }
+  //两操作数形式的运算，如 subs r1, #1，目标同时也是源
+  if (pure_def && operands_.size() == 2 && !IsLoadOpcode(opcode_) && opcode_ != "mov" && opcode_ != "mvn" &&
+      opcode_ != "vmov" && opcode_ != "movw" && opcode_ != "movt" && opcode_ != "neg" && opcode_ != "vneg" &&
+      opcode_ != "vcvt" && opcode_ != "vdup") {
+    CollectRegs(operands_[0], &ret);
+  }
+  return ret;
+}
+
+std::vector<std::string> ArmInst::GetDefRegs() const {
+  std::vector<std::string> ret;
+  if (!IsInstruction() || opcode_ == "b" || opcode_ == "nop") {
+    return ret;
+  }
+  if (IsCall()) {
+    //调用者保存的寄存器都可能被改写
+    ret = {"r0", "r1", "r2", "r3", "ip", "lr"};
+    for (int i = 0; i < 16; i++) {
+      ret.push_back("s" + std::to_string(i));
+    }
+    return ret;
+  }
+  if (opcode_ == "push" || opcode_ == "vpush") {
+    return {"sp"};
+  }
+  if (opcode_ == "pop" || opcode_ == "vpop") {
+    ret.push_back("sp");
+    CollectRegs(operands_[0], &ret);
+    return ret;
+  }
+  if (opcode_.compare(0, 3, "ldm") == 0 || opcode_.compare(0, 4, "vldm") == 0 || opcode_.compare(0, 3, "stm") == 0 ||
+      opcode_.compare(0, 4, "vstm") == 0) {
+    if (!operands_.empty() && !operands_[0].empty() && operands_[0].back() == '!') {
+      CollectRegs(operands_[0], &ret);
+    }
+    if (opcode_[0] == 'l' || opcode_.compare(0, 4, "vldm") == 0) {
+      CollectRegs(operands_[1], &ret);
+    }
+    return ret;
+  }
+  if (opcode_ == "cmp" || opcode_ == "cmn" || opcode_ == "tst" || opcode_ == "teq" || opcode_ == "vcmp" ||
+      opcode_ == "bx" || opcode_ == "vmrs") {
+    return ret;
+  }
+  if (opcode_ == "vst1") {
+    if (operands_.size() > 1 && operands_[1].back() == '!') {
+      ret.push_back(BaseRegOf(operands_[1].substr(1)));
+    }
+    return ret;
+  }
+  if (IsStoreOpcode(opcode_)) {
+    if (HasWriteBack(*this)) {
+      ret.push_back(BaseRegOf(operands_[1].substr(1)));
+    }
+    return ret;
+  }
+  if (!IsKnown()) {
+    return ret;
+  }
+  if (!operands_.empty()) {
+    CollectRegs(operands_[0], &ret);
+    if (opcode_ == "smull" || opcode_ == "umull") {
+      CollectRegs(operands_[1], &ret);
+    }
+  }
+  if (IsLoadOpcode(opcode_) && HasWriteBack(*this)) {
+    ret.push_back(BaseRegOf(operands_[1].substr(1)));
+  }
+  return ret;
+}
+
+bool ArmInst::UsesReg(const std::string &reg) const {
+  if (IsInstruction() && !IsKnown()) {
+    return true;
+  }
+  return Contains(GetUseRegs(), reg);
+}
+
+bool ArmInst::DefinesReg(const std::string &reg) const {
+  if (IsInstruction() && !IsKnown()) {
+    return true;
+  }
+  return Contains(GetDefRegs(), reg);
+}
+
+ArmInstList ParseArmInstList(const std::string &text) {
+  ArmInstList ret;
+  std::istringstream iss(text);
+  std::string line;
+  while (std::getline(iss, line)) {
+    if (line.empty()) {
+      continue;
+    }
+    ret.push_back(ArmInst::Parse(line));
+  }
+  return ret;
+}
+
+std::string ArmInstListToString(const ArmInstList &insts) {
+  std::string ret;
+  for (auto &inst : insts) {
+    ret += inst.ToString();
+    ret += "\n";
+  }
+  return ret;
+}
+
+}  // namespace AssemblyBuilder
+}  // namespace HaveFunCompiler
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "ASM/arm/FunctionContext.hh"
+#include "ASM/arm/InstructionSelector.hh"
 #include "ASM/arm/RegAllocator.hh"
 #include "MacroUtil.hh"
 
@@ -25,6 +26,10 @@ void FunctionContext::SetUp() {
   func_attr_ = {};
   parameter_head_ = true;
   reg_alloc_ = nullptr;
+  selector_ = nullptr;
+  global_anchor_reg_ = -1;
+  frame_base_reg_ = -1;
+  call_live_out_.clear();
   int_freereg1_ = nullptr;
   int_freereg2_ = nullptr;
   float_freereg1_ = nullptr;
@@ -36,6 +41,8 @@ void FunctionContext::SetUp() {
 
 void FunctionContext::TearDown() {
   delete reg_alloc_;
+  delete selector_;
+  call_live_out_.clear();
   int_freereg1_ = nullptr;
   int_freereg2_ = nullptr;
   float_freereg1_ = nullptr;
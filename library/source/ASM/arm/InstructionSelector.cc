@@ -0,0 +1,264 @@
+#include "ASM/arm/InstructionSelector.hh"
+#include <algorithm>
+#include <climits>
+#include "ASM/arm/ArmHelper.hh"
+#include "ASM/arm/RegAllocator.hh"
+#include "TAC/Symbol.hh"
+
+namespace HaveFunCompiler {
+namespace AssemblyBuilder {
+using namespace ThreeAddressCode;
+
+namespace {
+//操作数为字面量时要先mov到寄存器，浮点字面量还要再vmov一次
+int OperandCost(const SymbolPtr &sym) {
+  if (!sym->IsLiteral()) {
+    return 0;
+  }
+  return sym->value_.Type() == SymbolValue::ValueType::Float ? 2 : 1;
+}
+
+//原有模板翻译一条tac的大致指令数
+int FallbackCost(const TACPtr &tac) {
+  switch (tac->operation_) {
+    case TACOperationType::Add:
+    case TACOperationType::Sub:
+    case TACOperationType::Mul:
+      return 1 + OperandCost(tac->b_) + OperandCost(tac->c_);
+    default:
+      return 1;
+  }
+}
+
+bool IsPositivePowerOf2(const SymbolPtr &sym) {
+  if (!sym->IsLiteral() || sym->value_.Type() != SymbolValue::ValueType::Int) {
+    return false;
+  }
+  int val = sym->value_.GetInt();
+  return val > 0 && ArmHelper::IsPowerOf2(val);
+}
+
+bool IsIntLiteral(const SymbolPtr &sym) {
+  return sym->IsLiteral() && sym->value_.Type() == SymbolValue::ValueType::Int;
+}
+}  // namespace
+
+InstructionSelector::InstructionSelector(TACList::iterator fbegin, TACList::iterator fend, RegAllocator *reg_alloc)
+    : fbegin_(fbegin), fend_(fend), reg_alloc_(reg_alloc) {}
+
+void InstructionSelector::select() {
+  CountUseDef();
+  for (auto it = fbegin_; it != fend_;) {
+    SelectedPattern pattern;
+    int len = MatchAt(it, &pattern);
+    if (len == 0) {
+      ++it;
+      continue;
+    }
+    for (int i = 1; i < len; i++, ++it) {
+      folded_.insert(it->get());
+    }
+    patterns_.emplace(it->get(), pattern);
+    ++it;
+  }
+}
+
+bool InstructionSelector::IsFolded(const TACPtr &tac) const { return folded_.count(tac.get()) != 0; }
+
+const SelectedPattern *InstructionSelector::GetPattern(const TACPtr &tac) const {
+  auto it = patterns_.find(tac.get());
+  if (it == patterns_.end()) {
+    return nullptr;
+  }
+  return &it->second;
+}
+
+void InstructionSelector::CountUseDef() {
+  for (auto it = fbegin_; it != fend_; ++it) {
+    auto defsym = (*it)->getDefineSym();
+    if (defsym) {
+      def_count_[defsym]++;
+    }
+    for (auto &sym : (*it)->getUseSym()) {
+      use_count_[sym]++;
+    }
+  }
+}
+
+bool InstructionSelector::IsSingleUseTemp(const SymbolPtr &sym) const {
+  if (sym->IsLiteral() || sym->IsGlobal() || sym->value_.Type() == SymbolValue::ValueType::Array) {
+    return false;
+  }
+  auto use = use_count_.find(sym);
+  auto def = def_count_.find(sym);
+  return use != use_count_.end() && use->second == 1 && def != def_count_.end() && def->second == 1;
+}
+
+bool InstructionSelector::IsIntScalar(const SymbolPtr &sym) const {
+  return sym && sym->value_.Type() == SymbolValue::ValueType::Int;
+}
+
+bool InstructionSelector::IsFloatScalar(const SymbolPtr &sym) const {
+  return sym && sym->value_.Type() == SymbolValue::ValueType::Float;
+}
+
+int InstructionSelector::CountNonRegOperands(const std::vector<SymbolPtr> &syms) const {
+  std::vector<SymbolPtr> counted;
+  for (auto &sym : syms) {
+    bool inreg = false;
+    if (!sym->IsLiteral() && !sym->IsGlobal()) {
+      auto attr = reg_alloc_->get_SymAttribute(sym);
+      inreg = (attr.attr.store_type == attr.INT_REG || attr.attr.store_type == attr.FLOAT_REG);
+    }
+    if (!inreg && std::find(counted.begin(), counted.end(), sym) == counted.end()) {
+      counted.push_back(sym);
+    }
+  }
+  return counted.size();
+}
+
+bool InstructionSelector::MatchCopyTail(TACList::iterator it, const SymbolPtr &result, SymbolPtr *dst) {
+  *dst = result;
+  if (it == fend_ || (*it)->operation_ != TACOperationType::Assign || (*it)->b_ != result) {
+    return false;
+  }
+  auto target = (*it)->a_;
+  if (target->IsGlobal() || target->value_.Type() != result->value_.Type() || !IsSingleUseTemp(result)) {
+    return false;
+  }
+  *dst = target;
+  return true;
+}
+
+int InstructionSelector::MatchAt(TACList::iterator it, SelectedPattern *pattern) {
+  auto tac = *it;
+  bool is_arith = tac->operation_ == TACOperationType::Add || tac->operation_ == TACOperationType::Sub ||
+                  tac->operation_ == TACOperationType::Mul;
+  if (!is_arith || tac->a_->value_.Type() == SymbolValue::ValueType::Array) {
+    return 0;
+  }
+  //候选模式：覆盖的tac数，合并后的代价，以及用原有模板翻译这些tac的代价
+  struct Candidate {
+    SelectedPattern pattern;
+    int len;
+    int cost;
+    int fallback;
+  };
+  std::vector<Candidate> candidates;
+  auto next = std::next(it);
+
+  //两层的树：t = x * y 后紧跟使用t的加减
+  if (tac->operation_ == TACOperationType::Mul && next != fend_ && IsSingleUseTemp(tac->a_) &&
+      ((*next)->operation_ == TACOperationType::Add || (*next)->operation_ == TACOperationType::Sub) &&
+      ((*next)->b_ == tac->a_ || (*next)->c_ == tac->a_) && (*next)->a_->value_.Type() == tac->a_->value_.Type()) {
+    auto consumer = *next;
+    bool t_is_lhs = (consumer->b_ == tac->a_);
+    auto acc = t_is_lhs ? consumer->c_ : consumer->b_;
+    auto x = tac->b_;
+    auto y = tac->c_;
+    SymbolPtr dst;
+    bool tail = MatchCopyTail(std::next(next), consumer->a_, &dst);
+    int len = tail ? 3 : 2;
+    int fallback = FallbackCost(tac) + FallbackCost(consumer) + (tail ? 1 : 0);
+    bool is_add = consumer->operation_ == TACOperationType::Add;
+
+    if (IsIntScalar(tac->a_) && IsIntScalar(acc) && IsIntScalar(x) && IsIntScalar(y)) {
+      if (IsPositivePowerOf2(x)) {
+        std::swap(x, y);
+      }
+      if (IsPositivePowerOf2(y) && !x->IsLiteral() && CountNonRegOperands({x, acc}) <= 2) {
+        SelectedPattern shift;
+        shift.kind_ = is_add ? SelectedPattern::Kind::ShiftAdd
+                             : (t_is_lhs ? SelectedPattern::Kind::ShiftRsb : SelectedPattern::Kind::ShiftSub);
+        shift.dst_ = dst;
+        shift.src1_ = x;
+        shift.acc_ = acc;
+        shift.imm_ = ArmHelper::Log2(y->value_.GetInt());
+        candidates.push_back({shift, len, 1 + OperandCost(acc), fallback});
+      }
+      if ((is_add || !t_is_lhs) && CountNonRegOperands({x, y, acc}) <= 2) {
+        SelectedPattern mla;
+        mla.kind_ = is_add ? SelectedPattern::Kind::MulAdd : SelectedPattern::Kind::MulSub;
+        mla.dst_ = dst;
+        mla.src1_ = x;
+        mla.src2_ = y;
+        mla.acc_ = acc;
+        candidates.push_back({mla, len, 1 + OperandCost(x) + OperandCost(y) + OperandCost(acc), fallback});
+      }
+    } else if (IsFloatScalar(tac->a_) && IsFloatScalar(acc) && IsFloatScalar(x) && IsFloatScalar(y)) {
+      // vmla/vmls累加到目标寄存器上，只有目标就是累加量时才划算
+      if ((is_add || !t_is_lhs) && dst == acc && CountNonRegOperands({x, y, acc}) <= 2) {
+        SelectedPattern vmla;
+        vmla.kind_ = is_add ? SelectedPattern::Kind::FloatMulAdd : SelectedPattern::Kind::FloatMulSub;
+        vmla.dst_ = dst;
+        vmla.src1_ = x;
+        vmla.src2_ = y;
+        vmla.acc_ = acc;
+        candidates.push_back({vmla, len, 1 + OperandCost(x) + OperandCost(y) + OperandCost(acc), fallback});
+      }
+    }
+  }
+
+  //单条tac：运算数是可编码的立即数，或乘以2的幂
+  if (IsIntScalar(tac->a_) && IsIntScalar(tac->b_) && IsIntScalar(tac->c_) &&
+      IsIntLiteral(tac->b_) != IsIntLiteral(tac->c_)) {
+    SelectedPattern single;
+    bool matched = false;
+    auto lit = IsIntLiteral(tac->b_) ? tac->b_ : tac->c_;
+    auto var = IsIntLiteral(tac->b_) ? tac->c_ : tac->b_;
+    int val = lit->value_.GetInt();
+    single.src1_ = var;
+    switch (tac->operation_) {
+      case TACOperationType::Add:
+        single.kind_ = SelectedPattern::Kind::AddImm;
+        single.imm_ = val;
+        matched = ArmHelper::IsImmediateValue(val) || (val != INT_MIN && ArmHelper::IsImmediateValue(-val));
+        break;
+      case TACOperationType::Sub:
+        if (lit == tac->c_) {
+          single.kind_ = SelectedPattern::Kind::AddImm;
+          single.imm_ = -val;
+          matched = val != INT_MIN && (ArmHelper::IsImmediateValue(val) || ArmHelper::IsImmediateValue(-val));
+        } else {
+          single.kind_ = SelectedPattern::Kind::RsbImm;
+          single.imm_ = val;
+          matched = ArmHelper::IsImmediateValue(val);
+        }
+        break;
+      case TACOperationType::Mul:
+        single.kind_ = SelectedPattern::Kind::ShiftImm;
+        matched = IsPositivePowerOf2(lit);
+        if (matched) {
+          single.imm_ = ArmHelper::Log2(val);
+        }
+        break;
+      default:
+        break;
+    }
+    if (matched) {
+      bool tail = MatchCopyTail(next, tac->a_, &single.dst_);
+      candidates.push_back({single, tail ? 2 : 1, 1, FallbackCost(tac) + (tail ? 1 : 0)});
+    }
+  }
+
+  //选择节省指令最多的覆盖，不比原有模板好的不选
+  const Candidate *best = nullptr;
+  for (auto &candidate : candidates) {
+    int saving = candidate.fallback - candidate.cost;
+    if (saving <= 0) {
+      continue;
+    }
+    if (best == nullptr || saving > best->fallback - best->cost ||
+        (saving == best->fallback - best->cost && candidate.len > best->len)) {
+      best = &candidate;
+    }
+  }
+  if (best == nullptr) {
+    return 0;
+  }
+  *pattern = best->pattern;
+  return best->len;
+}
+
+}  // namespace AssemblyBuilder
+}  // namespace HaveFunCompiler
\ No newline at end of file
@@ -0,0 +1,126 @@
+#include "ASM/arm/LiteralPoolManager.hh"
+#include <set>
+#include <vector>
+
+namespace HaveFunCompiler {
+namespace AssemblyBuilder {
+
+int LiteralPoolManager::SizeOf(const ArmInst &inst) {
+  switch (inst.kind_) {
+    case ArmInst::Kind::Instruction:
+      return 4;
+    case ArmInst::Kind::Directive: {
+      auto &text = inst.text_;
+      if (text.find(".word") != std::string::npos) {
+        return 4;
+      }
+      if (text.compare(0, 6, ".align") == 0) {
+        //按最坏情况估计对齐带来的填充
+        int n = std::atoi(text.c_str() + 6);
+        return n > 2 ? (1 << n) - 4 : 0;
+      }
+      if (text.compare(0, 5, ".skip") == 0 || text.compare(0, 6, ".space") == 0) {
+        return std::atoi(text.c_str() + (text[1] == 's' && text[2] == 'k' ? 5 : 6));
+      }
+      return 0;
+    }
+    default:
+      return 0;
+  }
+}
+
+bool LiteralPoolManager::IsLiteralLoad(const ArmInst &inst, std::string *literal) {
+  if (!inst.IsInstruction() || inst.opcode_ != "ldr" || inst.operands_.size() != 2 || inst.operands_[1].empty() ||
+      inst.operands_[1][0] != '=') {
+    return false;
+  }
+  *literal = inst.operands_[1].substr(1);
+  return true;
+}
+
+void LiteralPoolManager::InsertPool(ArmInstList::iterator it, bool needbranch) {
+  std::string label = "_literal_pool_" + label_prefix_ + "_" + std::to_string(pool_count_);
+  if (needbranch) {
+    insts_->insert(it, ArmInst::MakeInst("b", {label}));
+    branch_count_++;
+  }
+  insts_->insert(it, ArmInst::Parse(".ltorg"));
+  if (needbranch) {
+    insts_->insert(it, ArmInst::Parse(label + ":"));
+  }
+  pool_count_++;
+}
+
+void LiteralPoolManager::place() {
+  //当前位置的字节偏移
+  int offset = 0;
+  //尚未放入文字池的引用：第一次引用的位置，以及引用到的不同常量
+  int first_ref = -1;
+  std::set<std::string> literals;
+  //最近一个可以放文字池的位置（无条件跳转之后），以及那时的偏移和常量数
+  auto candidate = insts_->end();
+  int candidate_offset = 0;
+  size_t candidate_literals = 0;
+  auto reset = [&]() -> void {
+    first_ref = -1;
+    literals.clear();
+    candidate = insts_->end();
+  };
+
+  for (auto it = insts_->begin(); it != insts_->end();) {
+    if (it->kind_ == ArmInst::Kind::Directive && (it->text_ == ".ltorg" || it->text_ == ".pool")) {
+      //已有的文字池
+      reset();
+      ++it;
+      continue;
+    }
+    std::string literal;
+    bool isref = IsLiteralLoad(*it, &literal);
+    size_t nliterals = literals.size() + ((isref && !literals.count(literal)) ? 1 : 0);
+    int first = (first_ref != -1 ? first_ref : (isref ? offset : -1));
+    if (first != -1 && offset + SizeOf(*it) + static_cast<int>(nliterals) * 4 - first > LITERAL_RANGE) {
+      if (candidate != insts_->end()) {
+        //放在之前的无条件跳转后面，然后从那里重新计算
+        InsertPool(candidate, false);
+        it = candidate;
+        offset = candidate_offset + static_cast<int>(candidate_literals) * 4;
+        reset();
+        continue;
+      }
+      //找不到合适的位置，只能跳过文字池
+      if (first_ref != -1) {
+        InsertPool(it, true);
+        offset += 4 + static_cast<int>(literals.size()) * 4;
+        reset();
+        continue;
+      }
+    }
+    if (isref) {
+      if (first_ref == -1) {
+        first_ref = offset;
+      }
+      literals.insert(literal);
+    }
+    offset += SizeOf(*it);
+    if (it->IsUnconditionalJump() && first_ref != -1) {
+      candidate = std::next(it);
+      candidate_offset = offset;
+      candidate_literals = literals.size();
+    }
+    ++it;
+  }
+
+  if (first_ref != -1) {
+    auto last = insts_->end();
+    for (auto it = insts_->rbegin(); it != insts_->rend(); ++it) {
+      if (it->IsInstruction()) {
+        last = std::prev(it.base());
+        break;
+      }
+    }
+    InsertPool(insts_->end(), last == insts_->end() || !last->IsUnconditionalJump());
+  }
+}
+
+}  // namespace AssemblyBuilder
+}  // namespace HaveFunCompiler
\ No newline at end of file
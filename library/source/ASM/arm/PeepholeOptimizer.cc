@@ -0,0 +1,334 @@
+#include "ASM/arm/PeepholeOptimizer.hh"
+#include <cstdlib>
+#include <vector>
+
+namespace HaveFunCompiler {
+namespace AssemblyBuilder {
+
+namespace {
+//解析 [sp] 或 [sp, #k] 形式的地址，成功时写入偏移量
+bool ParseStackSlot(const ArmInst &inst, int *offset) {
+  if (inst.operands_.size() != 2) {
+    return false;
+  }
+  std::string addr;
+  for (auto c : inst.operands_[1]) {
+    if (c != ' ' && c != '\t') {
+      addr += c;
+    }
+  }
+  if (addr == "[sp]") {
+    *offset = 0;
+    return true;
+  }
+  if (addr.compare(0, 5, "[sp,#") != 0 || addr.back() != ']') {
+    return false;
+  }
+  auto num = addr.substr(5, addr.length() - 6);
+  if (num.empty()) {
+    return false;
+  }
+  char *end = nullptr;
+  long val = strtol(num.c_str(), &end, 10);
+  if (*end != '\0') {
+    return false;
+  }
+  *offset = static_cast<int>(val);
+  return true;
+}
+
+//只处理4字节的整数和单精度寄存器
+bool IsWordReg(const std::string &reg) {
+  return !reg.empty() && (reg[0] == 'r' || reg[0] == 's' || reg == "fp" || reg == "ip" || reg == "lr");
+}
+
+bool IsFloatReg(const std::string &reg) { return !reg.empty() && reg[0] == 's'; }
+
+bool IsPlainMove(const ArmInst &inst) {
+  if (!inst.IsInstruction() || inst.set_flags_ || inst.IsConditional() || inst.operands_.size() != 2) {
+    return false;
+  }
+  if (inst.opcode_ == "mov") {
+    return !ArmInst::NormalizeRegName(inst.operands_[0]).empty() &&
+           !ArmInst::NormalizeRegName(inst.operands_[1]).empty();
+  }
+  if (inst.opcode_ == "vmov" && (inst.datatype_.empty() || inst.datatype_ == ".f32")) {
+    return IsFloatReg(ArmInst::NormalizeRegName(inst.operands_[0])) &&
+           IsFloatReg(ArmInst::NormalizeRegName(inst.operands_[1]));
+  }
+  return false;
+}
+
+//两寄存器之间的复制指令
+ArmInst MakeMove(const std::string &dst, const std::string &src) {
+  if (IsFloatReg(dst) && IsFloatReg(src)) {
+    return ArmInst::MakeInst("vmov.f32", {dst, src});
+  }
+  if (IsFloatReg(dst) || IsFloatReg(src)) {
+    return ArmInst::MakeInst("vmov", {dst, src});
+  }
+  return ArmInst::MakeInst("mov", {dst, src});
+}
+}  // namespace
+
+void PeepholeOptimizer::optimize() {
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    changed |= RemoveSelfMove();
+    changed |= ForwardStackSlot();
+    changed |= RemoveBranchToNext();
+    changed |= RemoveGlobalStorePushPop();
+  }
+}
+
+std::string PeepholeOptimizer::CountsToString() const {
+  std::string ret;
+  for (auto &[rule, cnt] : rule_counts_) {
+    if (!ret.empty()) {
+      ret += " ";
+    }
+    ret += rule + "=" + std::to_string(cnt);
+  }
+  return ret;
+}
+
+bool PeepholeOptimizer::RemoveSelfMove() {
+  bool changed = false;
+  auto prev = insts_->end();
+  for (auto it = insts_->begin(); it != insts_->end();) {
+    if (!it->IsInstruction()) {
+      if (it->kind_ != ArmInst::Kind::Comment) {
+        prev = insts_->end();
+      }
+      ++it;
+      continue;
+    }
+    if (IsPlainMove(*it)) {
+      auto dst = ArmInst::NormalizeRegName(it->operands_[0]);
+      auto src = ArmInst::NormalizeRegName(it->operands_[1]);
+      bool remove = (dst == src);
+      // mov rA, rB; mov rB, rA 中第二条无效
+      if (!remove && prev != insts_->end() && IsPlainMove(*prev) && prev->opcode_ == it->opcode_) {
+        remove = ArmInst::NormalizeRegName(prev->operands_[0]) == src &&
+                 ArmInst::NormalizeRegName(prev->operands_[1]) == dst;
+      }
+      if (remove) {
+        it = insts_->erase(it);
+        Count("self-move");
+        changed = true;
+        continue;
+      }
+    }
+    prev = it;
+    ++it;
+  }
+  return changed;
+}
+
+bool PeepholeOptimizer::ForwardStackSlot() {
+  bool changed = false;
+  //栈槽偏移 -> 当前与之内容相同的寄存器
+  std::map<int, std::string> slots;
+  auto kill_overlap = [&slots](int offset) -> void {
+    for (auto it = slots.begin(); it != slots.end();) {
+      if (it->first > offset - 4 && it->first < offset + 4) {
+        it = slots.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  };
+  auto kill_reg = [&slots](const std::string &reg) -> void {
+    for (auto it = slots.begin(); it != slots.end();) {
+      if (it->second == reg) {
+        it = slots.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  };
+
+  for (auto it = insts_->begin(); it != insts_->end();) {
+    auto &inst = *it;
+    if (inst.kind_ == ArmInst::Kind::Comment) {
+      ++it;
+      continue;
+    }
+    if (!inst.IsInstruction() || !inst.IsKnown() || inst.IsBranch()) {
+      //标签、数据池和跳转都结束当前基本块
+      slots.clear();
+      ++it;
+      continue;
+    }
+    int offset;
+    bool is_load = (inst.opcode_ == "ldr" || inst.opcode_ == "vldr");
+    bool is_store = (inst.opcode_ == "str" || inst.opcode_ == "vstr");
+    if ((is_load || is_store) && inst.datatype_.empty() && !inst.IsConditional() && ParseStackSlot(inst, &offset)) {
+      auto reg = ArmInst::NormalizeRegName(inst.operands_[0]);
+      if (IsWordReg(reg)) {
+        auto slot = slots.find(offset);
+        if (is_store) {
+          if (slot != slots.end() && slot->second == reg) {
+            it = insts_->erase(it);
+            Count("redundant-store");
+            changed = true;
+            continue;
+          }
+          kill_overlap(offset);
+          slots[offset] = reg;
+          ++it;
+          continue;
+        }
+        if (slot != slots.end()) {
+          auto src = slot->second;
+          if (src == reg) {
+            it = insts_->erase(it);
+          } else {
+            *it = MakeMove(reg, src);
+            kill_reg(reg);
+            ++it;
+          }
+          Count("store-load");
+          changed = true;
+          continue;
+        }
+        kill_reg(reg);
+        slots[offset] = reg;
+        ++it;
+        continue;
+      }
+    }
+    if (inst.WritesMemory() || inst.DefinesReg("sp")) {
+      slots.clear();
+    } else {
+      for (auto &reg : inst.GetDefRegs()) {
+        kill_reg(reg);
+      }
+    }
+    ++it;
+  }
+  return changed;
+}
+
+bool PeepholeOptimizer::RemoveBranchToNext() {
+  bool changed = false;
+  for (auto it = insts_->begin(); it != insts_->end();) {
+    if (!it->IsInstruction() || it->opcode_ != "b" || it->operands_.size() != 1) {
+      ++it;
+      continue;
+    }
+    auto &target = it->operands_[0];
+    bool found = false;
+    for (auto next = std::next(it); next != insts_->end(); ++next) {
+      if (next->kind_ == ArmInst::Kind::Comment) {
+        continue;
+      }
+      if (next->kind_ != ArmInst::Kind::Label) {
+        break;
+      }
+      if (next->text_ == target) {
+        found = true;
+        break;
+      }
+    }
+    if (found) {
+      it = insts_->erase(it);
+      Count("branch-to-next");
+      changed = true;
+    } else {
+      ++it;
+    }
+  }
+  return changed;
+}
+
+bool PeepholeOptimizer::RemoveGlobalStorePushPop() {
+  bool changed = false;
+  //跳过注释，取下一条
+  auto next_of = [this](ArmInstList::iterator it) -> ArmInstList::iterator {
+    do {
+      ++it;
+    } while (it != insts_->end() && it->kind_ == ArmInst::Kind::Comment);
+    return it;
+  };
+  for (auto it = insts_->begin(); it != insts_->end();) {
+    if (!it->IsInstruction() || it->opcode_ != "push" || it->IsConditional()) {
+      ++it;
+      continue;
+    }
+    auto pushed = ArmInst::ExpandRegList(it->operands_[0]);
+    if (pushed.size() != 1) {
+      ++it;
+      continue;
+    }
+    auto &reg = pushed[0];
+    //中间是取全局变量地址的指令：ldr X, lbl 或 movw/movt X, #:lower16:g
+    auto is_addr = [&reg](const ArmInst &inst) -> bool {
+      if (!inst.IsInstruction() || inst.IsConditional() || inst.operands_.size() != 2 ||
+          ArmInst::NormalizeRegName(inst.operands_[0]) != reg || inst.operands_[1].empty()) {
+        return false;
+      }
+      if (inst.opcode_ == "ldr") {
+        return inst.operands_[1][0] != '[';
+      }
+      return (inst.opcode_ == "movw" || inst.opcode_ == "movt") && inst.operands_[1][0] == '#';
+    };
+    auto ld = next_of(it);
+    if (ld == insts_->end() || !is_addr(*ld)) {
+      ++it;
+      continue;
+    }
+    while (next_of(ld) != insts_->end() && is_addr(*next_of(ld))) {
+      ld = next_of(ld);
+    }
+    auto st = next_of(ld);
+    if (st == insts_->end() || !st->IsInstruction() || (st->opcode_ != "str" && st->opcode_ != "vstr") ||
+        st->IsConditional() || st->operands_.size() != 2 || ArmInst::NormalizeRegName(st->operands_[0]) == reg ||
+        ArmInst::NormalizeRegName(st->operands_[0]) == "sp" || st->operands_[1] != "[" + reg + "]") {
+      ++it;
+      continue;
+    }
+    auto pop = next_of(st);
+    if (pop == insts_->end() || !pop->IsInstruction() || pop->opcode_ != "pop" || pop->IsConditional() ||
+        ArmInst::ExpandRegList(pop->operands_[0]) != pushed) {
+      ++it;
+      continue;
+    }
+    if (IsLiveAfter(pop, reg)) {
+      ++it;
+      continue;
+    }
+    auto after = std::next(pop);
+    insts_->erase(pop);
+    it = insts_->erase(it);
+    Count("global-store-push-pop", 2);
+    changed = true;
+    it = after;
+  }
+  return changed;
+}
+
+bool PeepholeOptimizer::IsLiveAfter(ArmInstList::iterator it, const std::string &reg) const {
+  for (++it; it != insts_->end(); ++it) {
+    if (it->kind_ == ArmInst::Kind::Comment) {
+      continue;
+    }
+    if (!it->IsInstruction() || !it->IsKnown()) {
+      return true;
+    }
+    if (it->UsesReg(reg)) {
+      return true;
+    }
+    if (it->DefinesReg(reg) && !it->IsConditional()) {
+      return false;
+    }
+    if (it->IsBranch() && !it->IsCall()) {
+      return true;
+    }
+  }
+  return true;
+}
+
+}  // namespace AssemblyBuilder
+}  // namespace HaveFunCompiler
\ No newline at end of file
@@ -46,7 +46,7 @@ void RegAllocator::ContextInit(const LiveAnalyzer& liveAnalyzer)
         if (tmpParams.find(sym) == tmpParams.end() && !sym->IsGlobal())
         {
             localSym.push_back(sym);
-            if (sym->value_.Type() == SymbolValue::ValueType::Array)
+            if (sym->value_.Type() == SymbolValue::ValueType::Array && !(staticArrays && staticArrays->count(sym)))
                 ptrToArrayOnStack.emplace(sym, SymAttribute());
         }
     }
@@ -127,13 +127,13 @@ void RegAllocator::getParamAddr()
             if (paramType == INT)
             {
                 if (regUsedNumber == 0)
-                    regUsedNumber = intRegPoolSize - 1;
+                    regUsedNumber = intParam0Reg;
                 ++intRegUsedNumber;
             }
             else
             {
                 if (regUsedNumber == 0)
-                    regUsedNumber = floatRegPoolSize - 1;
+                    regUsedNumber = floatParam0Reg;
                 ++floatRegUsedNumber;
             }
             paramAttribute.value = regUsedNumber;
@@ -141,6 +141,73 @@ void RegAllocator::getParamAddr()
     }
 }
 
+void RegAllocator::chooseSpecialRegs()
+{
+    intReservedReg = 4;
+    floatReservedReg = 16;
+    intParam0Reg = intRegPoolSize - 1;
+    floatParam0Reg = floatRegPoolSize - 1;
+    if (!isLeaf)
+        return;
+
+    int intParamCnt = 0, floatParamCnt = 0;
+    for (auto param : paramLs)
+    {
+        if (fetchSymValueType(param) == INT)
+            ++intParamCnt;
+        else
+            ++floatParamCnt;
+    }
+    if (intParamCnt > intRegParamUsableNumber)
+        intParamCnt = intRegParamUsableNumber;
+    if (floatParamCnt > floatRegParamUsableNumber)
+        floatParamCnt = floatRegParamUsableNumber;
+
+    // 从编号大的一端取没有传参的调用者保存寄存器，先给保留寄存器，再给第一个参数
+    auto pick = [](int &next, int paramCnt, int &target)
+    {
+        if (next >= std::max(paramCnt, 1))
+            target = next--;
+    };
+    int next = intRegParamUsableNumber - 1;
+    pick(next, intParamCnt, intReservedReg);
+    if (intParamCnt > 0)
+        pick(next, intParamCnt, intParam0Reg);
+    next = floatRegParamUsableNumber - 1;
+    pick(next, floatParamCnt, floatReservedReg);
+    if (floatParamCnt > 0)
+        pick(next, floatParamCnt, floatParam0Reg);
+}
+
+std::vector<int> RegAllocator::regAllocOrder(int callerSavedCnt, int poolSize, int reservedReg, int param0Reg, int paramRegCnt) const
+{
+    std::vector<int> order;
+    std::vector<bool> added(poolSize, false);
+    added[0] = added[reservedReg] = true;
+    auto add = [&order, &added](int regId)
+    {
+        if (!added[regId])
+        {
+            order.push_back(regId);
+            added[regId] = true;
+        }
+    };
+
+    // 叶函数中没有传参的调用者保存寄存器不需要保存，最先分配
+    if (isLeaf)
+    {
+        for (int i = callerSavedCnt; i >= paramRegCnt && i >= 1; --i)
+            if (i != param0Reg)
+                add(i);
+    }
+    for (int i = callerSavedCnt + 1; i < poolSize; ++i)
+        add(i);
+    // 传参的寄存器最后分配，尽量让参数留在原来的寄存器中
+    for (int i = callerSavedCnt; i >= 1; --i)
+        add(i);
+    return order;
+}
+
 SymAttribute& RegAllocator::fetchSymAttr(const SymInfo &symInfo)
 {
     // 程序debug完成后，可以去掉这些异常处理(运行逻辑正确，则无论输入如何都不会进入异常分支)
@@ -203,36 +270,37 @@ void RegAllocator::LinearScan(const LiveAnalyzer& liveAnalyzer)
         {INT, intRegsIndex}, {FLOAT, floatRegsIndex}
     };
 
-    for (int i = 5, j = 0; i < intRegPoolSize; ++i, ++j)
+    int intParamRegCnt = 0, floatParamRegCnt = 0;
+    for (auto param : paramLs)
     {
-        intRegs.emplace_back(i);
-        intRegsIndex[i] = j;
+        if (fetchSymValueType(param) == INT)
+        {
+            if (intParamRegCnt < intRegParamUsableNumber)
+                ++intParamRegCnt;
+        }
+        else if (floatParamRegCnt < floatRegParamUsableNumber)
+            ++floatParamRegCnt;
     }
-    for (int i = 3, j = intRegs.size(); i >= 1; --i, ++j)
+    for (auto i : regAllocOrder(intRegParamUsableNumber - 1, intRegPoolSize, intReservedReg, intParam0Reg, intParamRegCnt))
     {
+        intRegsIndex[i] = intRegs.size();
         intRegs.emplace_back(i);
-        intRegsIndex[i] = j;
-    }
-    for (int i = 17, j = 0; i < floatRegPoolSize; ++i, ++j)
-    {
-        floatRegs.emplace_back(i);
-        floatRegsIndex[i] = j;
     }
-    for (int i = 15, j = floatRegs.size(); i >= 1; --i, ++j)
+    for (auto i : regAllocOrder(floatRegParamUsableNumber - 1, floatRegPoolSize, floatReservedReg, floatParam0Reg, floatParamRegCnt))
     {
+        floatRegsIndex[i] = floatRegs.size();
         floatRegs.emplace_back(i);
-        floatRegsIndex[i] = j;
     }
 
     // 记录保留的寄存器
-    funcAttr.attr.used_regs.intReservedReg = 4;
-    funcAttr.attr.used_regs.floatReservedReg = 16;
+    funcAttr.attr.used_regs.intReservedReg = intReservedReg;
+    funcAttr.attr.used_regs.floatReservedReg = floatReservedReg;
     SET_UINT(funcAttr.attr.used_regs.intRegs, 0);
-    SET_UINT(funcAttr.attr.used_regs.intRegs, 4);
+    SET_UINT(funcAttr.attr.used_regs.intRegs, intReservedReg);
     for (int i = 13; i < 16; ++i)
         SET_UINT(funcAttr.attr.used_regs.intRegs, i);
     SET_UINT(funcAttr.attr.used_regs.floatRegs, 0);
-    SET_UINT(funcAttr.attr.used_regs.floatRegs, 16);
+    SET_UINT(funcAttr.attr.used_regs.floatRegs, floatReservedReg);
 
     // 记录当前局部变量的栈偏移
     int varStackOffset = 0;
@@ -247,6 +315,51 @@ void RegAllocator::LinearScan(const LiveAnalyzer& liveAnalyzer)
         varStackOffset += size;
     };
 
+    // 溢出变量的栈槽，id为栈上偏移
+    // 与寄存器一样，活跃区间不相交的变量可以共用同一个栈槽
+    std::vector<RegInfo> spillSlots;
+
+    // 为溢出变量分配栈槽，优先复用不冲突的已有栈槽
+    auto AllocOnSpillSlotMark = [&](SymAttribute &symAttr, const std::set<LiveInterval> &liveRanges)
+    {
+        if (liveRanges.empty())
+        {
+            AllocOnStackMark(symAttr, 4);
+            return;
+        }
+        // 空闲寄存器中修改过的值延迟到基本块末尾才写回栈槽，占用区间要延长到基本块末尾
+        std::set<LiveInterval> occupy;
+        LiveInterval cur = {0, 0};
+        bool hasCur = false;
+        for (auto &range : liveRanges)
+        {
+            LiveInterval ext = {range.first, liveAnalyzer.get_blockEndDfn(range.second)};
+            if (hasCur && ext.first <= cur.second)
+                cur.second = std::max(cur.second, ext.second);
+            else
+            {
+                if (hasCur)
+                    occupy.insert(cur);
+                cur = ext;
+                hasCur = true;
+            }
+        }
+        occupy.insert(cur);
+
+        for (auto &slot : spillSlots)
+        {
+            if (slot.AllocToSym(occupy))
+            {
+                symAttr.attr.store_type = SymAttribute::STACK_VAR;
+                symAttr.value = slot.id;
+                return;
+            }
+        }
+        AllocOnStackMark(symAttr, 4);
+        spillSlots.emplace_back(symAttr.value);
+        spillSlots.back().AllocToSym(occupy);
+    };
+
     // 将寄存器regId加入到函数使用的type类寄存器集
     auto funcUsedRegadd = [this](SymValueType type, int regId)
     {
@@ -298,7 +411,7 @@ void RegAllocator::LinearScan(const LiveAnalyzer& liveAnalyzer)
                 // 失败，溢出到栈
                 else
                 {
-                    AllocOnStackMark(attribute, 4);  // 参数始终是4字节
+                    AllocOnSpillSlotMark(attribute, *(symInfo.liveRanges));  // 参数始终是4字节
                     continue;
                 }
             }    
@@ -323,7 +436,7 @@ void RegAllocator::LinearScan(const LiveAnalyzer& liveAnalyzer)
             // 如果sym是通过栈传递的参数，则不需移动
             // 局部变量则溢出到栈
             if (symInfo.symType == LOCAL_VAR)
-                AllocOnStackMark(attribute, 4);  // 局部变量始终是4字节
+                AllocOnSpillSlotMark(attribute, *(symInfo.liveRanges));  // 局部变量始终是4字节
         }
     }
 
@@ -368,10 +481,11 @@ bool RegAllocator::RegInfo::AllocToSym(const std::set<LiveInterval> &symRanges)
     return true;
 }
 
-RegAllocator::RegAllocator(const LiveAnalyzer& liveAnalyzer)
+RegAllocator::RegAllocator(const LiveAnalyzer& liveAnalyzer, bool isLeaf, const std::unordered_set<SymPtr> *staticArrays) : isLeaf(isLeaf), staticArrays(staticArrays)
 {
     // 得到函数中的局部变量、参数列表
     ContextInit(liveAnalyzer);
+    chooseSpecialRegs();
     // 线性扫描
     LinearScan(liveAnalyzer);
     // 在symAttrMap中添加函数属性
@@ -1,7 +1,10 @@
 #include "TAC/TAC.hh"
 #include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <map>
 #include <sstream>
+#include <unordered_set>
 #include "Exceptions.hh"
 #include "MagicEnum.hh"
 
@@ -189,8 +192,14 @@ std::string TACFactory::ToCustomerLabelName(const std::string name) { return "U_
 std::string TACFactory::ToTempLabelName(uint64_t id) { return "SL_" + std::to_string(id); }
 std::string TACFactory::ToVariableOrConstantName(const std::string name) { return "U_" + name; }
 std::string TACFactory::ToTempVariableName(uint64_t id) { return "SV_" + std::to_string(id); }
-
-TACBuilder::TACBuilder() : cur_temp_var_(0), cur_temp_label_(0), cur_symtab_id_(0) {
+std::string TACFactory::ToArrayTemplateName(uint64_t id) { return "ST_" + std::to_string(id); }
+
+TACBuilder::TACBuilder()
+    : cur_temp_var_(0),
+      cur_temp_label_(0),
+      cur_symtab_id_(0),
+      cur_array_template_(0),
+      array_template_tac_(TACFactory::Instance()->NewTACList()) {
   EnterSubscope();
   CreateLibraryFunction();
 }
@@ -436,26 +445,100 @@ ExpressionPtr TACBuilder::AccessArray(ExpressionPtr array, std::vector<Expressio
     arrayDescriptor->subarray->emplace(idx, NewExp(NewTACList(), nArraySym));
     return AccessArray(NewExp(array->tac, nArraySym), pos);
   } else {
-    auto tac_list = NewTACList(array->tac);
-    auto nArrayDescriptor = NewArrayDescriptor();
+    //剩下的下标一次处理完，按Horner形式计算展开后的偏移 ((i0 * d1 + i1) * d2 + i2) * ...
+    //常量下标和步长单独累加，最后只加一次，变量部分的乘法推迟到遇到下一个变量下标时再做
+    pos.insert(pos.cbegin(), idx_exp);
+    auto &dims = arrayDescriptor->dimensions;
+    ExpressionPtr var_exp;
+    ssize_t var_scale = 1;
+    ssize_t const_offset = 0;
+    for (size_t i = 0; i < pos.size(); i++) {
+      if (i > 0) {
+        var_scale *= dims[i];
+        const_offset *= dims[i];
+      }
+      auto idx = RemoveDirectArray(pos[i]);
+      if (idx->ret->type_ == SymbolType::Constant) {
+        const_offset += idx->ret->value_.GetInt();
+        continue;
+      }
+      if (var_exp == nullptr) {
+        var_exp = idx;
+      } else {
+        if (var_scale != 1) {
+          var_exp = CreateArithmeticOperation(TACOperationType::Mul, var_exp, CreateConstExp((int)var_scale));
+        }
+        var_exp = CreateArithmeticOperation(TACOperationType::Add, var_exp, idx);
+      }
+      var_scale = 1;
+    }
 
+    auto nArrayDescriptor = NewArrayDescriptor();
     size_t size_sublen = 1;
-    for (size_t i = 1; i < arrayDescriptor->dimensions.size(); i++) {
-      size_sublen *= arrayDescriptor->dimensions[i];
-      nArrayDescriptor->dimensions.push_back(arrayDescriptor->dimensions[i]);
+    for (size_t i = pos.size(); i < dims.size(); i++) {
+      size_sublen *= dims[i];
+      nArrayDescriptor->dimensions.push_back(dims[i]);
+    }
+    var_scale *= size_sublen;
+    const_offset *= size_sublen;
+    auto base_offset = arrayDescriptor->base_offset;
+    if (base_offset->type_ == SymbolType::Constant) {
+      const_offset += base_offset->value_.GetInt();
+    }
+    if (const_offset > (ssize_t)INT32_MAX || const_offset < 0) {
+      throw RUNTIME_EXCEPTION("Invalid array access at " + std::to_string(const_offset));
+    }
+
+    ExpressionPtr offset_exp;
+    if (var_exp == nullptr) {
+      offset_exp = CreateConstExp((int)const_offset);
+    } else {
+      if (var_scale != 1) {
+        var_exp = CreateArithmeticOperation(TACOperationType::Mul, var_exp, CreateConstExp((int)var_scale));
+      }
+      if (base_offset->type_ != SymbolType::Constant) {
+        var_exp = CreateArithmeticOperation(TACOperationType::Add, NewExp(NewTACList(), base_offset), var_exp);
+      }
+      //常量部分作为最后一次加法的立即数
+      offset_exp = const_offset ? CreateArithmeticOperation(TACOperationType::Add, var_exp,
+                                                            CreateConstExp((int)const_offset))
+                                : var_exp;
     }
+    auto tac_list = NewTACList(array->tac);
+    (*tac_list) += offset_exp->tac;
     nArrayDescriptor->base_addr = arrayDescriptor->base_addr;
     nArrayDescriptor->value_type = arrayDescriptor->value_type;
-    auto offset_exp = NewExp(NewTACList(), arrayDescriptor->base_offset);
-    offset_exp = CreateArithmeticOperation(
-        TACOperationType::Add, offset_exp,
-        CreateArithmeticOperation(TACOperationType::Mul, idx_exp, CreateConstExp((int)size_sublen)));
-    (*tac_list) += offset_exp->tac;
     nArrayDescriptor->base_offset = offset_exp->ret;
-    return AccessArray(NewExp(tac_list, NewSymbol(array->ret->type_, std::nullopt, nArrayDescriptor)), pos);
+    return NewExp(tac_list, NewSymbol(array->ret->type_, std::nullopt, nArrayDescriptor));
   }
 }
 
+ExpressionPtr TACBuilder::FoldConstArrayRead(ExpressionPtr exp) {
+  if (exp->ret->type_ != SymbolType::Constant || exp->ret->value_.Type() != SymbolValue::ValueType::Array) {
+    return exp;
+  }
+  //下标都是常量时AccessArray给出的元素偏移也是常量，初值记在它的subarray中，没有初值的元素为0
+  auto arrayDescriptor = exp->ret->value_.GetArrayDescriptor();
+  if (!arrayDescriptor->dimensions.empty() || arrayDescriptor->base_offset->type_ != SymbolType::Constant) {
+    return exp;
+  }
+  if (!arrayDescriptor->subarray->empty()) {
+    //初值按元素类型转换，否则 const float w[1] = {3} 中的 w[0] / 2 会变成整数除法
+    auto value = arrayDescriptor->subarray->begin()->second;
+    if (value->ret->value_.Type() == arrayDescriptor->value_type) {
+      return value;
+    }
+    if (arrayDescriptor->value_type == SymbolValue::ValueType::Float) {
+      return CreateConstExp(static_cast<float>(value->ret->value_.GetInt()));
+    }
+    return CreateConstExp(static_cast<int>(value->ret->value_.GetFloat()));
+  }
+  if (arrayDescriptor->value_type == SymbolValue::ValueType::Float) {
+    return CreateConstExp(0.0f);
+  }
+  return CreateConstExp(0);
+}
+
 int TACBuilder::ArrayInitImpl(ExpressionPtr array, FlattenedArray::iterator &it, const FlattenedArray::iterator &end,
                               TACListPtr tac_list) {
   enum { OK, IGNORE };
@@ -471,8 +554,13 @@ int TACBuilder::ArrayInitImpl(ExpressionPtr array, FlattenedArray::iterator &it,
     if (it->first == 2) {
       return IGNORE;
     }
-    (*tac_list) += CreateAssign(array->ret, it->second)->tac;
-    arrayDescriptor->subarray->emplace(0, it->second);
+    //ConstInitVal不按元素类型转换，字面量在这里转换，如 const float c[3] = {1.5, 2, 3.5} 中的2
+    auto init = it->second;
+    if (init->ret->IsLiteral() && init->ret->value_.Type() != arrayDescriptor->value_type) {
+      init = arrayDescriptor->value_type == SymbolValue::ValueType::Float ? CastIntToFloat(init) : CastFloatToInt(init);
+    }
+    (*tac_list) += CreateAssign(array->ret, init)->tac;
+    arrayDescriptor->subarray->emplace(0, init);
     ++it;
     return OK;
   }
@@ -514,22 +602,13 @@ ExpressionPtr TACBuilder::CreateArrayInit(ExpressionPtr array, ExpressionPtr ini
   //                        array->value_.TypeToString() + " and " + init_array->value_.TypeToString());
   // }
   //进行数组初始化
-  {
-    std::vector<ExpressionPtr> zero_pos;
-    auto ad = array->ret->value_.GetArrayDescriptor();
-    size_t size = 1;
-    for (size_t i = 0; i < ad->dimensions.size(); i++) {
-      zero_pos.push_back(CreateConstExp((int)0));
-      size *= ad->dimensions[i];
-    }
-    if (size > INT32_MAX) {
-      throw RUNTIME_EXCEPTION("Array size is too big (" + std::to_string(size) + ")");
-    }
-    auto zero_pos_array = AccessArray(NewExp(NewTACList(), array->ret), zero_pos);
-    (*array->tac) += zero_pos_array->tac;
-    (*array->tac) += NewTAC(TACOperationType::ArgumentAddress, zero_pos_array->ret);
-    (*array->tac) += NewTAC(TACOperationType::Argument, CreateConstExp((int)size)->ret);
-    (*array->tac) += NewTAC(TACOperationType::Call, nullptr, NewSymbol(SymbolType::Function, "_builtin_clear"));
+  auto ad = array->ret->value_.GetArrayDescriptor();
+  size_t size = 1;
+  for (size_t i = 0; i < ad->dimensions.size(); i++) {
+    size *= ad->dimensions[i];
+  }
+  if (size > INT32_MAX) {
+    throw RUNTIME_EXCEPTION("Array size is too big (" + std::to_string(size) + ")");
   }
 
   auto finit_array = FlattenInitArray(init_array->ret->value_.GetArrayDescriptor());
@@ -557,9 +636,160 @@ ExpressionPtr TACBuilder::CreateArrayInit(ExpressionPtr array, ExpressionPtr ini
   }
   auto init_array_it = finit_array.begin();
   ++init_array_it;
-  ArrayInitImpl(array, init_array_it, finit_array.end(), array->tac);
+  auto init_tac = NewTACList();
+  ArrayInitImpl(array, init_array_it, finit_array.end(), init_tac);
+  //全局数组的初值在汇编时直接放进数据段
+  if (array->ret->IsGlobal() || !CreateLocalArrayInit(array, init_tac, size)) {
+    AppendArrayClear(array, 0, size);
+    (*array->tac) += init_tac;
+  }
   return array;
 }
+
+bool TACBuilder::CreateLocalArrayInit(ExpressionPtr array, TACListPtr init_tac, size_t size) {
+  auto value_type = array->ret->value_.GetArrayDescriptor()->value_type;
+  //展开后的下标 -> 非零常量初值
+  std::map<size_t, SymbolPtr> literals;
+  //初值为0的元素和模板中的元素不需要再单独赋值
+  std::unordered_map<ThreeAddressCode *, size_t> literal_tacs;
+  std::vector<ThreeAddressCode *> zero_tacs;
+  //运行时才能求出初值的元素
+  std::vector<bool> stored(size, false);
+  for (auto &tac : *init_tac) {
+    if (tac->operation_ != TACOperationType::Assign || tac->a_->value_.Type() != SymbolValue::ValueType::Array) {
+      continue;
+    }
+    auto offset_sym = tac->a_->value_.GetArrayDescriptor()->base_offset;
+    if (!offset_sym->IsLiteral() || offset_sym->value_.Type() != SymbolValue::ValueType::Int) {
+      return false;
+    }
+    size_t offset = offset_sym->value_.GetInt();
+    auto &value = tac->b_->value_;
+    if (!tac->b_->IsLiteral() || value.Type() != value_type) {
+      stored[offset] = true;
+    } else if (value.Type() == SymbolValue::ValueType::Int
+                   ? value.GetInt() == 0
+                   : (value.GetFloat() == 0 && !std::signbit(value.GetFloat()))) {
+      zero_tacs.push_back(tac.get());
+    } else {
+      literals[offset] = tac->b_;
+      literal_tacs[tac.get()] = offset;
+    }
+  }
+
+  //把相距不远的常量连成一段，常量太少的段还是逐个赋值
+  std::vector<std::pair<size_t, size_t>> runs;
+  auto flush = [&](std::map<size_t, SymbolPtr>::iterator first, std::map<size_t, SymbolPtr>::iterator last) -> void {
+    if ((size_t)std::distance(first, last) < ARRAY_TEMPLATE_MIN_RUN) {
+      for (; first != last; ++first) {
+        stored[first->first] = true;
+      }
+      return;
+    }
+    runs.emplace_back(first->first, std::prev(last)->first + 1);
+  };
+  auto first = literals.begin();
+  for (auto it = literals.begin(); it != literals.end(); ++it) {
+    if (it != first && it->first - std::prev(it)->first - 1 > ARRAY_TEMPLATE_MAX_GAP) {
+      flush(first, it);
+      first = it;
+    }
+  }
+  flush(first, literals.end());
+  //数组两头不长的0也一起复制，省掉一次清零
+  if (!runs.empty() && runs.front().first <= ARRAY_TEMPLATE_MAX_GAP) {
+    runs.front().first = 0;
+  }
+  if (!runs.empty() && size - runs.back().second <= ARRAY_TEMPLATE_MAX_GAP) {
+    runs.back().second = size;
+  }
+  std::vector<SymbolPtr> template_values;
+  for (auto &[lo, hi] : runs) {
+    for (size_t i = lo; i < hi; i++) {
+      auto it = literals.find(i);
+      template_values.push_back(it == literals.end() ? nullptr : it->second);
+    }
+  }
+
+  auto template_exp = runs.empty() ? nullptr : NewExp(NewTACList(), CreateArrayTemplate(value_type, template_values));
+  size_t template_offset = 0;
+  size_t gap_begin = 0;
+  //清零[gap_begin, gap_end)中没有运行时初值的部分
+  auto clear_gap = [&](size_t gap_end) -> void {
+    while (gap_begin < gap_end && stored[gap_begin]) {
+      gap_begin++;
+    }
+    while (gap_end > gap_begin && stored[gap_end - 1]) {
+      gap_end--;
+    }
+    if (gap_begin < gap_end) {
+      AppendArrayClear(array, gap_begin, gap_end - gap_begin);
+    }
+  };
+  for (auto &[lo, hi] : runs) {
+    clear_gap(lo);
+    auto dst = AccessFlattenedArray(NewExp(NewTACList(), array->ret), lo);
+    auto src = AccessFlattenedArray(template_exp, template_offset);
+    (*array->tac) += dst->tac;
+    (*array->tac) += NewTAC(TACOperationType::ArgumentAddress, dst->ret);
+    (*array->tac) += NewTAC(TACOperationType::ArgumentAddress, src->ret);
+    (*array->tac) += NewTAC(TACOperationType::Argument, CreateConstExp((int)(hi - lo))->ret);
+    (*array->tac) += NewTAC(TACOperationType::Call, nullptr, NewSymbol(SymbolType::Function, "_builtin_copy"));
+    template_offset += hi - lo;
+    gap_begin = hi;
+  }
+  clear_gap(size);
+
+  std::unordered_set<ThreeAddressCode *> skipped(zero_tacs.begin(), zero_tacs.end());
+  for (auto &[tac, offset] : literal_tacs) {
+    if (!stored[offset]) {
+      skipped.insert(tac);
+    }
+  }
+  for (auto &tac : *init_tac) {
+    if (!skipped.count(tac.get())) {
+      (*array->tac) += tac;
+    }
+  }
+  return true;
+}
+
+ExpressionPtr TACBuilder::AccessFlattenedArray(ExpressionPtr array, size_t offset) {
+  //直接构造元素，不经过AccessArray，否则常量数组会把清零和复制用到的元素记成初值
+  auto arrayDescriptor = array->ret->value_.GetArrayDescriptor();
+  auto nArrayDescriptor = NewArrayDescriptor();
+  nArrayDescriptor->base_addr = arrayDescriptor->base_addr;
+  nArrayDescriptor->value_type = arrayDescriptor->value_type;
+  nArrayDescriptor->base_offset =
+      CreateConstExp(static_cast<int>(arrayDescriptor->base_offset->value_.GetInt() + offset))->ret;
+  return NewExp(array->tac, NewSymbol(array->ret->type_, std::nullopt, SymbolValue(nArrayDescriptor)));
+}
+
+void TACBuilder::AppendArrayClear(ExpressionPtr array, size_t begin, size_t count) {
+  auto elem = AccessFlattenedArray(NewExp(NewTACList(), array->ret), begin);
+  (*array->tac) += elem->tac;
+  (*array->tac) += NewTAC(TACOperationType::ArgumentAddress, elem->ret);
+  (*array->tac) += NewTAC(TACOperationType::Argument, CreateConstExp((int)count)->ret);
+  (*array->tac) += NewTAC(TACOperationType::Call, nullptr, NewSymbol(SymbolType::Function, "_builtin_clear"));
+}
+
+SymbolPtr TACBuilder::CreateArrayTemplate(SymbolValue::ValueType type, const std::vector<SymbolPtr> &values) {
+  auto ad = NewArrayDescriptor();
+  ad->dimensions.push_back(values.size());
+  ad->value_type = type;
+  ad->base_offset = CreateConstExp((int)0)->ret;
+  auto name = AppendScopePrefix(TACFactory::Instance()->ToArrayTemplateName(cur_array_template_++), 0);
+  auto sym = NewSymbol(SymbolType::Constant, name, SymbolValue(ad));
+  ad->base_addr = sym;
+  (*array_template_tac_) += NewTAC(TACOperationType::Constant, sym);
+  auto template_exp = NewExp(NewTACList(), sym);
+  for (size_t i = 0; i < values.size(); i++) {
+    if (values[i] != nullptr) {
+      (*array_template_tac_) += NewTAC(TACOperationType::Assign, AccessFlattenedArray(template_exp, i)->ret, values[i]);
+    }
+  }
+  return sym;
+}
 void TACBuilder::EnterSubscope() { symbol_stack_.emplace_back(cur_symtab_id_++); }
 
 void TACBuilder::ExitSubscope() { symbol_stack_.pop_back(); }
@@ -1039,7 +1269,11 @@ ExpressionPtr TACBuilder::RemoveDirectArray(ExpressionPtr exp) {
   return exp;
 }
 
-void TACBuilder::SetTACList(TACListPtr tac_list) { tac_list_ = tac_list; }
+void TACBuilder::SetTACList(TACListPtr tac_list) {
+  //数组初始化模板要在使用前声明
+  tac_list_ = NewTACList(array_template_tac_);
+  (*tac_list_) += tac_list;
+}
 
 void TACBuilder::SetLocation(HaveFunCompiler::Parser::location *plocation) { plocation_ = plocation; }
 
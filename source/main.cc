@@ -21,7 +21,13 @@
 
 using namespace HaveFunCompiler::AssemblyBuilder;
 
-enum class ArgType { SourceFile, TargetFile, _o, OP, Others };
+enum class ArgType { SourceFile, TargetFile, _o, OP, IDIV, MEMO, STATIC, L1CACHE, UNROLL_TIMES, UNROLLED_INSNS, Others };
+
+// L1数据缓存大小(KB)，循环分块按它选择块的大小
+const std::string L1_CACHE_PARAM = "--param=l1-cache-size=";
+// 循环部分展开的最大因子，以及展开后循环体的最大tac数
+const std::string MAX_UNROLL_TIMES_PARAM = "--param=max-unroll-times=";
+const std::string MAX_UNROLLED_INSNS_PARAM = "--param=max-unrolled-insns=";
 
 ArgType analyzeArg(const char *arg)
 {
@@ -33,6 +39,22 @@ ArgType analyzeArg(const char *arg)
       return ArgType::_o;
     else if (s == "-O2")
       return ArgType::OP;
+    // 目标处理器带有硬件整数除法
+    else if (s == "-mattr=+idiv" || s == "-march=armv7ve" || s == "-mcpu=cortex-a7" || s == "-mcpu=cortex-a12" ||
+             s == "-mcpu=cortex-a15" || s == "-mcpu=cortex-a17")
+      return ArgType::IDIV;
+    // 纯递归函数按实参记忆结果
+    else if (s == "-fmemoize")
+      return ArgType::MEMO;
+    // 不会递归重入的函数中的大局部数组静态分配
+    else if (s == "-fstatic-arrays")
+      return ArgType::STATIC;
+    else if (s.compare(0, L1_CACHE_PARAM.length(), L1_CACHE_PARAM) == 0)
+      return ArgType::L1CACHE;
+    else if (s.compare(0, MAX_UNROLL_TIMES_PARAM.length(), MAX_UNROLL_TIMES_PARAM) == 0)
+      return ArgType::UNROLL_TIMES;
+    else if (s.compare(0, MAX_UNROLLED_INSNS_PARAM.length(), MAX_UNROLLED_INSNS_PARAM) == 0)
+      return ArgType::UNROLLED_INSNS;
     return ArgType::Others;
   }
   else
@@ -48,6 +70,12 @@ ArgType analyzeArg(const char *arg)
 }
 
 int OP_flag = 0;
+int IDIV_flag = 0;
+int MEMO_flag = 0;
+int STATIC_flag = 0;
+int L1_CACHE_SIZE = 32;
+int MAX_UNROLL_TIMES = 4;
+int MAX_UNROLLED_INSNS = 64;
 
 int main(const int arg, const char **argv) {
   HaveFunCompiler::Parser::Driver driver;
@@ -68,6 +96,30 @@ int main(const int arg, const char **argv) {
     else if (res == ArgType::OP) {
       OP_flag = 1;
     }
+    else if (res == ArgType::IDIV) {
+      IDIV_flag = 1;
+    }
+    else if (res == ArgType::MEMO) {
+      MEMO_flag = 1;
+    }
+    else if (res == ArgType::STATIC) {
+      STATIC_flag = 1;
+    }
+    else if (res == ArgType::L1CACHE) {
+      int size = atoi(argv[i] + L1_CACHE_PARAM.length());
+      if (size > 0)
+        L1_CACHE_SIZE = size;
+    }
+    else if (res == ArgType::UNROLL_TIMES) {
+      int times = atoi(argv[i] + MAX_UNROLL_TIMES_PARAM.length());
+      if (times > 0)
+        MAX_UNROLL_TIMES = times;
+    }
+    else if (res == ArgType::UNROLLED_INSNS) {
+      int insns = atoi(argv[i] + MAX_UNROLLED_INSNS_PARAM.length());
+      if (insns > 0)
+        MAX_UNROLLED_INSNS = insns;
+    }
   }
   if (input == nullptr || !driver.parse(input)) {
     return -1;
@@ -0,0 +1,286 @@
+#include <gtest/gtest.h>
+#include "ASM/arm/ArmBuilder.hh"
+#include <algorithm>
+#include <functional>
+#include <regex>
+#include <sstream>
+#include <string>
+
+#include "Driver.hh"
+#include "TACDriver.hh"
+
+using namespace HaveFunCompiler;
+using namespace HaveFunCompiler::ThreeAddressCode;
+using namespace HaveFunCompiler::AssemblyBuilder;
+
+// 编译选项在main.cc中定义，测试程序不链接main.cc
+int OP_flag = 0;
+int IDIV_flag = 0;
+int MEMO_flag = 0;
+int STATIC_flag = 0;
+int L1_CACHE_SIZE = 32;
+int MAX_UNROLL_TIMES = 4;
+int MAX_UNROLLED_INSNS = 64;
+
+namespace {
+//edit不为空时在生成汇编之前修改三地址码
+std::string Compile(const std::string &source, const std::function<void(TACListPtr)> &edit = nullptr) {
+  HaveFunCompiler::Parser::Driver driver;
+  HaveFunCompiler::Parser::TACDriver tacdriver;
+  std::stringstream src(source), ss;
+  EXPECT_TRUE(driver.parse(src));
+  driver.print(ss) << "\n";
+  EXPECT_TRUE(tacdriver.parse(ss));
+  auto tac_list = tacdriver.get_tacbuilder()->GetTACList();
+  if (edit) {
+    edit(tac_list);
+  }
+  ArmBuilder builder(tac_list);
+  std::string output;
+  EXPECT_TRUE(builder.Translate(&output));
+  return output;
+}
+
+//标号label之后的一行和之前最近的段声明
+std::string DataOf(const std::string &output, const std::string &label) {
+  auto pos = output.find("\n" + label + ":\n");
+  if (pos == std::string::npos) {
+    return "";
+  }
+  auto section = output.rfind("\n.", output.rfind("\n.align", pos) - 1);
+  auto begin = pos + label.size() + 3;
+  return output.substr(section + 1, output.find('\n', section + 1) - section) +
+         output.substr(begin, output.find('\n', begin) - begin);
+}
+
+//函数label的汇编，到下一个段声明为止
+std::string FunctionOf(const std::string &output, const std::string &label) {
+  auto begin = output.find("\n" + label + ":\n");
+  if (begin == std::string::npos) {
+    return "";
+  }
+  begin += label.size() + 3;
+  return output.substr(begin, output.find("\n.text", begin) - begin);
+}
+}  // namespace
+
+// 只有结果仅取决于实参的递归函数才查表
+TEST(ArmBuilder, MemoizeOnlyPureFunctions) {
+  MEMO_flag = 1;
+  auto output = Compile(
+      "int g;\n"
+      "int fib(int n) { if (n < 2) return n; return fib(n - 1) + fib(n - 2); }\n"
+      "int fibg(int n) { if (n < 2) return g; return fibg(n - 1) + fibg(n - 2); }\n"
+      "int main() { g = getint(); return fib(g) + fibg(g); }\n");
+  MEMO_flag = 0;
+  EXPECT_NE(output.find("S0U_fib_memo:"), std::string::npos);
+  EXPECT_EQ(output.find("S0U_fibg_memo"), std::string::npos);
+}
+
+// 整数字面量按元素类型转换成浮点数，整个数组放进只读段，main中不再初始化
+TEST(ArmBuilder, StaticInitMixedLiteralFloatArray) {
+  auto output = Compile(
+      "const float c[3] = {1.5, 2, 3.5};\n"
+      "int main() { putfloat(c[1]); return 0; }\n");
+  // 1.5f, 2.0f, 3.5f
+  EXPECT_EQ(DataOf(output, "S0U_c"), ".section .rodata\n.word 1069547520, 1073741824, 1080033280");
+  EXPECT_EQ(output.find("vpush {s16-s31}"), std::string::npos);
+}
+
+// 常量数组的初始化只有一部分能在编译期求值时，其余的赋值在main中执行，数组不能放在只读段
+TEST(ArmBuilder, StaticInitPartialConstArray) {
+  auto output = Compile(
+      "int b = 7;\n"
+      "const int d[3] = {3, 4, 5};\n"
+      "int main() { int i = getint(); return d[i]; }\n",
+      [](TACListPtr tac_list) {
+        SymbolPtr b;
+        for (auto &tac : *tac_list) {
+          if (tac->operation_ != TACOperationType::Assign) {
+            continue;
+          }
+          if (tac->a_->get_tac_name(true) == "S0U_b") {
+            b = tac->a_;
+          }
+          //把 d[1] = 4 换成编译期不求值的 d[1] = b
+          if (tac->a_->value_.Type() == SymbolValue::ValueType::Array &&
+              tac->a_->get_tac_name() == "S0U_d[1]") {
+            tac->b_ = b;
+          }
+        }
+      });
+  EXPECT_EQ(DataOf(output, "S0U_d"), ".data\n.word 3");
+}
+
+// 乘法结果只被加减一次时合并成mla，乘2的幂合并成移位的减法
+TEST(ArmBuilder, SelectFusedMultiply) {
+  OP_flag = 1;
+  auto output = Compile(
+      "int f(int a, int b, int c) { return a * b + c; }\n"
+      "int g(int a, int c) { return c - a * 8; }\n"
+      "int main() { int a = getint(); int b = getint(); putint(f(a, b, 3)); return g(a, b); }\n");
+  OP_flag = 0;
+  auto f = FunctionOf(output, "S0U_f");
+  EXPECT_NE(f.find("\nmla "), std::string::npos);
+  EXPECT_EQ(f.find("\nmul "), std::string::npos);
+  auto g = FunctionOf(output, "S0U_g");
+  EXPECT_NE(g.find(", LSL #3\n"), std::string::npos);
+  EXPECT_EQ(g.find("\nmul "), std::string::npos);
+}
+
+// 标量全局变量放在同一块中，函数只取一次块的基址，之后用立即数偏移访问
+TEST(ArmBuilder, GlobalAnchor) {
+  OP_flag = 1;
+  auto output = Compile(
+      "int a;\n"
+      "int b;\n"
+      "float c;\n"
+      "void f(int x) { a = a + x; b = b * x; c = c + 1.0; }\n"
+      "int main() { f(getint()); putint(a + b); return 0; }\n");
+  OP_flag = 0;
+  auto f = FunctionOf(output, "S0U_f");
+  auto anchor = f.find("movw r");
+  ASSERT_NE(anchor, std::string::npos);
+  auto reg = f.substr(anchor + 5, f.find(',', anchor) - anchor - 5);
+  EXPECT_EQ(f.substr(anchor, f.find('\n', anchor) - anchor), "movw " + reg + ", #:lower16:_global_anchor");
+  EXPECT_EQ(f.find("movw", anchor + 1), std::string::npos);
+  EXPECT_NE(f.find(", [" + reg + ", #0]"), std::string::npos);
+  EXPECT_NE(f.find(", [" + reg + ", #4]"), std::string::npos);
+  EXPECT_NE(f.find(", [" + reg + ", #8]"), std::string::npos);
+}
+
+// 调用后不再用到调用者保存的寄存器时，调用前后不用保存，ip只在序言中保存一次
+TEST(ArmBuilder, SaveOnlyLiveCallerSavedRegisters) {
+  OP_flag = 1;
+  auto output = Compile(
+      "int f(int a) { return a + 1; }\n"
+      "int main() { int a = getint(); putint(f(a)); putint(f(a + 2)); return 0; }\n");
+  OP_flag = 0;
+  auto main = FunctionOf(output, "S0U_main");
+  ASSERT_EQ(main.find("push {"), 0);
+  EXPECT_NE(main.substr(0, main.find('\n')).find("ip"), std::string::npos);
+  EXPECT_EQ(main.find("\npush {"), std::string::npos);
+  EXPECT_EQ(main.find("vpush {s1"), std::string::npos);
+}
+
+// 有硬件除法时除法用sdiv，取模用sdiv和mls，不调用库函数
+TEST(ArmBuilder, HardwareDivide) {
+  const std::string source =
+      "int f(int a, int b) { return a / b + a % b; }\n"
+      "int main() { return f(getint(), getint()); }\n";
+  OP_flag = 1;
+  auto f = FunctionOf(Compile(source), "S0U_f");
+  EXPECT_NE(f.find("bl __aeabi_idiv\n"), std::string::npos);
+  EXPECT_NE(f.find("bl __aeabi_idivmod\n"), std::string::npos);
+  IDIV_flag = 1;
+  f = FunctionOf(Compile(source), "S0U_f");
+  IDIV_flag = 0;
+  OP_flag = 0;
+  EXPECT_EQ(f.find("bl __aeabi"), std::string::npos);
+  EXPECT_NE(f.find("\nsdiv "), std::string::npos);
+  EXPECT_NE(f.find("\nmls "), std::string::npos);
+}
+
+// 叶函数不保存lr，用bx lr返回；开头的 if (n < 2) return n; 在序言之前处理
+TEST(ArmBuilder, LeafFunctionAndEarlyReturn) {
+  OP_flag = 1;
+  auto output = Compile(
+      "int fib(int n) { if (n < 2) return n; return fib(n - 1) + fib(n - 2); }\n"
+      "int sq(int a) { return a * a; }\n"
+      "int main() { return fib(getint()) + sq(3); }\n");
+  OP_flag = 0;
+  auto fib = FunctionOf(output, "S0U_fib");
+  EXPECT_EQ(fib.find("cmp r0, #2\nbxlt lr\npush {"), 0);
+  auto sq = FunctionOf(output, "S0U_sq");
+  EXPECT_EQ(sq.find("push"), std::string::npos);
+  EXPECT_EQ(sq.find("lr}"), std::string::npos);
+  EXPECT_NE(sq.find("\nbx lr\n"), std::string::npos);
+}
+
+// 栈帧很大时，离sp很远的栈上传参通过保存了入口sp的帧基址寄存器直接访问
+TEST(ArmBuilder, FrameBaseRegister) {
+  OP_flag = 1;
+  auto output = Compile(
+      "int f(int a, int b, int c, int d, int e, float x) {\n"
+      "  int arr[2000];\n"
+      "  arr[a] = e;\n"
+      "  putfloat(x);\n"
+      "  return arr[b] + e;\n"
+      "}\n"
+      "int main() { return f(1, 1, 2, 3, 4, 5.0); }\n");
+  OP_flag = 0;
+  auto f = FunctionOf(output, "S0U_f");
+  std::smatch base;
+  ASSERT_TRUE(std::regex_search(f, base, std::regex("\nadd (\\w+), sp, #\\d+\nsub sp, sp, #8000\n")));
+  EXPECT_NE(base[1], "sp");
+  std::smatch param;
+  ASSERT_TRUE(std::regex_search(f, param, std::regex("// param int S1U_e\nldr \\w+, \\[(\\w+), #0\\]\n")));
+  EXPECT_EQ(param[1], base[1]);
+}
+
+// 局部数组的字面量初值放在只读段的模板中整段复制，只清零既没有字面量也没有运行时初值的部分
+TEST(ArmBuilder, LocalArrayTemplate) {
+  auto output = Compile(
+      "int main() {\n"
+      "  int a[10] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10};\n"
+      "  int b[40] = {getint(), 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 3, 4};\n"
+      "  return a[getint()] + b[getint()];\n"
+      "}\n");
+  EXPECT_EQ(DataOf(output, "S0ST_0"), ".section .rodata\n.word 1, 2, 3, 4, 5, 6, 7, 8, 9, 10");
+  //数组末尾不长的0并入模板
+  EXPECT_EQ(DataOf(output, "S0ST_1"), ".section .rodata\n.word 1, 2, 3, 4");
+  auto main = FunctionOf(output, "S0U_main");
+  auto copy = main.find("bl _builtin_copy\n");
+  ASSERT_NE(copy, std::string::npos);
+  EXPECT_NE(main.find("bl _builtin_copy\n", copy + 1), std::string::npos);
+  // b[0]有运行时初值，只清零b[1]到b[19]
+  auto clear = main.find("// arg & S1U_b[1]\n// arg 19\n");
+  ASSERT_NE(clear, std::string::npos);
+  EXPECT_EQ(main.find("bl _builtin_clear\n"), main.find("bl _builtin_clear\n", clear));
+  EXPECT_EQ(main.find("bl _builtin_clear\n", main.find("bl _builtin_clear\n") + 1), std::string::npos);
+}
+
+// 不超过16个字的清零在调用处用stm展开，更长的才调用_builtin_clear
+TEST(ArmBuilder, InlineSmallClear) {
+  OP_flag = 1;
+  auto output = Compile(
+      "int main() { int a[12] = {getint()}; int b[100] = {getint()}; return a[getint()] + b[getint()]; }\n");
+  OP_flag = 0;
+  auto main = FunctionOf(output, "S0U_main");
+  auto begin = main.find("// arg 11\n// call _builtin_clear\n");
+  ASSERT_NE(begin, std::string::npos);
+  auto end = main.find("\n// ", begin + 30);
+  std::istringstream inlined(main.substr(begin, end - begin));
+  int words = 0;
+  for (std::string line; std::getline(inlined, line);) {
+    EXPECT_EQ(line.find("bl "), std::string::npos) << line;
+    //地址后面的每个逗号对应寄存器列表中的一个寄存器
+    if (line.compare(0, 3, "stm") == 0) {
+      words += static_cast<int>(std::count(line.begin(), line.end(), ','));
+    }
+  }
+  EXPECT_EQ(words, 11);
+  EXPECT_NE(main.find("mov r1, #99\nbl _builtin_clear\n"), std::string::npos);
+}
+
+// 不会递归的函数中不小于1KB的局部数组放在.bss中，递归函数和小数组仍在栈上
+TEST(ArmBuilder, StaticLocalArrays) {
+  STATIC_flag = 1;
+  auto output = Compile(
+      "int r(int n) { int b[1000]; b[n] = n; if (n == 0) return b[0]; return r(n - 1) + b[n]; }\n"
+      "int main() {\n"
+      "  int a[1000];\n"
+      "  int c[10];\n"
+      "  a[getint()] = 1;\n"
+      "  c[getint()] = 2;\n"
+      "  return a[getint()] + c[getint()] + r(3);\n"
+      "}\n");
+  STATIC_flag = 0;
+  EXPECT_EQ(DataOf(output, "S2U_a"), ".bss\n.skip 4000");
+  EXPECT_EQ(DataOf(output, "S1U_b"), "");
+  EXPECT_EQ(DataOf(output, "S2U_c"), "");
+  auto main = FunctionOf(output, "S0U_main");
+  EXPECT_NE(main.find("sub sp, sp, #40\n"), std::string::npos);
+  EXPECT_NE(main.find("// int[1000] S2U_a\nmovw r"), std::string::npos);
+  EXPECT_NE(FunctionOf(output, "S0U_r").find("sub sp, sp, #4000\n"), std::string::npos);
+}
\ No newline at end of file
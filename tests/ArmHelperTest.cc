@@ -30,4 +30,54 @@ TEST(ArmHelper, DivideIntoImmediateValues) {
       ASSERT_TRUE(ArmHelper::IsImmediateValue(v));
     }
   }
+}
+
+TEST(ArmHelper, SequentializeParallelMoves) {
+  // 每条赋值 dst <- srcs之和，顺序执行的结果要与同时赋值相同
+  std::vector<std::vector<ParallelMove>> cases = {
+      {{1, {2}, 0}, {2, {1}, 1}},
+      {{1, {2}, 0}, {2, {3}, 1}, {3, {1}, 2}, {0, {1}, 3}},
+      {{1, {2}, 0}, {2, {1, 3}, 1}, {3, {2}, 2}},
+      {{0, {5}, 0}, {1, {0, 6}, 1}, {2, {1}, 2}},
+  };
+  for (auto &moves : cases) {
+    std::vector<int> expect(16), regs(16);
+    for (int i = 0; i < 16; i++) {
+      expect[i] = regs[i] = i * 100 + 7;
+    }
+    for (auto &move : moves) {
+      expect[move.dst] = 0;
+      for (auto src : move.srcs) {
+        expect[move.dst] += regs[src];
+      }
+    }
+    auto seq = ArmHelper::SequentializeParallelMoves(moves, {4, 0});
+    int nmoves = 0;
+    for (auto &move : seq) {
+      int val = 0;
+      for (auto src : move.srcs) {
+        val += regs[src];
+      }
+      regs[move.dst] = val;
+      nmoves += (move.id != -1);
+    }
+    EXPECT_EQ(nmoves, static_cast<int>(moves.size()));
+    for (auto &move : moves) {
+      EXPECT_EQ(expect[move.dst], regs[move.dst]);
+    }
+  }
+}
+
+TEST(ArmHelper, EmitLoadImmediate) {
+  std::vector<std::pair<uint32_t, std::string>> cases = {
+      {255, "mov r0, #255\n"},
+      {static_cast<uint32_t>(-256), "mvn r0, #255\n"},
+      {4097, "movw r0, #4097\n"},
+      {0x12345678, "movw r0, #22136\nmovt r0, #4660\n"},
+  };
+  for (auto &[val, expect] : cases) {
+    std::string asm_str;
+    ArmHelper::EmitLoadImmediate([&asm_str](const std::string &line) { asm_str += line + "\n"; }, "r0", val);
+    EXPECT_EQ(expect, asm_str);
+  }
 }
\ No newline at end of file
@@ -0,0 +1,50 @@
+#include <gtest/gtest.h>
+#include "ASM/arm/ArmInst.hh"
+#include "ASM/arm/LiteralPoolManager.hh"
+
+using namespace HaveFunCompiler;
+using namespace HaveFunCompiler::AssemblyBuilder;
+
+namespace {
+//count条不引用文字池的指令
+std::string Filler(int count) {
+  std::string ret;
+  for (int i = 0; i < count; i++) {
+    ret += "add r1, r1, #1\n";
+  }
+  return ret;
+}
+}  // namespace
+
+//函数以无条件跳转结束时文字池直接放在最后，不需要跳过
+TEST(LiteralPoolManager, PoolAtFunctionEnd) {
+  auto insts = ParseArmInstList("ldr r0, =S0U_a\nbx lr\n");
+  LiteralPoolManager manager(&insts, "f");
+  manager.place();
+  EXPECT_EQ(ArmInstListToString(insts), "ldr r0, =S0U_a\nbx lr\n.ltorg\n");
+  EXPECT_EQ(manager.get_pool_count(), 1);
+  EXPECT_EQ(manager.get_branch_count(), 0);
+}
+
+//超出ldr的寻址范围前，文字池放到之前的无条件跳转后面
+TEST(LiteralPoolManager, PoolAfterUnconditionalJump) {
+  auto insts = ParseArmInstList("ldr r0, =S0U_a\nb S1SL_0\n" + Filler(1100) + "S1SL_0:\nbx lr\n");
+  LiteralPoolManager manager(&insts, "f");
+  manager.place();
+  auto text = ArmInstListToString(insts);
+  EXPECT_EQ(text.find("ldr r0, =S0U_a\nb S1SL_0\n.ltorg\nadd"), 0);
+  EXPECT_EQ(manager.get_pool_count(), 1);
+  EXPECT_EQ(manager.get_branch_count(), 0);
+}
+
+//没有无条件跳转时只能插入跳过文字池的b
+TEST(LiteralPoolManager, PoolWithBranch) {
+  auto insts = ParseArmInstList("ldr r0, =S0U_a\n" + Filler(1100) + "bx lr\n");
+  LiteralPoolManager manager(&insts, "f");
+  manager.place();
+  auto text = ArmInstListToString(insts);
+  EXPECT_NE(text.find("b _literal_pool_f_0\n.ltorg\n_literal_pool_f_0:\n"), std::string::npos);
+  EXPECT_EQ(text.find(".ltorg", text.find(".ltorg") + 1), std::string::npos);
+  EXPECT_EQ(manager.get_pool_count(), 1);
+  EXPECT_EQ(manager.get_branch_count(), 1);
+}
\ No newline at end of file
@@ -0,0 +1,680 @@
+#include <gtest/gtest.h>
+#include "ASM/Optimizer.hh"
+#include "ASM/SideEffectAnalyzer.hh"
+#include "TAC/Symbol.hh"
+#include "TAC/TAC.hh"
+#include <algorithm>
+#include <climits>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Driver.hh"
+#include "TACDriver.hh"
+
+using namespace HaveFunCompiler;
+using namespace HaveFunCompiler::ThreeAddressCode;
+using namespace HaveFunCompiler::AssemblyBuilder;
+
+namespace
+{
+// 直接执行三地址码，用来比较优化前后的结果
+// 只支持int标量、int数组和用户函数之间的调用，超过步数限制时抛出异常
+class TACInterpreter
+{
+public:
+    TACInterpreter(TACListPtr tacList, long long maxSteps = 1000000) : _tacls(tacList), _maxSteps(maxSteps)
+    {
+        // 函数之外的代码是全局变量的声明和初始化
+        Frame frame;
+        for (auto it = _tacls->begin(); it != _tacls->end(); ++it)
+        {
+            if ((*it)->operation_ == TACOperationType::FunctionBegin)
+            {
+                functions[(*std::prev(it))->a_->get_tac_name(true)] = std::prev(it);
+                while ((*it)->operation_ != TACOperationType::FunctionEnd)
+                    ++it;
+                continue;
+            }
+            if ((*it)->operation_ == TACOperationType::Label && std::next(it) != _tacls->end() &&
+                (*std::next(it))->operation_ == TACOperationType::FunctionBegin)
+                continue;
+            execute(it, &frame);
+        }
+    }
+
+    int call(const std::string &name, const std::vector<int> &args)
+    {
+        std::vector<Value> values;
+        for (auto arg : args)
+            values.push_back(Value{arg, {}});
+        return invoke(name, values);
+    }
+
+    int global(const std::string &name) const
+    {
+        for (auto &[sym, value] : globals)
+        {
+            if (sym->get_tac_name(true) == name)
+                return value;
+        }
+        throw std::runtime_error("unknown global " + name);
+    }
+
+    long long steps() const { return _steps; }
+
+private:
+    struct Array
+    {
+        std::shared_ptr<std::vector<int>> data;
+        int offset;
+    };
+    struct Value
+    {
+        int scalar;
+        Array array;
+    };
+    struct Frame
+    {
+        std::unordered_map<SymbolPtr, int> scalars;
+        std::unordered_map<SymbolPtr, Array> arrays;
+        std::vector<Value> args;
+    };
+
+    TACListPtr _tacls;
+    long long _maxSteps, _steps = 0;
+    std::unordered_map<std::string, TACList::iterator> functions;
+    std::unordered_map<SymbolPtr, int> globals;
+    std::unordered_map<SymbolPtr, Array> globalArrays;
+
+    Array &arrayOf(const SymbolPtr &base, Frame *frame)
+    {
+        auto it = frame->arrays.find(base);
+        if (it != frame->arrays.end())
+            return it->second;
+        auto global = globalArrays.find(base);
+        if (global == globalArrays.end())
+            throw std::runtime_error("unknown array " + base->get_tac_name(true));
+        return global->second;
+    }
+
+    int &element(const SymbolPtr &sym, Frame *frame)
+    {
+        auto ad = sym->value_.GetArrayDescriptor();
+        auto &array = arrayOf(ad->base_addr.lock(), frame);
+        int idx = array.offset + read(ad->base_offset, frame);
+        if (idx < 0 || idx >= static_cast<int>(array.data->size()))
+            throw std::runtime_error("index out of range");
+        return (*array.data)[idx];
+    }
+
+    int read(const SymbolPtr &sym, Frame *frame)
+    {
+        if (sym->IsLiteral())
+            return sym->value_.GetInt();
+        if (sym->value_.Type() == SymbolValue::ValueType::Array)
+            return element(sym, frame);
+        if (sym->IsGlobal())
+            return globals[sym];
+        auto it = frame->scalars.find(sym);
+        return it == frame->scalars.end() ? 0 : it->second;
+    }
+
+    void write(const SymbolPtr &sym, int value, Frame *frame)
+    {
+        if (sym->value_.Type() == SymbolValue::ValueType::Array)
+            element(sym, frame) = value;
+        else if (sym->IsGlobal())
+            globals[sym] = value;
+        else
+            frame->scalars[sym] = value;
+    }
+
+    int invoke(const std::string &name, const std::vector<Value> &args)
+    {
+        // 数组初始化用的两个内部函数，字数是最后一个实参
+        if (name == "_builtin_clear" || name == "_builtin_copy")
+        {
+            auto &dst = args.at(0).array;
+            for (int i = 0; i < args.back().scalar; ++i)
+            {
+                auto &src = args.at(1).array;
+                dst.data->at(dst.offset + i) = name == "_builtin_clear" ? 0 : src.data->at(src.offset + i);
+            }
+            return 0;
+        }
+        auto func = functions.find(name);
+        if (func == functions.end())
+            throw std::runtime_error("unknown function " + name);
+        Frame frame;
+        std::unordered_map<SymbolPtr, TACList::iterator> labels;
+        auto it = func->second;
+        for (auto end = it; (*end)->operation_ != TACOperationType::FunctionEnd; ++end)
+        {
+            if ((*end)->operation_ == TACOperationType::Label)
+                labels[(*end)->a_] = end;
+        }
+        size_t argIdx = 0;
+        for (++it; (*it)->operation_ != TACOperationType::FunctionEnd; ++it)
+        {
+            if (++_steps > _maxSteps)
+                throw std::runtime_error("step limit exceeded");
+            auto tac = *it;
+            switch (tac->operation_)
+            {
+            case TACOperationType::Parameter:
+                if (tac->a_->value_.Type() == SymbolValue::ValueType::Array)
+                {
+                    frame.arrays[tac->a_] = args.at(argIdx).array;
+                    frame.arrays[tac->a_->value_.GetArrayDescriptor()->base_addr.lock()] = args.at(argIdx).array;
+                }
+                else
+                    frame.scalars[tac->a_] = args.at(argIdx).scalar;
+                ++argIdx;
+                break;
+            case TACOperationType::Goto:
+                it = labels.at(tac->a_);
+                break;
+            case TACOperationType::IfZero:
+                if (read(tac->b_, &frame) == 0)
+                    it = labels.at(tac->a_);
+                break;
+            case TACOperationType::Return:
+                return tac->a_ ? read(tac->a_, &frame) : 0;
+            default:
+                execute(it, &frame);
+                break;
+            }
+        }
+        return 0;
+    }
+
+    void execute(TACList::iterator it, Frame *frame)
+    {
+        auto tac = *it;
+        auto x = [&]()
+        { return static_cast<unsigned>(read(tac->b_, frame)); };
+        auto y = [&]()
+        { return static_cast<unsigned>(read(tac->c_, frame)); };
+        switch (tac->operation_)
+        {
+        case TACOperationType::Variable:
+        case TACOperationType::Constant:
+            if (tac->a_->value_.Type() == SymbolValue::ValueType::Array)
+            {
+                auto ad = tac->a_->value_.GetArrayDescriptor();
+                Array array{std::make_shared<std::vector<int>>(ad->GetSizeInByte() / 4), 0};
+                if (tac->a_->IsGlobal())
+                    globalArrays[ad->base_addr.lock()] = array;
+                else
+                    frame->arrays[ad->base_addr.lock()] = array;
+            }
+            break;
+        case TACOperationType::Label:
+        case TACOperationType::FunctionBegin:
+        case TACOperationType::BlockBegin:
+        case TACOperationType::BlockEnd:
+            break;
+        case TACOperationType::Assign:
+            write(tac->a_, read(tac->b_, frame), frame);
+            break;
+        case TACOperationType::Add:
+            write(tac->a_, static_cast<int>(x() + y()), frame);
+            break;
+        case TACOperationType::Sub:
+            write(tac->a_, static_cast<int>(x() - y()), frame);
+            break;
+        case TACOperationType::Mul:
+            write(tac->a_, static_cast<int>(x() * y()), frame);
+            break;
+        case TACOperationType::Div:
+        case TACOperationType::Mod:
+        {
+            int a = read(tac->b_, frame), b = read(tac->c_, frame);
+            if (b == 0)
+                throw std::runtime_error("division by zero");
+            write(tac->a_, tac->operation_ == TACOperationType::Div ? a / b : a % b, frame);
+            break;
+        }
+        case TACOperationType::Equal:
+            write(tac->a_, read(tac->b_, frame) == read(tac->c_, frame), frame);
+            break;
+        case TACOperationType::NotEqual:
+            write(tac->a_, read(tac->b_, frame) != read(tac->c_, frame), frame);
+            break;
+        case TACOperationType::LessThan:
+            write(tac->a_, read(tac->b_, frame) < read(tac->c_, frame), frame);
+            break;
+        case TACOperationType::LessOrEqual:
+            write(tac->a_, read(tac->b_, frame) <= read(tac->c_, frame), frame);
+            break;
+        case TACOperationType::GreaterThan:
+            write(tac->a_, read(tac->b_, frame) > read(tac->c_, frame), frame);
+            break;
+        case TACOperationType::GreaterOrEqual:
+            write(tac->a_, read(tac->b_, frame) >= read(tac->c_, frame), frame);
+            break;
+        case TACOperationType::UnaryMinus:
+            write(tac->a_, static_cast<int>(0u - x()), frame);
+            break;
+        case TACOperationType::UnaryNot:
+            write(tac->a_, !read(tac->b_, frame), frame);
+            break;
+        case TACOperationType::UnaryPositive:
+            write(tac->a_, read(tac->b_, frame), frame);
+            break;
+        case TACOperationType::Argument:
+            frame->args.push_back(Value{read(tac->a_, frame), {}});
+            break;
+        case TACOperationType::ArgumentAddress:
+        {
+            auto ad = tac->a_->value_.GetArrayDescriptor();
+            auto array = arrayOf(ad->base_addr.lock(), frame);
+            array.offset += read(ad->base_offset, frame);
+            frame->args.push_back(Value{0, array});
+            break;
+        }
+        case TACOperationType::Call:
+        {
+            auto args = std::move(frame->args);
+            frame->args.clear();
+            int ret = invoke(tac->b_->get_tac_name(true), args);
+            if (tac->a_)
+                write(tac->a_, ret, frame);
+            break;
+        }
+        default:
+            throw std::runtime_error("unsupported tac " + tac->ToString());
+        }
+    }
+};
+}
+
+class OptimizerTest : public ::testing::Test
+{
+protected:
+    HaveFunCompiler::Parser::Driver driver;
+    HaveFunCompiler::Parser::TACDriver tacDriver;
+    TACListPtr tacList;
+    std::shared_ptr<SideEffectAnalyzer> sideEffect;
+
+    // 把SysY源程序翻译成三地址码
+    void parse(const std::string &source)
+    {
+        std::stringstream src(source), ss;
+        ASSERT_TRUE(driver.parse(src));
+        driver.print(ss) << "\n";
+        ASSERT_TRUE(tacDriver.parse(ss));
+        tacList = tacDriver.get_tacbuilder()->GetTACList();
+        sideEffect = std::make_shared<SideEffectAnalyzer>(tacList);
+    }
+
+    // 函数的范围：从函数名标号到fend之后，与ArmBuilder传给各个优化的相同
+    std::pair<TACList::iterator, TACList::iterator> function(const std::string &name)
+    {
+        for (auto it = tacList->begin(); it != tacList->end(); ++it)
+        {
+            if ((*it)->operation_ != TACOperationType::Label || (*it)->a_->get_tac_name(true) != name)
+                continue;
+            auto end = it;
+            while ((*end)->operation_ != TACOperationType::FunctionEnd)
+                ++end;
+            return {it, std::next(end)};
+        }
+        throw std::runtime_error("unknown function " + name);
+    }
+
+    template <typename Pass, typename... Args>
+    void run(const std::string &name, Args... args)
+    {
+        auto [fbegin, fend] = function(name);
+        Pass pass(tacList, fbegin, fend, args...);
+        pass.optimize();
+    }
+
+    // 函数中某种tac的个数
+    int count(const std::string &name, TACOperationType op)
+    {
+        auto [fbegin, fend] = function(name);
+        int n = 0;
+        for (auto it = fbegin; it != fend; ++it)
+            n += (*it)->operation_ == op;
+        return n;
+    }
+};
+
+// 尾调用 f(b, a) 交换两个形参，并行赋值需要借助临时变量
+TEST_F(OptimizerTest, TailRecursionSwapsParameters)
+{
+    parse("int f(int a, int b, int n) { if (n == 0) return a * 10 + b; return f(b, a, n - 1); }\n"
+          "int main() { return 0; }\n");
+    std::vector<std::vector<int>> cases = {{1, 2, 0}, {1, 2, 1}, {1, 2, 3}, {3, 4, 4}, {5, 6, 7}};
+    std::vector<int> expected;
+    {
+        TACInterpreter interpreter(tacList);
+        for (auto &args : cases)
+            expected.push_back(interpreter.call("S0U_f", args));
+    }
+    run<TailRecursionEliminator>("S0U_f", sideEffect.get());
+    EXPECT_EQ(count("S0U_f", TACOperationType::Call), 0);
+    TACInterpreter interpreter(tacList);
+    for (size_t i = 0; i < cases.size(); ++i)
+        EXPECT_EQ(interpreter.call("S0U_f", cases[i]), expected[i]);
+    EXPECT_EQ(expected[2], 21);
+}
+
+// 改变数组形参的尾调用不处理
+TEST_F(OptimizerTest, TailRecursionKeepsChangedArrayParameter)
+{
+    parse("int b[4];\n"
+          "int f(int a[], int n) { if (n == 0) return a[0]; return f(b, n - 1); }\n"
+          "int main() { return 0; }\n");
+    run<TailRecursionEliminator>("S0U_f", sideEffect.get());
+    EXPECT_EQ(count("S0U_f", TACOperationType::Call), 1);
+}
+
+// 递归调用改变了全局变量g，return f(n - 1) + g 中的g不能提前到调用之前读
+TEST_F(OptimizerTest, TailRecursionKeepsGlobalAccumulator)
+{
+    parse("int g;\n"
+          "int f(int n) { if (n == 0) return 0; g = g + 1; return f(n - 1) + g; }\n"
+          "int main() { return 0; }\n");
+    run<TailRecursionEliminator>("S0U_f", sideEffect.get());
+    EXPECT_EQ(count("S0U_f", TACOperationType::Call), 1);
+}
+
+// 递归中调用了库函数时累加量同样不能提前读，getarray(g)写了g[0]，其他库函数也按可能写全局变量处理
+TEST_F(OptimizerTest, TailRecursionKeepsAccumulatorAfterLibraryCall)
+{
+    parse("int g[4];\n"
+          "int s;\n"
+          "int f(int n) { if (n == 0) return 0; getarray(g); return f(n - 1) + g[0]; }\n"
+          "int h(int n) { if (n == 0) return 0; putint(n); return h(n - 1) + s; }\n"
+          "int main() { return 0; }\n");
+    run<TailRecursionEliminator>("S0U_f", sideEffect.get());
+    run<TailRecursionEliminator>("S0U_h", sideEffect.get());
+    EXPECT_EQ(count("S0U_f", TACOperationType::Call), 2);
+    EXPECT_EQ(count("S0U_h", TACOperationType::Call), 2);
+}
+
+// 累加量是局部变量时仍然消除递归
+TEST_F(OptimizerTest, TailRecursionFoldsLocalAccumulator)
+{
+    parse("int f(int n) { if (n == 0) return 1; int x = n * 2; return x * f(n - 1); }\n"
+          "int main() { return 0; }\n");
+    TACInterpreter before(tacList);
+    int expected = before.call("S0U_f", {5});
+    run<TailRecursionEliminator>("S0U_f", sideEffect.get());
+    EXPECT_EQ(count("S0U_f", TACOperationType::Call), 0);
+    TACInterpreter after(tacList);
+    EXPECT_EQ(after.call("S0U_f", {5}), expected);
+    EXPECT_EQ(expected, 3840);
+}
+
+// 返回值没有用到的调用：写全局变量的保留，纯函数的删除
+TEST_F(OptimizerTest, DeadCodeKeepsCallWritingGlobal)
+{
+    parse("int g;\n"
+          "int inc(int n) { g = g + n; return g; }\n"
+          "int square(int n) { return n * n; }\n"
+          "int main() { int a = inc(2); int b = square(3); return 0; }\n");
+    run<DeadCodeOptimizer>("S0U_main", sideEffect.get());
+    auto [fbegin, fend] = function("S0U_main");
+    std::vector<std::string> callees;
+    for (auto it = fbegin; it != fend; ++it)
+    {
+        if ((*it)->operation_ == TACOperationType::Call)
+            callees.push_back((*it)->b_->get_tac_name(true));
+    }
+    EXPECT_EQ(callees, std::vector<std::string>{"S0U_inc"});
+    TACInterpreter interpreter(tacList);
+    interpreter.call("S0U_main", {});
+    EXPECT_EQ(interpreter.global("S0U_g"), 2);
+}
+
+// 库函数读写传给它的数组，getarray(g)写全局数组，getarray(a)通过数组形参写
+TEST_F(OptimizerTest, SideEffectOfLibraryArrayArguments)
+{
+    parse("int g[4];\n"
+          "void readGlobal() { getarray(g); }\n"
+          "void readParam(int a[]) { getarray(a); }\n"
+          "void putParam(int a[]) { putarray(2, a); }\n"
+          "int readLocal() { int b[4]; return getarray(b); }\n"
+          "int caller() { readParam(g); return 0; }\n"
+          "int main() { return 0; }\n");
+    auto summary = sideEffect->get_summary("S0U_readGlobal");
+    EXPECT_TRUE(summary->writeGlobal && summary->io);
+    summary = sideEffect->get_summary("S0U_readParam");
+    EXPECT_TRUE(summary->writeParamArray && !summary->writeGlobal);
+    summary = sideEffect->get_summary("S0U_putParam");
+    EXPECT_TRUE(summary->readParamArray);
+    summary = sideEffect->get_summary("S0U_readLocal");
+    EXPECT_TRUE(summary->io && !summary->writeGlobal && !summary->writeParamArray);
+    EXPECT_TRUE(sideEffect->get_summary("S0U_caller")->writeGlobal);
+}
+
+// 常量下标和只赋值一次的下标折叠成初值，形参下标和非常量数组保留
+TEST_F(OptimizerTest, ConstArrayFolding)
+{
+    parse("const int a[4] = {1, 2, 3};\n"
+          "int b[2] = {5, 6};\n"
+          "int f(int n) { int i = 1; return a[2] * 1000 + a[i] * 100 + a[3] * 10 + a[n] + b[1]; }\n"
+          "int main() { return 0; }\n");
+    std::vector<int> expected;
+    {
+        TACInterpreter interpreter(tacList);
+        for (int n = 0; n < 4; ++n)
+            expected.push_back(interpreter.call("S0U_f", {n}));
+    }
+    auto constArrays = ConstArrayFolder::collect(tacList);
+    run<ConstArrayFolder>("S0U_f", &constArrays);
+    std::vector<std::string> reads;
+    auto [fbegin, fend] = function("S0U_f");
+    for (auto it = fbegin; it != fend; ++it)
+    {
+        auto &tac = *it;
+        if (tac->operation_ == TACOperationType::Variable || tac->operation_ == TACOperationType::Constant)
+            continue;
+        for (auto &sym : {tac->b_, tac->c_})
+        {
+            if (sym && sym->value_.Type() == SymbolValue::ValueType::Array)
+                reads.push_back(sym->value_.GetArrayDescriptor()->base_addr.lock()->get_tac_name(true));
+        }
+    }
+    EXPECT_EQ(reads, (std::vector<std::string>{"S0U_a", "S0U_b"}));
+    TACInterpreter interpreter(tacList);
+    for (int n = 0; n < 4; ++n)
+        EXPECT_EQ(interpreter.call("S0U_f", {n}), expected[n]);
+    EXPECT_EQ(expected[0], 3207);
+}
+
+// 只用字面量下标的小数组拆成标量，作为实参传出去的数组不拆
+TEST_F(OptimizerTest, ArrayScalarizerKeepsArrayArgument)
+{
+    parse("int sum(int x[], int n) { int i = 0; int s = 0; while (i < n) { s = s + x[i]; i = i + 1; } return s; }\n"
+          "int f(int n) { int a[4] = {1, 2, 3, 4}; int b[3]; b[0] = n; b[1] = 2; b[2] = 3; a[2] = n; return a[1] * 100 + a[2] * 10 + sum(b, 3); }\n"
+          "int main() { return 0; }\n");
+    int expected = TACInterpreter(tacList).call("S0U_f", {5});
+    auto constArrays = ConstArrayFolder::collect(tacList);
+    run<ArrayScalarizer>("S0U_f", &constArrays);
+    std::vector<std::string> arrays;
+    auto [fbegin, fend] = function("S0U_f");
+    for (auto it = fbegin; it != fend; ++it)
+    {
+        auto &tac = *it;
+        for (auto &sym : {tac->a_, tac->b_, tac->c_})
+        {
+            if (sym && sym->value_.Type() == SymbolValue::ValueType::Array)
+            {
+                auto name = sym->value_.GetArrayDescriptor()->base_addr.lock()->get_tac_name(true);
+                if (std::find(arrays.begin(), arrays.end(), name) == arrays.end())
+                    arrays.push_back(name);
+            }
+        }
+    }
+    EXPECT_EQ(arrays, std::vector<std::string>{"S3U_b"});
+    EXPECT_EQ(TACInterpreter(tacList).call("S0U_f", {5}), expected);
+    EXPECT_EQ(expected, 260);
+}
+
+// 两个数组形参可能指向同一数组，通过b的写入之后不能把a[0]换成之前写入的值
+TEST_F(OptimizerTest, ArrayAccessKeepsAliasingParameters)
+{
+    parse("int f(int a[], int b[]) { a[0] = 1; b[0] = 2; return a[0]; }\n"
+          "int g(int a[], int n) { int c[2]; c[0] = n; c[1] = 3; return c[0] + a[0]; }\n"
+          "int main() { int x[1]; return f(x, x) * 10 + g(x, 5); }\n");
+    run<ArrayAccessOptimizer>("S0U_f", sideEffect.get());
+    run<ArrayAccessOptimizer>("S0U_g", sideEffect.get());
+    auto loads = [this](const std::string &name)
+    {
+        int n = 0;
+        auto [fbegin, fend] = function(name);
+        for (auto it = fbegin; it != fend; ++it)
+            n += (*it)->operation_ == TACOperationType::Assign && (*it)->b_->value_.Type() == SymbolValue::ValueType::Array;
+        return n;
+    };
+    EXPECT_EQ(loads("S0U_f"), 1);
+    EXPECT_EQ(loads("S0U_g"), 1);
+    EXPECT_EQ(TACInterpreter(tacList).call("S0U_main", {}), 27);
+}
+
+// 外层j内层i按列访问，交换后按行访问
+// A[i][j] = A[i - 1][j + 1]读的元素在原顺序中之后才写，交换后会先写再读，不能交换；读另一个数组B时可以交换
+TEST_F(OptimizerTest, LoopInterchangeChecksDependence)
+{
+    auto source = [](const std::string &rhs)
+    {
+        return "int A[16][16];\n"
+               "int B[16][16];\n"
+               "int f() {\n"
+               "  int k = 0; while (k < 256) { A[k / 16][k % 16] = k; B[k / 16][k % 16] = k * 3; k = k + 1; }\n"
+               "  int i; int j = 0;\n"
+               "  while (j < 15) { i = 1; while (i < 16) { A[i][j] = " + rhs + "; i = i + 1; } j = j + 1; }\n"
+               "  return A[15][0] * 100000 + A[8][7] * 100 + A[1][14];\n"
+               "}\n"
+               "int main() { return 0; }\n";
+    };
+    auto dump = [this]()
+    {
+        std::string text;
+        auto [fbegin, fend] = function("S0U_f");
+        for (auto it = fbegin; it != fend; ++it)
+            text += (*it)->ToString() + "\n";
+        return text;
+    };
+    parse(source("A[i - 1][j + 1] + 1"));
+    auto before = dump();
+    run<LoopNestOptimizer>("S0U_f", 32 * 1024);
+    EXPECT_EQ(dump(), before);
+
+    parse(source("A[i][j] * 2 + B[i - 1][j + 1]"));
+    int expected = TACInterpreter(tacList).call("S0U_f", {});
+    before = dump();
+    run<LoopNestOptimizer>("S0U_f", 32 * 1024);
+    EXPECT_NE(dump(), before);
+    EXPECT_EQ(TACInterpreter(tacList).call("S0U_f", {}), expected);
+}
+
+// 次数已知的小循环完全展开，不再有跳转
+TEST_F(OptimizerTest, LoopUnrollFully)
+{
+    parse("int f() { int s = 0; int i = 0; while (i < 4) { s = s + i * i; i = i + 1; } return s; }\n"
+          "int main() { return 0; }\n");
+    run<LoopUnroller>("S0U_f", 4, 64);
+    EXPECT_EQ(count("S0U_f", TACOperationType::Goto), 0);
+    EXPECT_EQ(count("S0U_f", TACOperationType::IfZero), 0);
+    EXPECT_EQ(TACInterpreter(tacList).call("S0U_f", {}), 14);
+}
+
+// 次数未知的循环展开4次，剩下的迭代由原来的循环执行
+TEST_F(OptimizerTest, LoopUnrollWithRemainder)
+{
+    parse("int f(int n) { int s = 0; int i = 0; while (i < n) { s = s * 3 + i; i = i + 1; } return s; }\n"
+          "int main() { return 0; }\n");
+    std::vector<int> cases = {-1, 0, 1, 3, 4, 5, 7, 8, 10};
+    std::vector<int> expected;
+    {
+        TACInterpreter interpreter(tacList);
+        for (auto n : cases)
+            expected.push_back(interpreter.call("S0U_f", {n}));
+    }
+    run<LoopUnroller>("S0U_f", 4, 64);
+    // 溢出检查、展开的循环、原来的循环各一个条件跳转
+    EXPECT_EQ(count("S0U_f", TACOperationType::IfZero), 3);
+    TACInterpreter interpreter(tacList);
+    for (size_t i = 0; i < cases.size(); ++i)
+        EXPECT_EQ(interpreter.call("S0U_f", {cases[i]}), expected[i]);
+    EXPECT_LT(interpreter.steps(), 1000);
+}
+
+// 界在循环中被修改时不展开
+TEST_F(OptimizerTest, LoopUnrollKeepsChangedBound)
+{
+    parse("int f(int n) { int s = 0; int i = 0; while (i < n) { s = s + i; n = n - 1; i = i + 1; } return s; }\n"
+          "int main() { return 0; }\n");
+    std::string before;
+    for (auto &tac : *tacList)
+        before += tac->ToString() + "\n";
+    run<LoopUnroller>("S0U_f", 4, 64);
+    std::string after;
+    for (auto &tac : *tacList)
+        after += tac->ToString() + "\n";
+    EXPECT_EQ(after, before);
+}
+
+// 界接近INT_MIN(递增)或INT_MAX(递减)时 n - (次数 - 1) * 步长会溢出，只能执行原来的循环
+TEST_F(OptimizerTest, LoopUnrollBoundNearIntLimits)
+{
+    parse("int f(int lo) { int s = 0; int i = lo; int lb = lo + 2; while (i < lb) { s = s + 1; i = i + 1; } return s; }\n"
+          "int g(int hi) { int s = 0; int i = hi; int hb = hi - 2; while (i > hb) { s = s + 1; i = i - 1; } return s; }\n"
+          "int main() { return 0; }\n");
+    run<LoopUnroller>("S0U_f", 4, 64);
+    run<LoopUnroller>("S0U_g", 4, 64);
+    TACInterpreter interpreter(tacList);
+    EXPECT_EQ(interpreter.call("S0U_f", {INT_MIN}), 2);
+    EXPECT_EQ(interpreter.call("S0U_f", {INT_MIN + 1}), 2);
+    EXPECT_EQ(interpreter.call("S0U_f", {0}), 2);
+    EXPECT_EQ(interpreter.call("S0U_g", {INT_MAX}), 2);
+    EXPECT_EQ(interpreter.call("S0U_g", {INT_MAX - 1}), 2);
+    EXPECT_EQ(interpreter.call("S0U_g", {0}), 2);
+}
+
+// 循环中读写的全局变量提升为局部变量，只在入口读一次、返回前写回一次；调用用户函数前后仍要写回和重新读入
+TEST_F(OptimizerTest, GlobalScalarPromotion)
+{
+    parse("int g;\n"
+          "int f(int n) { int i = 0; while (i < n) { g = g + i; i = i + 1; } return g; }\n"
+          "int h(int n) { g = g * 2; return n; }\n"
+          "int k(int n) { int i = 0; while (i < n) { g = g + i; i = i + 1; } h(0); while (i > 0) { g = g + i; i = i - 1; } return g; }\n"
+          "int main() { return 0; }\n");
+    auto globalRefs = [this](const std::string &name)
+    {
+        auto [fbegin, fend] = function(name);
+        int n = 0;
+        for (auto it = fbegin; it != fend; ++it)
+        {
+            for (auto sym : {(*it)->a_, (*it)->b_, (*it)->c_})
+                n += sym && sym->get_tac_name(true) == "S0U_g";
+        }
+        return n;
+    };
+    std::vector<int> expected;
+    {
+        TACInterpreter interpreter(tacList);
+        expected.push_back(interpreter.call("S0U_f", {10}));
+        expected.push_back(interpreter.call("S0U_k", {5}));
+        expected.push_back(interpreter.global("S0U_g"));
+    }
+    run<GlobalScalarPromoter>("S0U_f", sideEffect.get());
+    run<GlobalScalarPromoter>("S0U_k", sideEffect.get());
+    EXPECT_EQ(globalRefs("S0U_f"), 2);
+    EXPECT_EQ(globalRefs("S0U_k"), 4);
+    TACInterpreter interpreter(tacList);
+    EXPECT_EQ(interpreter.call("S0U_f", {10}), expected[0]);
+    EXPECT_EQ(interpreter.call("S0U_k", {5}), expected[1]);
+    EXPECT_EQ(interpreter.global("S0U_g"), expected[2]);
+    EXPECT_EQ(expected[0], 45);
+}
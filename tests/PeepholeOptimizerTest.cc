@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+#include "ASM/arm/ArmInst.hh"
+#include "ASM/arm/PeepholeOptimizer.hh"
+
+using namespace HaveFunCompiler;
+using namespace HaveFunCompiler::AssemblyBuilder;
+
+namespace {
+std::string Optimize(const std::string &text) {
+  auto insts = ParseArmInstList(text);
+  PeepholeOptimizer optimizer(&insts);
+  optimizer.optimize();
+  return ArmInstListToString(insts);
+}
+}  // namespace
+
+TEST(PeepholeOptimizer, ForwardStackSlot) {
+  auto insts = ParseArmInstList(
+      "str r4, [sp, #8]\n"
+      "ldr r5, [sp, #8]\n"
+      "str r4, [sp, #8]\n"
+      "add r4, r4, #1\n"
+      "ldr r6, [sp, #8]\n");
+  PeepholeOptimizer optimizer(&insts);
+  optimizer.optimize();
+  // r4被改写后不再知道哪个寄存器与栈槽相同，最后一条读保留
+  EXPECT_EQ(ArmInstListToString(insts),
+            "str r4, [sp, #8]\n"
+            "mov r5, r4\n"
+            "add r4, r4, #1\n"
+            "ldr r6, [sp, #8]\n");
+  EXPECT_EQ(optimizer.CountsToString(), "redundant-store=1 store-load=1");
+}
+
+//标签和跳转结束基本块，之后不能再转发
+TEST(PeepholeOptimizer, StackSlotNotForwardedAcrossLabel) {
+  auto text =
+      "str r4, [sp]\n"
+      "S1SL_1:\n"
+      "ldr r5, [sp]\n"
+      "bl putint\n"
+      "ldr r5, [sp]\n";
+  EXPECT_EQ(Optimize(text), text);
+}
+
+TEST(PeepholeOptimizer, RemoveSelfMoveAndBranchToNext) {
+  EXPECT_EQ(Optimize("mov r0, r0\n"
+                     "mov r1, r2\n"
+                     "mov r2, r1\n"
+                     "b S1SL_2\n"
+                     "S1SL_2:\n"
+                     "bx lr\n"),
+            "mov r1, r2\n"
+            "S1SL_2:\n"
+            "bx lr\n");
+}
+
+TEST(PeepholeOptimizer, RemoveGlobalStorePushPop) {
+  auto text =
+      "push {r4}\n"
+      "movw r4, #:lower16:S0U_g\n"
+      "movt r4, #:upper16:S0U_g\n"
+      "str r0, [r4]\n"
+      "pop {r4}\n";
+  // r4随后被重新赋值，push/pop可以去掉
+  EXPECT_EQ(Optimize(std::string(text) + "mov r4, #0\n"),
+            "movw r4, #:lower16:S0U_g\n"
+            "movt r4, #:upper16:S0U_g\n"
+            "str r0, [r4]\n"
+            "mov r4, #0\n");
+  // r4之后还要用
+  EXPECT_EQ(Optimize(std::string(text) + "mov r0, r4\n"), std::string(text) + "mov r0, r4\n");
+}
\ No newline at end of file
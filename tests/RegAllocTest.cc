@@ -3,6 +3,7 @@
 #include "ASM/LiveAnalyzer.hh"
 #include "ASM/arm/RegAllocator.hh"
 #include "TAC/TAC.hh"
+#include <map>
 #include <vector>
 #include <cstdlib>
 #include <cstring>
@@ -129,4 +130,61 @@ TEST(RegAllocTest, test)
         std::cout << s[i];
         std::cout << '\n';
     }
+}
+
+// 两段互不重叠的代码各有20个同时活跃的变量，溢出的变量可以共用栈槽，但共用栈槽的变量活跃区间不能相交
+TEST(RegAllocTest, ShareSpillSlots)
+{
+    HaveFunCompiler::Parser::Driver driver;
+    HaveFunCompiler::Parser::TACDriver tacdriver;
+
+    std::string source = "int f() {\n";
+    for (char phase : {'a', 'b'})
+    {
+        for (int i = 0; i < 20; ++i)
+            source += "int " + std::string(1, phase) + std::to_string(i) + " = getint();\n";
+        source += "putint(0";
+        for (int i = 0; i < 20; ++i)
+            source += " + " + std::string(1, phase) + std::to_string(i);
+        source += ");\n";
+    }
+    source += "return 0;\n}\nint main() { return f(); }\n";
+
+    std::stringstream src(source), ss;
+    ASSERT_TRUE(driver.parse(src));
+    driver.print(ss) << "\n";
+    ASSERT_TRUE(tacdriver.parse(ss));
+    auto tac_list = tacdriver.get_tacbuilder()->GetTACList();
+
+    auto fbegin = tac_list->begin();
+    while ((*fbegin)->operation_ != TACOperationType::Label || (*fbegin)->a_->get_tac_name(true) != "S0U_f")
+        ++fbegin;
+    auto fend = fbegin;
+    while ((*fend)->operation_ != TACOperationType::FunctionEnd)
+        ++fend;
+
+    auto cfg = std::make_shared<ControlFlowGraph>(fbegin, std::next(fend));
+    LiveAnalyzer liveAnalyzer(cfg);
+    RegAllocator regAllocator(liveAnalyzer);
+
+    std::map<int, std::vector<std::shared_ptr<Symbol>>> slots;
+    for (auto sym : liveAnalyzer.get_allSymSet())
+    {
+        auto symAttr = regAllocator.get_SymAttribute(sym);
+        if (symAttr.attr.store_type == SymAttribute::STACK_VAR)
+            slots[symAttr.value].push_back(sym);
+    }
+
+    size_t spilled = 0;
+    for (auto &[offset, syms] : slots)
+    {
+        spilled += syms.size();
+        SymLiveInfo occupy;
+        for (auto sym : syms)
+        {
+            for (auto range : liveAnalyzer.get_symLiveInfo(sym)->liveIntervalSet)
+                EXPECT_NO_THROW(occupy.addUncoveredLiveInterval(range)) << sym->get_tac_name(true) << " at " << offset;
+        }
+    }
+    EXPECT_LT(slots.size(), spilled);
 }
\ No newline at end of file
@@ -466,4 +466,92 @@ TEST(TACBuilder, DISABLED_VarArrayInit1) {
   //                  ->subarray->at(0)
   //                  ->ret->value_.GetInt());
   std::cout << arrayExp->tac->ToString() << std::endl;
+}
+
+TEST(TACBuilder, FoldConstFloatArrayRead) {
+  using namespace std;
+  using namespace HaveFunCompiler::ThreeAddressCode;
+  HaveFunCompiler::Parser::location loc;
+  auto builder = make_unique<TACBuilder>();
+  builder->SetLocation(&loc);
+  // const float w[2] = {3, 2.5}; w[0] / 2
+  auto array1 = builder->NewArrayDescriptor();
+  array1->dimensions = {2};
+  array1->base_offset = builder->CreateConstExp(0)->ret;
+  array1->value_type = SymbolValue::ValueType::Float;
+  auto arraySym = builder->NewSymbol(SymbolType::Constant, "w", SymbolValue(array1), 0);
+  array1->base_addr = arraySym;
+  auto arrayExp = builder->NewExp(builder->NewTACList(), arraySym);
+
+  auto array2 = builder->NewArrayDescriptor();
+  { array2->subarray->emplace(0, builder->CreateConstExp(3)); }
+  { array2->subarray->emplace(1, builder->CreateConstExp(2.5f)); }
+  builder->CreateArrayInit(arrayExp, builder->CreateConstExp(array2));
+
+  auto w0 = builder->FoldConstArrayRead(builder->AccessArray(arrayExp, {builder->CreateConstExp(0)}));
+  ASSERT_EQ(SymbolValue::ValueType::Float, w0->ret->value_.Type());
+  EXPECT_FLOAT_EQ(3.0f, w0->ret->value_.GetFloat());
+  auto quotient = builder->CreateArithmeticOperation(TACOperationType::Div, w0, builder->CreateConstExp(2));
+  ASSERT_EQ(SymbolValue::ValueType::Float, quotient->ret->value_.Type());
+  EXPECT_FLOAT_EQ(1.5f, quotient->ret->value_.GetFloat());
+
+  //不经过CreateArrayInit转换的整数初值也按元素类型读出
+  auto w1 = builder->AccessArray(arrayExp, {builder->CreateConstExp(1)});
+  w1->ret->value_.GetArrayDescriptor()->subarray->clear();
+  w1->ret->value_.GetArrayDescriptor()->subarray->emplace(0, builder->CreateConstExp(7));
+  auto folded = builder->FoldConstArrayRead(w1);
+  ASSERT_EQ(SymbolValue::ValueType::Float, folded->ret->value_.Type());
+  EXPECT_FLOAT_EQ(7.0f, folded->ret->value_.GetFloat());
+}
+
+TEST(TACBuilder, HornerAccessArray) {
+  using namespace std;
+  using namespace HaveFunCompiler::ThreeAddressCode;
+  HaveFunCompiler::Parser::location loc;
+  auto builder = make_unique<TACBuilder>();
+  builder->SetLocation(&loc);
+  auto array1 = builder->NewArrayDescriptor();
+  array1->dimensions = {4, 5, 6};
+  array1->base_offset = builder->CreateConstExp(0)->ret;
+  array1->value_type = SymbolValue::ValueType::Int;
+  auto arraySym = builder->NewSymbol(SymbolType::Variable, "hahaha", SymbolValue(array1), 0);
+  array1->base_addr = arraySym;
+  auto arrayExp = builder->NewExp(builder->NewTACList(), arraySym);
+
+  auto tmpV1 = builder->CreateTempVariable(SymbolValue::ValueType::Int);
+  auto tmpV2 = builder->CreateTempVariable(SymbolValue::ValueType::Int);
+  auto tmpE1 = builder->NewExp(builder->NewTACList(), tmpV1);
+  auto tmpE2 = builder->NewExp(builder->NewTACList(), tmpV2);
+  // hahaha[i][2][k] 的偏移为 i * 30 + k + 12，常量部分最后加一次
+  auto ret = builder->AccessArray(arrayExp, {tmpE1, builder->CreateConstExp(2), tmpE2});
+  std::vector<ThreeAddressCodePtr> calc;
+  for (auto &tac : *ret->tac) {
+    if (tac->operation_ != TACOperationType::Variable) {
+      calc.push_back(tac);
+    }
+  }
+  ASSERT_EQ(3u, calc.size());
+  EXPECT_EQ(TACOperationType::Mul, calc[0]->operation_);
+  EXPECT_EQ(tmpV1, calc[0]->b_);
+  EXPECT_EQ(30, calc[0]->c_->value_.GetInt());
+  EXPECT_EQ(TACOperationType::Add, calc[1]->operation_);
+  EXPECT_EQ(calc[0]->a_, calc[1]->b_);
+  EXPECT_EQ(tmpV2, calc[1]->c_);
+  EXPECT_EQ(TACOperationType::Add, calc[2]->operation_);
+  EXPECT_EQ(calc[1]->a_, calc[2]->b_);
+  EXPECT_EQ(12, calc[2]->c_->value_.GetInt());
+  EXPECT_EQ(calc[2]->a_, ret->ret->value_.GetArrayDescriptor()->base_offset);
+
+  //常量下标全部并入最后一次加法，不出现乘1和加0
+  auto row = builder->AccessArray(arrayExp, {builder->CreateConstExp(1), builder->CreateConstExp(3), tmpE2});
+  calc.clear();
+  for (auto &tac : *row->tac) {
+    if (tac->operation_ != TACOperationType::Variable) {
+      calc.push_back(tac);
+    }
+  }
+  ASSERT_EQ(1u, calc.size());
+  EXPECT_EQ(TACOperationType::Add, calc[0]->operation_);
+  EXPECT_EQ(tmpV2, calc[0]->b_);
+  EXPECT_EQ(48, calc[0]->c_->value_.GetInt());
 }
\ No newline at end of file